@@ -0,0 +1,8 @@
+#include "bvh.h"
+#include "bvh.tcc"
+
+template class BoundingVolumeHierarchy<float, 2u>;
+template class BoundingVolumeHierarchy<float, 3u>;
+
+template class LinearBoundingVolumeHierarchy<float, 2u>;
+template class LinearBoundingVolumeHierarchy<float, 3u>;
@@ -0,0 +1,650 @@
+#ifndef BVH_H
+#define BVH_H
+
+
+#include "geometry.h"
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// contains a bounding volume hierarchy (bvh) over the aabbs of arbitrary primitives, e.g. spheres or triangles.
+// the hierarchy only knows the aabb of each primitive, the primitive itself is identified by its index.
+
+class ThreadPool;
+
+
+/*
+ a binary tree of aabbs built with the binned surface area heuristic (sah)
+
+ each inner node is split into two children along the axis and position with the
+ smallest expected intersection cost:
+
+   cost = traversal_cost + intersection_cost * (area(left) * |left| + area(right) * |right|) / area(node)
+
+ a leaf stores a range [first, first + count) of primitive_indices()
+ if the primitives of a leaf are tested leaf_width at a time (e.g. by a SphereSet), |left| and |right|
+ are the number of such tests, i.e. the primitive counts divided by leaf_width and rounded up
+
+ alternatively the hierarchy is built as a linear bvh (lbvh): the primitives are sorted along a morton
+ (z-order) curve through their centroids and each node is split where the morton codes of its primitives
+ begin to differ. this is an order of magnitude faster than the sah build, e.g. for scenes that change
+ every frame, at the price of a higher sah_cost(). build_time() and sah_cost() allow to pick the builder
+ per scene.
+
+ for triangles, a spatial split bvh (sbvh) may also split a node by a plane that cuts the triangles crossing
+ it. both children then reference such a triangle with the aabb of its part on their side, so that long thin
+ triangles no longer make the children overlap. a triangle may therefore be in more than one leaf.
+*/
+template <class FLOAT, size_t N>
+class BoundingVolumeHierarchy {
+public:
+  static constexpr size_t no_hit = static_cast<size_t>(-1);
+  static constexpr size_t bins = 16u;
+  static constexpr size_t max_depth = 64u; // deeper nodes become leaves
+  static constexpr FLOAT traversal_cost = 1.0;
+  static constexpr FLOAT intersection_cost = 1.0;
+  static constexpr size_t morton_bits = 64u / N; // bits per axis of the morton codes, e.g. 21 for N = 3
+
+  enum class Builder { sah, morton };
+
+  struct Node {
+    AxisAlignedBoundingBox<FLOAT, N> bounds;
+    std::unique_ptr<Node> left, right; // both are nullptr for leaves
+    size_t first, count;               // range of primitive_indices(), count is zero for inner nodes
+    size_t axis;                       // split axis of inner nodes
+  };
+
+  // builds the hierarchy over the given aabbs, the i-th aabb belongs to the primitive with index i
+  // nodes with max_leaf_size or less primitives become leaves if the sah does not favour a split
+  // leaf_width is the number of primitives tested at once in a leaf, see above
+  // the morton builder sorts the primitives and emits the nodes on the workers of pool if it is not nullptr,
+  // the sah builder ignores pool
+  explicit BoundingVolumeHierarchy(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, size_t max_leaf_size = 4u, size_t leaf_width = 1u,
+                                   Builder builder = Builder::sah, ThreadPool * pool = nullptr);
+
+  // searches the primitive closest to the ray origin
+  // intersect(i, t) is called for each primitive i whose aabb is hit within [t_min, t],
+  //   it has to return true iff primitive i is hit at a value t_hit with t_min < t_hit < t
+  //   and set t to t_hit in this case
+  // t has to be initialized with the largest accepted value (e.g. INFINITY), it contains the
+  // value of the closest hit afterwards
+  // returns the index of the closest primitive or no_hit
+  template <class INTERSECT>
+  size_t closest_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t, INTERSECT intersect) const;
+
+  // searches any primitive between t_min and t_max, e.g. a blocker of a shadow ray
+  // occludes(i) is called for each primitive i whose aabb is hit within [t_min, t_max],
+  //   it has to return true iff primitive i is hit at a value t with t_min < t < t_max
+  // the traversal stops at the first primitive for which occludes() returns true,
+  // neither the hit values nor the order of the children are tracked
+  // returns the index of this primitive or no_hit
+  template <class OCCLUDES>
+  size_t any_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max, OCCLUDES occludes) const;
+
+  // returns the root of the tree or nullptr if the hierarchy is empty
+  const Node * root() const;
+
+  // the primitive indices in leaf order, after a spatial split build a primitive may occur more than once
+  const std::vector<size_t> & primitive_indices() const;
+
+  size_t node_count() const;
+  size_t depth() const;
+
+  // returns the sah cost of the whole tree relative to the root area
+  FLOAT sah_cost() const;
+
+  // returns the number of bytes used by the nodes and primitive indices
+  size_t memory_size() const;
+
+  // builds a spatial split bvh over the given triangles, the i-th triangle is the primitive with index i
+  // at most max_growth * triangles.size() references are added by spatial splits, e.g. 0.3 for 30% more
+  // primitive indices, with a max_growth of zero the result is the same as the sah build of their aabbs
+  BoundingVolumeHierarchy(const std::vector<std::array<Vector<FLOAT, N>, 3u>> & triangles, FLOAT max_growth, size_t max_leaf_size = 4u);
+
+  // returns the seconds the constructor needed to build the hierarchy
+  double build_time() const;
+
+  // interleaves the bits of the quantized coordinates, bit i of axis k becomes bit i * N + k of the code
+  static uint64_t morton_code(const std::array<uint64_t, N> & coordinates);
+
+private:
+  std::unique_ptr<Node> build(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, size_t first, size_t count, size_t max_leaf_size, size_t depth);
+
+  // lbvh build, codes are the sorted morton codes of the primitives in indices
+  void build_morton(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, size_t max_leaf_size, ThreadPool * pool);
+  std::unique_ptr<Node> build_morton(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, const std::vector<uint64_t> & codes,
+                                     size_t first, size_t count, size_t max_leaf_size, size_t depth);
+
+  // returns the number of primitives of the left child of the range, axis is set to the axis of the split
+  static size_t morton_split(const std::vector<uint64_t> & codes, size_t first, size_t count, size_t & axis);
+
+  // a triangle or the part of a triangle within a node of the spatial split build
+  struct Reference {
+    size_t index;                  // index of the triangle
+    Vector<FLOAT, N> lower, upper; // aabb of the part
+  };
+  static constexpr FLOAT min_overlap = 1e-5; // spatial splits are only searched if the object split children overlap more (relative to the root area)
+
+  std::unique_ptr<Node> build_spatial(const std::vector<std::array<Vector<FLOAT, N>, 3u>> & triangles, std::vector<Reference> & references,
+                                      size_t max_leaf_size, size_t depth, size_t & budget, FLOAT root_area);
+
+  // clips the triangle to the aabb [lower, upper] and sets lower and upper to the aabb of the remaining part
+  // returns false if nothing remains
+  static bool clip(const std::array<Vector<FLOAT, N>, 3u> & triangle, Vector<FLOAT, N> & lower, Vector<FLOAT, N> & upper);
+
+  // number of intersection tests of a leaf with count primitives
+  size_t leaf_tests(size_t count) const;
+
+  template <class INTERSECT>
+  size_t closest_hit(const Node * node, RayQuery<FLOAT, N> &query, INTERSECT & intersect) const;
+
+  template <class OCCLUDES>
+  size_t any_hit(const Node * node, const RayQuery<FLOAT, N> &query, OCCLUDES & occludes) const;
+
+  std::unique_ptr<Node> tree;
+  std::vector<size_t> indices;
+  size_t leaf_width;
+  double seconds;
+};
+
+
+// the traversal is a template wrt the intersection function and therefore defined in this header
+template <class FLOAT, size_t N>
+template <class INTERSECT>
+size_t BoundingVolumeHierarchy<FLOAT, N>::closest_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t, INTERSECT intersect) const {
+  if (!tree) {
+    return no_hit;
+  }
+  RayQuery<FLOAT, N> query(ray, t_min, t);
+  size_t hit = closest_hit(tree.get(), query, intersect);
+  t = query.t_max;
+  return hit;
+}
+
+// query.t_max is the value of the closest hit found so far
+template <class FLOAT, size_t N>
+template <class INTERSECT>
+size_t BoundingVolumeHierarchy<FLOAT, N>::closest_hit(const Node * node, RayQuery<FLOAT, N> &query, INTERSECT & intersect) const {
+  FLOAT t_entry;
+  if ( !node->bounds.intersects(query, t_entry) ) {
+    return no_hit;
+  }
+  size_t hit = no_hit;
+  if (node->count > 0) {
+    for (size_t i = node->first; i < node->first + node->count; i++) {
+      if ( intersect(indices[i], query.t_max) ) {
+        hit = indices[i];
+      }
+    }
+    return hit;
+  }
+  size_t left = closest_hit(node->left.get(), query, intersect);
+  size_t right = closest_hit(node->right.get(), query, intersect);
+  return right != no_hit ? right : left;
+}
+
+template <class FLOAT, size_t N>
+template <class OCCLUDES>
+size_t BoundingVolumeHierarchy<FLOAT, N>::any_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max, OCCLUDES occludes) const {
+  if (!tree) {
+    return no_hit;
+  }
+  RayQuery<FLOAT, N> query(ray, t_min, t_max);
+  return any_hit(tree.get(), query, occludes);
+}
+
+template <class FLOAT, size_t N>
+template <class OCCLUDES>
+size_t BoundingVolumeHierarchy<FLOAT, N>::any_hit(const Node * node, const RayQuery<FLOAT, N> &query, OCCLUDES & occludes) const {
+  FLOAT t_entry;
+  if ( !node->bounds.intersects(query, t_entry) ) {
+    return no_hit;
+  }
+  if (node->count > 0) {
+    for (size_t i = node->first; i < node->first + node->count; i++) {
+      if ( occludes(indices[i]) ) {
+        return indices[i];
+      }
+    }
+    return no_hit;
+  }
+  size_t hit = any_hit(node->left.get(), query, occludes);
+  return hit != no_hit ? hit : any_hit(node->right.get(), query, occludes);
+}
+
+
+/*
+ a BoundingVolumeHierarchy flattened into an array of nodes in depth first order
+
+ the first child of an inner node directly follows its parent in the array, only the
+ index of the second child is stored. a node holds the min/max corners of its aabb,
+ so that for float and N = 3 a node needs 32 bytes and two nodes fit into a cache line.
+
+   nodes:  | root | left | left.left | left.right | right | ...
+              |                                      ^
+              +----------- offset -------------------+
+
+ each primitive has an 8 bit mask, e.g. the visibility of an object for different kinds of rays.
+ a query with a mask only visits primitives with (primitive mask & query mask) != 0, the last byte
+ of a node holds the union of the masks below it, so that subtrees without matching primitives are
+ culled before their aabb is tested.
+
+ the nodes and primitive arrays can be saved to a cache file with a fixed layout: a header followed by the
+ three arrays exactly as they are in memory. load() maps such a file and the hierarchy uses the mapped
+ arrays in place, so that a cached scene starts without a build and without parsing.
+
+   file:  | header | nodes | primitive indices | primitive masks |   (each array at a multiple of 64 bytes)
+*/
+template <class FLOAT, size_t N>
+class LinearBoundingVolumeHierarchy {
+public:
+  static constexpr size_t no_hit = static_cast<size_t>(-1);
+
+  typedef uint8_t Mask;
+  static constexpr Mask all = 0xFF;
+  static constexpr FLOAT max_degradation = 1.5;
+  static constexpr uint32_t cache_version = 1u; // changes whenever the layout of a cache file changes
+  static constexpr size_t max_leaf_count = UINT16_MAX;  // larger leaves are split in halves when flattening
+  // bound of the traversal stack: the depth of the built tree plus the levels that split a leaf of up to
+  // 2^32 primitives into leaves of at most max_leaf_count primitives
+  static constexpr size_t max_depth = BoundingVolumeHierarchy<FLOAT, N>::max_depth + 17u;
+
+  // number of rays of a packet whose aabb tests use a single instruction for float and N = 3
+#if defined(__AVX512F__)
+  static constexpr size_t packet_size = 16u;
+#else
+  static constexpr size_t packet_size = 8u;
+#endif
+
+  struct alignas(32) Node {
+    FLOAT lower[N], upper[N];
+    uint32_t offset;  // leaves: first primitive index, inner nodes: index of the second child
+    uint16_t count;   // number of primitives of a leaf, zero for inner nodes
+    uint8_t axis;     // split axis of inner nodes
+    Mask mask;        // union of the masks of all primitives below this node
+  };
+
+  // flattens the given hierarchy, throws std::length_error if it has more than UINT32_MAX primitive indices
+  // masks[i] is the mask of the primitive with index i, all primitives get the mask all if masks is empty
+  explicit LinearBoundingVolumeHierarchy(const BoundingVolumeHierarchy<FLOAT, N> & bvh, const std::vector<Mask> & masks = {});
+
+  // a copy always owns its arrays, also if other uses a mapped cache file
+  LinearBoundingVolumeHierarchy(const LinearBoundingVolumeHierarchy & other);
+  LinearBoundingVolumeHierarchy(LinearBoundingVolumeHierarchy && other) = default;
+  LinearBoundingVolumeHierarchy & operator=(const LinearBoundingVolumeHierarchy & other);
+  LinearBoundingVolumeHierarchy & operator=(LinearBoundingVolumeHierarchy && other) = default;
+
+  // returns a hash of the given aabbs and masks, i.e. of the input of the build, to be used as the key of a
+  // cache file. settings like the builder or the leaf size that also change the tree should go into seed
+  static uint64_t hash(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, const std::vector<Mask> & masks = {}, uint64_t seed = 0u);
+
+  // writes the hierarchy to a cache file that load() can map, the file is written under a temporary name
+  // unique to the calling process and thread and renamed afterwards, so that neither a concurrent load()
+  // nor a concurrent save() of the same scene sees a partial file
+  // returns false if the file could not be written
+  bool save(const std::string & path, uint64_t key) const;
+
+  // maps a cache file written by save(), the arrays are used in place without copying. the nodes and primitive
+  // indices are read once to check them, the pages of the primitive masks are read on first access
+  // returns nothing if the file does not exist, was written with another key, version, FLOAT, N or byte order,
+  // if its nodes would let a traversal leave the arrays or its stack or if one of its primitive indices is not
+  // less than primitive_count, the number of primitives of the scene, e.g. for a corrupted file
+  // refit() works on a private copy of the changed pages, the file itself is never modified
+  static std::optional<LinearBoundingVolumeHierarchy> load(const std::string & path, uint64_t key, size_t primitive_count);
+
+  // true if the arrays are mapped from a cache file
+  bool is_mapped() const;
+
+  // same as BoundingVolumeHierarchy::closest_hit()
+  // the child on the side of the ray origin (wrt the split axis) is visited first,
+  // so that far nodes are culled by the closer hits found before
+  // intersect() is only called for primitives whose mask shares a bit with the given mask
+  template <class INTERSECT>
+  size_t closest_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t, INTERSECT intersect, Mask mask = all) const;
+
+  // same as closest_hit(), but the primitives of a leaf are tested by a single call, e.g. with SIMD instructions
+  // intersect_leaf(first, count, t) is called for each leaf whose aabb is hit within [t_min, t], it has to search
+  //   the primitives primitive_indices()[first], ..., primitive_indices()[first + count - 1] with a
+  //   mask that matches the given mask, and return the index of the closest one that is hit at a value
+  //   t_hit with t_min < t_hit < t (and set t to t_hit), or no_hit
+  template <class INTERSECT_LEAF>
+  size_t closest_hit_leaves(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t, INTERSECT_LEAF intersect_leaf, Mask mask = all) const;
+
+  // searches the closest primitive for each active ray of the packet, like closest_hit() does for a single ray
+  // each node is tested against all rays at once and the children are visited in the order given by the
+  // signs of the packet, a packet that is not coherent is traced ray by ray instead
+  // intersect(i, lane, t) is called for each primitive i of a leaf whose aabb is hit by the ray of lane within
+  //   [t_min, t[lane]], it has the same meaning as intersect(i, t) in closest_hit() for this ray
+  // t and hit hold SIZE values, hit[lane] is only set if a primitive is hit by the ray of lane
+  template <size_t SIZE, class INTERSECT>
+  void closest_hit(const RayPacket<FLOAT, N, SIZE> &packet, FLOAT t_min, FLOAT * t, size_t * hit, INTERSECT intersect, Mask mask = all) const;
+
+  // same as BoundingVolumeHierarchy::any_hit()
+  // occludes() is only called for primitives whose mask shares a bit with the given mask
+  template <class OCCLUDES>
+  size_t any_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max, OCCLUDES occludes, Mask mask = all) const;
+
+  // tests the rays of the given lanes against the aabb of node within [t_min, t[lane]]
+  // bit l of the result is set iff the ray of lane l hits the aabb, the packet has to be coherent
+  template <size_t SIZE>
+  static uint32_t intersects(const Node & node, const RayPacket<FLOAT, N, SIZE> & packet, FLOAT t_min, const FLOAT * t, uint32_t lanes);
+
+  // scalar implementation of intersects(), used if no SIMD instructions are available
+  template <size_t SIZE>
+  static uint32_t intersects_scalar(const Node & node, const RayPacket<FLOAT, N, SIZE> & packet, FLOAT t_min, const FLOAT * t, uint32_t lanes);
+
+  // recomputes the aabbs of all nodes bottom-up from the aabbs of the moved primitives, e.g. for the next
+  // frame of an animation, the tree itself is not changed
+  // boxes[i] is the aabb of the primitive with index i, like in the constructor of BoundingVolumeHierarchy
+  // the subtrees below the upper levels are refitted on the workers of pool if it is not nullptr
+  // returns degradation(), the hierarchy should be built again if it exceeds max_degradation
+  FLOAT refit(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, ThreadPool * pool = nullptr);
+
+  // returns the sah cost of the nodes relative to the root area, like BoundingVolumeHierarchy::sah_cost()
+  // with a leaf width of one
+  FLOAT sah_cost() const;
+
+  // returns sah_cost() relative to the sah cost after the construction, refits of moving primitives
+  // let the aabbs of the nodes overlap more and more
+  FLOAT degradation() const;
+
+  std::span<const Node> get_nodes() const;
+
+  // the primitive indices in leaf order
+  std::span<const uint32_t> primitive_indices() const;
+
+  // the masks of the primitives in leaf order, i.e. primitive_masks()[k] belongs to primitive_indices()[k]
+  std::span<const Mask> primitive_masks() const;
+
+  // returns the number of bytes used by the nodes, primitive indices and primitive masks
+  size_t memory_size() const;
+
+private:
+  static constexpr size_t cache_alignment = 64u;
+
+  // the first bytes of a cache file, all fields have their natural alignment so the layout has no padding
+  struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;  // 0x01020304 as written by the saving machine
+    uint32_t float_size, dimension, node_size, mask_size;
+    uint64_t key;
+    uint64_t node_count, index_count;
+    uint64_t nodes_offset, indices_offset, masks_offset;
+    double built_cost;
+  };
+
+  LinearBoundingVolumeHierarchy() = default;
+
+  // returns the header that save() writes for this hierarchy and that load() expects
+  CacheHeader cache_header(uint64_t key) const;
+
+  // returns true if the nodes are in depth first order, all child offsets and leaf ranges are inside the
+  // arrays and no traversal needs more than max_depth stack entries
+  bool consistent() const;
+
+  // lets the arrays point to the owned vectors
+  void own();
+
+  uint32_t flatten(const typename BoundingVolumeHierarchy<FLOAT, N>::Node * node);
+
+  // flattens the leaf [first, first + count), leaves with more than max_leaf_count primitives are split
+  uint32_t flatten(const AxisAlignedBoundingBox<FLOAT, N> & bounds, size_t first, size_t count);
+
+  // appends a node with the given aabb, returns its index
+  uint32_t add_node(const AxisAlignedBoundingBox<FLOAT, N> & bounds);
+
+  // refits the nodes [first, last) in reverse order, i.e. the children before their parents
+  void refit(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, uint32_t first, uint32_t last);
+
+  // checks if the aabb of node is hit within [query.t_min, query.t_max]
+  static bool intersects(const Node & node, const RayQuery<FLOAT, N> & query);
+
+  // the arrays used by all queries, they point either into the vectors below or into a mapped cache file
+  std::span<Node> nodes;
+  std::span<const uint32_t> indices;
+  std::span<const Mask> masks;
+
+  std::vector<Node> node_storage;
+  std::vector<uint32_t> index_storage;
+  std::vector<Mask> mask_storage;
+  std::shared_ptr<void> mapping;  // unmaps the cache file when the last reference is gone
+  FLOAT built_cost = 0.0;  // sah_cost() after the construction
+};
+
+static_assert(sizeof(LinearBoundingVolumeHierarchy<float, 3u>::Node) == 32u);
+
+
+template <class FLOAT, size_t N>
+inline bool LinearBoundingVolumeHierarchy<FLOAT, N>::intersects(const Node & node, const RayQuery<FLOAT, N> & query) {
+  FLOAT t_min = query.t_min,
+        t_max = query.t_max;
+  for (size_t i = 0; i < N; i++) {
+    FLOAT t_near = ( (query.negative[i] ? node.upper[i] : node.lower[i]) - query.origin[i] ) * query.inverse_direction[i];
+    FLOAT t_far = ( (query.negative[i] ? node.lower[i] : node.upper[i]) - query.origin[i] ) * query.inverse_direction[i];
+    t_min = t_near > t_min ? t_near : t_min;
+    t_max = t_far < t_max ? t_far : t_max;
+  }
+  return t_min <= t_max;
+}
+
+template <class FLOAT, size_t N>
+template <class INTERSECT>
+size_t LinearBoundingVolumeHierarchy<FLOAT, N>::closest_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t, INTERSECT intersect, Mask mask) const {
+  return closest_hit_leaves(ray, t_min, t, [&](uint32_t first, uint32_t count, FLOAT & t_max) {
+    size_t hit = no_hit;
+    for (uint32_t i = first; i < first + count; i++) {
+      if ( (masks[i] & mask) && intersect(indices[i], t_max) ) {
+        hit = indices[i];
+      }
+    }
+    return hit;
+  }, mask);
+}
+
+template <class FLOAT, size_t N>
+template <class INTERSECT_LEAF>
+size_t LinearBoundingVolumeHierarchy<FLOAT, N>::closest_hit_leaves(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t, INTERSECT_LEAF intersect_leaf, Mask mask) const {
+  if (nodes.empty()) {
+    return no_hit;
+  }
+  RayQuery<FLOAT, N> query(ray, t_min, t);
+
+  uint32_t stack[max_depth];
+  size_t top = 0;
+  uint32_t current = 0;
+  size_t hit = no_hit;
+  while (true) {
+    const Node & node = nodes[current];
+    if ( (node.mask & mask) && intersects(node, query) ) {
+      if (node.count > 0) {
+        size_t leaf_hit = intersect_leaf(node.offset, static_cast<uint32_t>(node.count), t);
+        if (leaf_hit != no_hit) {
+          hit = leaf_hit;
+        }
+        query.t_max = t; // the address of query must not escape, to keep it in registers
+      } else if (query.negative[node.axis]) {
+        stack[top++] = current + 1;
+        current = node.offset;
+        continue;
+      } else {
+        stack[top++] = node.offset;
+        current = current + 1;
+        continue;
+      }
+    }
+    if (top == 0) {
+      break;
+    }
+    current = stack[--top];
+  }
+  return hit;
+}
+
+template <class FLOAT, size_t N>
+template <size_t SIZE>
+inline uint32_t LinearBoundingVolumeHierarchy<FLOAT, N>::intersects_scalar(const Node & node, const RayPacket<FLOAT, N, SIZE> & packet, FLOAT t_min, const FLOAT * t, uint32_t lanes) {
+  uint32_t hit = 0u;
+  for (; lanes != 0u; lanes &= lanes - 1u) {
+    unsigned l = static_cast<unsigned>( std::countr_zero(lanes) );
+    FLOAT t0 = t_min, t1 = t[l];
+    for (size_t i = 0; i < N; i++) {
+      FLOAT t_near = ( (packet.negative[i] ? node.upper[i] : node.lower[i]) - packet.origin[i][l] ) * packet.inverse_direction[i][l];
+      FLOAT t_far = ( (packet.negative[i] ? node.lower[i] : node.upper[i]) - packet.origin[i][l] ) * packet.inverse_direction[i][l];
+      t0 = t_near > t0 ? t_near : t0;
+      t1 = t_far < t1 ? t_far : t1;
+    }
+    hit |= static_cast<uint32_t>(t0 <= t1) << l;
+  }
+  return hit;
+}
+
+// the same slab test as for a single ray, with the rays of the packet in the lanes of one register
+template <class FLOAT, size_t N>
+template <size_t SIZE>
+inline uint32_t LinearBoundingVolumeHierarchy<FLOAT, N>::intersects(const Node & node, const RayPacket<FLOAT, N, SIZE> & packet, FLOAT t_min, const FLOAT * t, uint32_t lanes) {
+#if defined(__AVX512F__)
+  if constexpr (std::is_same_v<FLOAT, float> && N == 3u && SIZE == 16u) {
+    __m512 t0 = _mm512_set1_ps(t_min),
+           t1 = _mm512_loadu_ps(t);
+    for (size_t i = 0; i < N; i++) {
+      __m512 o = _mm512_load_ps(packet.origin[i]),
+             inv = _mm512_load_ps(packet.inverse_direction[i]);
+      __m512 near = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(packet.negative[i] ? node.upper[i] : node.lower[i]), o), inv);
+      __m512 far = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(packet.negative[i] ? node.lower[i] : node.upper[i]), o), inv);
+      // returns the second operand if near is NaN, like the scalar slab test; the zero masked form with all
+      // lanes set avoids the undefined source register of _mm512_max_ps() that GCC 12 warns about
+      t0 = _mm512_maskz_max_ps(0xFFFF, near, t0);
+      t1 = _mm512_maskz_min_ps(0xFFFF, far, t1);
+    }
+    return _mm512_mask_cmp_ps_mask(static_cast<__mmask16>(lanes), t0, t1, _CMP_LE_OQ);
+  }
+#endif
+#if defined(__AVX__)
+  if constexpr (std::is_same_v<FLOAT, float> && N == 3u && SIZE == 8u) {
+    __m256 t0 = _mm256_set1_ps(t_min),
+           t1 = _mm256_loadu_ps(t);
+    for (size_t i = 0; i < N; i++) {
+      __m256 o = _mm256_load_ps(packet.origin[i]),
+             inv = _mm256_load_ps(packet.inverse_direction[i]);
+      __m256 near = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(packet.negative[i] ? node.upper[i] : node.lower[i]), o), inv);
+      __m256 far = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(packet.negative[i] ? node.lower[i] : node.upper[i]), o), inv);
+      t0 = _mm256_max_ps(near, t0);
+      t1 = _mm256_min_ps(far, t1);
+    }
+    return static_cast<uint32_t>( _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)) ) & lanes;
+  }
+#endif
+  return intersects_scalar(node, packet, t_min, t, lanes);
+}
+
+// a node is visited if any active ray hits it, the primitives of a leaf are only tested with the rays that hit the leaf
+template <class FLOAT, size_t N>
+template <size_t SIZE, class INTERSECT>
+void LinearBoundingVolumeHierarchy<FLOAT, N>::closest_hit(const RayPacket<FLOAT, N, SIZE> &packet, FLOAT t_min, FLOAT * t, size_t * hit, INTERSECT intersect, Mask mask) const {
+  if (!packet.coherent) {
+    for (uint32_t lanes = packet.active; lanes != 0u; lanes &= lanes - 1u) {
+      unsigned l = static_cast<unsigned>( std::countr_zero(lanes) );
+      size_t lane_hit = closest_hit(packet.ray(l), t_min, t[l], [&](size_t i, FLOAT & t_lane) {
+        return intersect(i, l, t_lane);
+      }, mask);
+      if (lane_hit != no_hit) {
+        hit[l] = lane_hit;
+      }
+    }
+    return;
+  }
+  if (nodes.empty()) {
+    return;
+  }
+
+  uint32_t stack[max_depth];
+  size_t top = 0;
+  uint32_t current = 0;
+  while (true) {
+    const Node & node = nodes[current];
+    uint32_t lanes = (node.mask & mask) ? intersects(node, packet, t_min, t, packet.active) : 0u;
+    if (lanes != 0u) {
+      if (node.count > 0) {
+        for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+          if ( !(masks[i] & mask) ) {
+            continue;
+          }
+          for (uint32_t rest = lanes; rest != 0u; rest &= rest - 1u) {
+            unsigned l = static_cast<unsigned>( std::countr_zero(rest) );
+            if ( intersect(indices[i], l, t[l]) ) {
+              hit[l] = indices[i];
+            }
+          }
+        }
+      } else if (packet.negative[node.axis]) {
+        stack[top++] = current + 1;
+        current = node.offset;
+        continue;
+      } else {
+        stack[top++] = node.offset;
+        current = current + 1;
+        continue;
+      }
+    }
+    if (top == 0) {
+      break;
+    }
+    current = stack[--top];
+  }
+}
+
+// the interval of the query is never shortened, so the children are visited in array order
+template <class FLOAT, size_t N>
+template <class OCCLUDES>
+size_t LinearBoundingVolumeHierarchy<FLOAT, N>::any_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max, OCCLUDES occludes, Mask mask) const {
+  if (nodes.empty()) {
+    return no_hit;
+  }
+  RayQuery<FLOAT, N> query(ray, t_min, t_max);
+
+  uint32_t stack[max_depth];
+  size_t top = 0;
+  uint32_t current = 0;
+  while (true) {
+    const Node & node = nodes[current];
+    if ( (node.mask & mask) && intersects(node, query) ) {
+      if (node.count > 0) {
+        for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+          if ( (masks[i] & mask) && occludes(indices[i]) ) {
+            return indices[i];
+          }
+        }
+      } else {
+        stack[top++] = node.offset;
+        current = current + 1;
+        continue;
+      }
+    }
+    if (top == 0) {
+      break;
+    }
+    current = stack[--top];
+  }
+  return no_hit;
+}
+
+
+typedef BoundingVolumeHierarchy<float, 2u> BVH2df;
+typedef BoundingVolumeHierarchy<float, 3u> BVH3df;
+
+typedef LinearBoundingVolumeHierarchy<float, 2u> LinearBVH2df;
+typedef LinearBoundingVolumeHierarchy<float, 3u> LinearBVH3df;
+
+#endif
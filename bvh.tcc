@@ -0,0 +1,1181 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+template <class FLOAT, size_t N>
+BoundingVolumeHierarchy<FLOAT, N>::BoundingVolumeHierarchy(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, size_t max_leaf_size, size_t leaf_width,
+                                                           Builder builder, ThreadPool * pool)
+  : indices(boxes.size()), leaf_width(std::max<size_t>(1u, leaf_width)), seconds(0.0)
+{
+  auto start = std::chrono::steady_clock::now();
+  if (builder == Builder::morton) {
+    build_morton(boxes, std::max<size_t>(1u, max_leaf_size), pool);
+  } else {
+    for (size_t i = 0; i < indices.size(); i++) {
+      indices[i] = i;
+    }
+    if (!boxes.empty()) {
+      tree = build(boxes, 0, boxes.size(), std::max<size_t>(1u, max_leaf_size), 1u);
+    }
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+// binned sah build:
+// the centroids of the aabbs are sorted into bins along each axis, the best split
+// plane is searched among the bin borders
+template <class FLOAT, size_t N>
+std::unique_ptr<typename BoundingVolumeHierarchy<FLOAT, N>::Node>
+BoundingVolumeHierarchy<FLOAT, N>::build(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, size_t first, size_t count, size_t max_leaf_size, size_t depth) {
+  AxisAlignedBoundingBox<FLOAT, N> bounds = boxes[indices[first]];
+  Vector<FLOAT, N> centroid_min = bounds.get_center(),
+                   centroid_max = bounds.get_center();
+  for (size_t i = first + 1; i < first + count; i++) {
+    bounds = bounds.merge(boxes[indices[i]]);
+    Vector<FLOAT, N> centroid = boxes[indices[i]].get_center();
+    for (size_t k = 0; k < N; k++) {
+      centroid_min[k] = std::min(centroid_min[k], centroid[k]);
+      centroid_max[k] = std::max(centroid_max[k], centroid[k]);
+    }
+  }
+
+  std::unique_ptr<Node> node(new Node{bounds, nullptr, nullptr, first, count, 0u});
+  if (count == 1 || depth >= max_depth) {
+    return node;
+  }
+
+  struct Bin {
+    AxisAlignedBoundingBox<FLOAT, N> bounds{ {0.0, }, {0.0, } };
+    size_t count = 0;
+  };
+
+  FLOAT best_cost = INFINITY;
+  size_t best_axis = N, best_bin = 0;
+  FLOAT area = bounds.surface_area();
+
+  for (size_t axis = 0; axis < N; axis++) {
+    FLOAT extent = centroid_max[axis] - centroid_min[axis];
+    if (extent <= 0.0) {
+      continue; // all centroids on a plane orthogonal to axis
+    }
+    std::array<Bin, bins> bin;
+    for (size_t i = first; i < first + count; i++) {
+      size_t b = std::min(bins - 1, static_cast<size_t>( bins * (boxes[indices[i]].get_center()[axis] - centroid_min[axis]) / extent ));
+      bin[b].bounds = bin[b].count == 0 ? boxes[indices[i]] : bin[b].bounds.merge(boxes[indices[i]]);
+      bin[b].count++;
+    }
+
+    // right_area[b] and right_count[b] belong to the bins b+1, ..., bins-1
+    std::array<FLOAT, bins> right_area{};
+    std::array<size_t, bins> right_count{};
+    Bin right;
+    for (size_t b = bins - 1; b > 0; b--) {
+      if (bin[b].count > 0) {
+        right.bounds = right.count == 0 ? bin[b].bounds : right.bounds.merge(bin[b].bounds);
+        right.count += bin[b].count;
+      }
+      right_area[b - 1] = right.bounds.surface_area();
+      right_count[b - 1] = right.count;
+    }
+
+    Bin left;
+    for (size_t b = 0; b < bins - 1; b++) {
+      if (bin[b].count > 0) {
+        left.bounds = left.count == 0 ? bin[b].bounds : left.bounds.merge(bin[b].bounds);
+        left.count += bin[b].count;
+      }
+      if (left.count == 0 || right_count[b] == 0) {
+        continue;
+      }
+      FLOAT cost = left.bounds.surface_area() * leaf_tests(left.count) + right_area[b] * leaf_tests(right_count[b]);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_bin = b;
+      }
+    }
+  }
+
+  if (best_axis == N) { // identical centroids, no split plane exists
+    if (count <= max_leaf_size) {
+      return node;
+    }
+    size_t half = count / 2;
+    node->left = build(boxes, first, half, max_leaf_size, depth + 1);
+    node->right = build(boxes, first + half, count - half, max_leaf_size, depth + 1);
+    node->count = 0;
+    return node;
+  }
+
+  FLOAT split_cost = area > 0.0 ? traversal_cost + intersection_cost * best_cost / area : INFINITY;
+  FLOAT leaf_cost = intersection_cost * leaf_tests(count);
+  if (count <= max_leaf_size && leaf_cost <= split_cost) {
+    return node;
+  }
+
+  FLOAT extent = centroid_max[best_axis] - centroid_min[best_axis];
+  auto middle = std::partition(indices.begin() + first, indices.begin() + first + count, [&](size_t index) {
+    size_t b = std::min(bins - 1, static_cast<size_t>( bins * (boxes[index].get_center()[best_axis] - centroid_min[best_axis]) / extent ));
+    return b <= best_bin;
+  });
+  size_t left_count = middle - (indices.begin() + first);
+
+  node->left = build(boxes, first, left_count, max_leaf_size, depth + 1);
+  node->right = build(boxes, first + left_count, count - left_count, max_leaf_size, depth + 1);
+  node->count = 0;
+  node->axis = best_axis;
+  return node;
+}
+
+
+template <class FLOAT, size_t N>
+BoundingVolumeHierarchy<FLOAT, N>::BoundingVolumeHierarchy(const std::vector<std::array<Vector<FLOAT, N>, 3u>> & triangles, FLOAT max_growth, size_t max_leaf_size)
+  : leaf_width(1u), seconds(0.0)
+{
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Reference> references;
+  references.reserve(triangles.size());
+  for (size_t i = 0; i < triangles.size(); i++) {
+    Reference reference = { i, triangles[i][0], triangles[i][0] };
+    for (size_t v = 1; v < 3; v++) {
+      for (size_t k = 0; k < N; k++) {
+        reference.lower[k] = std::min(reference.lower[k], triangles[i][v][k]);
+        reference.upper[k] = std::max(reference.upper[k], triangles[i][v][k]);
+      }
+    }
+    references.push_back(reference);
+  }
+  if (!references.empty()) {
+    size_t budget = static_cast<size_t>(std::max<FLOAT>(0.0, max_growth) * triangles.size());
+    Vector<FLOAT, N> lower = references[0].lower,
+                     upper = references[0].upper;
+    for (const Reference & reference : references) {
+      for (size_t k = 0; k < N; k++) {
+        lower[k] = std::min(lower[k], reference.lower[k]);
+        upper[k] = std::max(upper[k], reference.upper[k]);
+      }
+    }
+    FLOAT root_area = AxisAlignedBoundingBox<FLOAT, N>( static_cast<FLOAT>(0.5) * (lower + upper), static_cast<FLOAT>(0.5) * (upper - lower) ).surface_area();
+    indices.reserve(triangles.size() + budget);
+    tree = build_spatial(triangles, references, std::max<size_t>(1u, max_leaf_size), 1u, budget, root_area);
+  }
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// sbvh build (stich et al. 2009):
+// the best object split is searched with binned sah like in build(). if its children overlap by more than
+// min_overlap of the root area, spatial splits are searched among the bin borders of the node aabb along each
+// axis: each reference is clipped to every bin it crosses and counted as entering its first and leaving its
+// last bin, so that a split at a bin border puts the references that cross it into both children. the split
+// with the smallest sah cost wins if its duplicated references fit into the remaining budget.
+// the leaves append their references to indices in depth first order
+template <class FLOAT, size_t N>
+std::unique_ptr<typename BoundingVolumeHierarchy<FLOAT, N>::Node>
+BoundingVolumeHierarchy<FLOAT, N>::build_spatial(const std::vector<std::array<Vector<FLOAT, N>, 3u>> & triangles, std::vector<Reference> & references,
+                                                 size_t max_leaf_size, size_t depth, size_t & budget, FLOAT root_area) {
+  struct Bin {
+    Vector<FLOAT, N> lower = {INFINITY}, upper = {-INFINITY};
+    size_t count = 0;
+
+    void grow(const Vector<FLOAT, N> & l, const Vector<FLOAT, N> & u) {
+      for (size_t k = 0; k < N; k++) {
+        lower[k] = std::min(lower[k], l[k]);
+        upper[k] = std::max(upper[k], u[k]);
+      }
+    }
+    FLOAT area() const {
+      return count == 0 ? 0.0 : AxisAlignedBoundingBox<FLOAT, N>( static_cast<FLOAT>(0.5) * (lower + upper), static_cast<FLOAT>(0.5) * (upper - lower) ).surface_area();
+    }
+  };
+
+  const size_t count = references.size();
+  Bin node_bounds, centroids;
+  for (const Reference & reference : references) {
+    node_bounds.grow(reference.lower, reference.upper);
+    Vector<FLOAT, N> centroid = static_cast<FLOAT>(0.5) * (reference.lower + reference.upper);
+    centroids.grow(centroid, centroid);
+  }
+  node_bounds.count = count;
+  const Vector<FLOAT, N> lower = node_bounds.lower, upper = node_bounds.upper;
+  std::unique_ptr<Node> node(new Node{ AxisAlignedBoundingBox<FLOAT, N>( static_cast<FLOAT>(0.5) * (lower + upper), static_cast<FLOAT>(0.5) * (upper - lower) ),
+                                       nullptr, nullptr, indices.size(), count, 0u });
+  auto leaf = [&]() {
+    for (const Reference & reference : references) {
+      indices.push_back(reference.index);
+    }
+    return std::move(node);
+  };
+  if (count == 1 || depth >= max_depth) {
+    return leaf();
+  }
+
+  FLOAT best_cost = INFINITY;
+  size_t best_axis = N, best_bin = 0;
+  bool spatial = false;
+
+  // object split, left_bounds and right_bounds of the best split give the overlap
+  Bin left_bounds, right_bounds;
+  for (size_t axis = 0; axis < N; axis++) {
+    FLOAT extent = centroids.upper[axis] - centroids.lower[axis];
+    if (extent <= 0.0) {
+      continue;
+    }
+    std::array<Bin, bins> bin;
+    for (const Reference & reference : references) {
+      FLOAT centroid = static_cast<FLOAT>(0.5) * (reference.lower[axis] + reference.upper[axis]);
+      size_t b = std::min(bins - 1, static_cast<size_t>( bins * (centroid - centroids.lower[axis]) / extent ));
+      bin[b].grow(reference.lower, reference.upper);
+      bin[b].count++;
+    }
+    std::array<Bin, bins> right; // right[b] contains the bins b+1, ..., bins-1
+    for (size_t b = bins - 1; b > 0; b--) {
+      right[b - 1] = right[b];
+      right[b - 1].grow(bin[b].lower, bin[b].upper);
+      right[b - 1].count += bin[b].count;
+    }
+    Bin left;
+    for (size_t b = 0; b < bins - 1; b++) {
+      left.grow(bin[b].lower, bin[b].upper);
+      left.count += bin[b].count;
+      if (left.count == 0 || right[b].count == 0) {
+        continue;
+      }
+      FLOAT cost = left.area() * leaf_tests(left.count) + right[b].area() * leaf_tests(right[b].count);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_bin = b;
+        left_bounds = left;
+        right_bounds = right[b];
+      }
+    }
+  }
+
+  // spatial split, bin b of axis covers [border(axis, b), border(axis, b + 1)]
+  auto border = [&](size_t axis, size_t b) {
+    return b == bins ? upper[axis] : lower[axis] + (upper[axis] - lower[axis]) * b / bins;
+  };
+  auto bin_of = [&](size_t axis, FLOAT x) {
+    return std::min(bins - 1, static_cast<size_t>( std::max<FLOAT>(0.0, bins * (x - lower[axis]) / (upper[axis] - lower[axis])) ));
+  };
+  Bin overlap;
+  overlap.count = best_axis < N;
+  for (size_t k = 0; k < N; k++) {
+    overlap.lower[k] = std::max(left_bounds.lower[k], right_bounds.lower[k]);
+    overlap.upper[k] = std::min(left_bounds.upper[k], right_bounds.upper[k]);
+    overlap.count = overlap.count && overlap.lower[k] <= overlap.upper[k];
+  }
+  if (budget > 0 && overlap.area() > min_overlap * root_area) {
+    for (size_t axis = 0; axis < N; axis++) {
+      if (upper[axis] - lower[axis] <= 0.0) {
+        continue;
+      }
+      std::array<Bin, bins> bin;               // count is the number of entering references
+      std::array<size_t, bins> exits{};
+      for (const Reference & reference : references) {
+        size_t first = bin_of(axis, reference.lower[axis]), last = bin_of(axis, reference.upper[axis]);
+        for (size_t b = first; b <= last; b++) {
+          Vector<FLOAT, N> l = reference.lower, u = reference.upper;
+          l[axis] = std::max(l[axis], border(axis, b));
+          u[axis] = std::min(u[axis], border(axis, b + 1));
+          if (clip(triangles[reference.index], l, u)) {
+            bin[b].grow(l, u);
+          }
+        }
+        bin[first].count++;
+        exits[last]++;
+      }
+      std::array<Bin, bins> right; // right[b] contains the bins b+1, ..., bins-1, count is the number of leaving references
+      for (size_t b = bins - 1; b > 0; b--) {
+        right[b - 1] = right[b];
+        right[b - 1].grow(bin[b].lower, bin[b].upper);
+        right[b - 1].count += exits[b];
+      }
+      Bin left;
+      for (size_t b = 0; b < bins - 1; b++) {
+        left.grow(bin[b].lower, bin[b].upper);
+        left.count += bin[b].count;
+        if (left.count == 0 || right[b].count == 0 || left.count + right[b].count - count > budget) {
+          continue;
+        }
+        FLOAT cost = left.area() * leaf_tests(left.count) + right[b].area() * leaf_tests(right[b].count);
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_bin = b;
+          spatial = true;
+        }
+      }
+    }
+  }
+
+  std::vector<Reference> left, right;
+  if (best_axis == N) { // identical centroids and no spatial split
+    if (count <= max_leaf_size) {
+      return leaf();
+    }
+    left.assign(references.begin(), references.begin() + count / 2);
+    right.assign(references.begin() + count / 2, references.end());
+    best_axis = 0;
+  } else {
+    FLOAT area = AxisAlignedBoundingBox<FLOAT, N>( static_cast<FLOAT>(0.5) * (lower + upper), static_cast<FLOAT>(0.5) * (upper - lower) ).surface_area();
+    FLOAT split_cost = area > 0.0 ? traversal_cost + intersection_cost * best_cost / area : INFINITY;
+    if (count <= max_leaf_size && intersection_cost * leaf_tests(count) <= split_cost) {
+      return leaf();
+    }
+    FLOAT extent = centroids.upper[best_axis] - centroids.lower[best_axis];
+    for (const Reference & reference : references) {
+      if (!spatial) {
+        FLOAT centroid = static_cast<FLOAT>(0.5) * (reference.lower[best_axis] + reference.upper[best_axis]);
+        size_t b = std::min(bins - 1, static_cast<size_t>( bins * (centroid - centroids.lower[best_axis]) / extent ));
+        (b <= best_bin ? left : right).push_back(reference);
+        continue;
+      }
+      size_t first = bin_of(best_axis, reference.lower[best_axis]), last = bin_of(best_axis, reference.upper[best_axis]);
+      if (last <= best_bin) {
+        left.push_back(reference);
+      } else if (first > best_bin) {
+        right.push_back(reference);
+      } else { // the reference crosses the plane and is clipped to both sides
+        FLOAT plane = border(best_axis, best_bin + 1);
+        Reference l = reference, r = reference;
+        l.upper[best_axis] = std::min(l.upper[best_axis], plane);
+        r.lower[best_axis] = std::max(r.lower[best_axis], plane);
+        bool has_left = clip(triangles[reference.index], l.lower, l.upper),
+             has_right = clip(triangles[reference.index], r.lower, r.upper);
+        if (has_left) {
+          left.push_back(l);
+        }
+        if (has_right || !has_left) {
+          right.push_back(has_right ? r : reference);
+        }
+        if (has_left && has_right && budget > 0) {
+          budget--;
+        }
+      }
+    }
+    if (left.empty() || right.empty()) { // the clipped parts all ended on one side
+      std::vector<Reference> & all = left.empty() ? right : left;
+      if (count <= max_leaf_size) {
+        return leaf();
+      }
+      left.assign(all.begin(), all.begin() + all.size() / 2);
+      right.assign(all.begin() + all.size() / 2, all.end());
+    }
+  }
+  references.clear();
+  references.shrink_to_fit();
+
+  node->left = build_spatial(triangles, left, max_leaf_size, depth + 1, budget, root_area);
+  node->right = build_spatial(triangles, right, max_leaf_size, depth + 1, budget, root_area);
+  node->count = 0;
+  node->axis = best_axis;
+  return node;
+}
+
+// sutherland-hodgman: the triangle is clipped against the 2 * N planes of the aabb,
+// each plane adds at most one vertex to the convex polygon
+template <class FLOAT, size_t N>
+bool BoundingVolumeHierarchy<FLOAT, N>::clip(const std::array<Vector<FLOAT, N>, 3u> & triangle, Vector<FLOAT, N> & lower, Vector<FLOAT, N> & upper) {
+  typedef std::array<FLOAT, N> Point;
+  Point polygon[2][3 + 2 * N];
+  size_t size = 3, current = 0;
+  for (size_t v = 0; v < 3; v++) {
+    for (size_t k = 0; k < N; k++) {
+      polygon[0][v][k] = triangle[v][k];
+    }
+  }
+  for (size_t axis = 0; axis < N; axis++) {
+    for (size_t side = 0; side < 2; side++) {
+      FLOAT plane = side == 0 ? lower[axis] : upper[axis];
+      auto inside = [&](const Point & p) {
+        return side == 0 ? p[axis] >= plane : p[axis] <= plane;
+      };
+      const Point * in = polygon[current];
+      Point * out = polygon[1 - current];
+      size_t out_size = 0;
+      for (size_t i = 0; i < size; i++) {
+        const Point & p = in[i], & q = in[(i + 1) % size];
+        if (inside(p)) {
+          out[out_size++] = p;
+        }
+        if (inside(p) != inside(q)) {
+          FLOAT s = (plane - p[axis]) / (q[axis] - p[axis]);
+          Point & x = out[out_size++];
+          for (size_t k = 0; k < N; k++) {
+            x[k] = p[k] + s * (q[k] - p[k]);
+          }
+          x[axis] = plane;
+        }
+      }
+      size = out_size;
+      current = 1 - current;
+      if (size == 0) {
+        return false;
+      }
+    }
+  }
+  Vector<FLOAT, N> clipped_lower = {INFINITY}, clipped_upper = {-INFINITY};
+  for (size_t v = 0; v < size; v++) {
+    for (size_t k = 0; k < N; k++) {
+      clipped_lower[k] = std::min(clipped_lower[k], polygon[current][v][k]);
+      clipped_upper[k] = std::max(clipped_upper[k], polygon[current][v][k]);
+    }
+  }
+  for (size_t k = 0; k < N; k++) { // rounding must not leave the aabb
+    lower[k] = std::max(lower[k], clipped_lower[k]);
+    upper[k] = std::min(upper[k], clipped_upper[k]);
+  }
+  return true;
+}
+
+// lbvh build:
+// 1. the centroids are quantized to morton_bits bits per axis within the aabb of all centroids and
+//    interleaved to morton codes
+// 2. the codes are sorted with a stable lsd radix sort of 11 bits per pass, each worker counts the digits
+//    of its block and scatters the block to the offsets of the prefix sums over all blocks
+// 3. a range of sorted codes is split where its first and last code begin to differ, i.e. all codes
+//    with a zero at the highest differing bit go to the left child. the upper levels are split serially
+//    until the ranges are small enough to be built as independent subtrees by the workers, afterwards
+//    the upper levels are assembled from the same splits
+// small nodes become leaves if the sah does not favour the split, like in the sah build
+template <class FLOAT, size_t N>
+void BoundingVolumeHierarchy<FLOAT, N>::build_morton(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, size_t max_leaf_size, ThreadPool * pool) {
+  const size_t count = boxes.size();
+  if (count == 0) {
+    return;
+  }
+  const size_t blocks = pool ? std::min(pool->size(), count) : 1u;
+  const size_t block_size = (count + blocks - 1) / blocks;
+  auto for_blocks = [&](const std::function<void(size_t, size_t, size_t)> & task) {
+    auto range = [&](size_t block) {
+      task(block, block * block_size, std::min(count, (block + 1) * block_size));
+    };
+    if (blocks > 1) {
+      pool->parallel_for(blocks, range);
+    } else {
+      range(0u);
+    }
+  };
+
+  std::vector<std::array<FLOAT, N>> lower(blocks), upper(blocks);
+  for_blocks([&](size_t block, size_t first, size_t last) {
+    lower[block].fill(INFINITY);
+    upper[block].fill(-INFINITY);
+    for (size_t i = first; i < last; i++) {
+      Vector<FLOAT, N> centroid = boxes[i].get_center();
+      for (size_t k = 0; k < N; k++) {
+        lower[block][k] = std::min(lower[block][k], centroid[k]);
+        upper[block][k] = std::max(upper[block][k], centroid[k]);
+      }
+    }
+  });
+  std::array<double, N> offset, scale;
+  for (size_t k = 0; k < N; k++) {
+    FLOAT min = INFINITY, max = -INFINITY;
+    for (size_t block = 0; block < blocks; block++) {
+      min = std::min(min, lower[block][k]);
+      max = std::max(max, upper[block][k]);
+    }
+    offset[k] = min;
+    scale[k] = max > min ? static_cast<double>(uint64_t(1) << morton_bits) / (static_cast<double>(max) - min) : 0.0;
+  }
+
+  struct Primitive {
+    uint64_t code;
+    size_t index;
+  };
+  std::vector<Primitive> primitives(count), sorted(count);
+  for_blocks([&](size_t, size_t first, size_t last) {
+    const uint64_t max_coordinate = (uint64_t(1) << morton_bits) - 1;
+    for (size_t i = first; i < last; i++) {
+      Vector<FLOAT, N> centroid = boxes[i].get_center();
+      std::array<uint64_t, N> coordinates;
+      for (size_t k = 0; k < N; k++) {
+        double q = (centroid[k] - offset[k]) * scale[k];
+        coordinates[k] = q > 0.0 ? std::min(max_coordinate, static_cast<uint64_t>(q)) : 0u;
+      }
+      primitives[i] = { morton_code(coordinates), i };
+    }
+  });
+
+  const size_t digit_bits = 11u, radix = size_t(1) << digit_bits;
+  std::vector<std::array<size_t, radix>> offsets(blocks);
+  for (size_t shift = 0; shift < morton_bits * N; shift += digit_bits) {
+    for_blocks([&](size_t block, size_t first, size_t last) {
+      offsets[block].fill(0u);
+      for (size_t i = first; i < last; i++) {
+        offsets[block][(primitives[i].code >> shift) & (radix - 1)]++;
+      }
+    });
+    size_t total = 0;
+    bool skip = false;
+    for (size_t digit = 0; digit < radix; digit++) {
+      size_t digit_count = 0;
+      for (size_t block = 0; block < blocks; block++) {
+        size_t block_count = offsets[block][digit];
+        offsets[block][digit] = total + digit_count;
+        digit_count += block_count;
+      }
+      skip = skip || digit_count == count; // all primitives have the same digit
+      total += digit_count;
+    }
+    if (skip) {
+      continue;
+    }
+    for_blocks([&](size_t block, size_t first, size_t last) {
+      for (size_t i = first; i < last; i++) {
+        sorted[offsets[block][(primitives[i].code >> shift) & (radix - 1)]++] = primitives[i];
+      }
+    });
+    primitives.swap(sorted);
+  }
+  sorted = std::vector<Primitive>();
+
+  std::vector<uint64_t> codes(count);
+  for_blocks([&](size_t, size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+      codes[i] = primitives[i].code;
+      indices[i] = primitives[i].index;
+    }
+  });
+
+  // ranges with at most grain primitives or at max_depth are built as subtrees by the workers
+  const size_t grain = blocks > 1 ? std::max(max_leaf_size, count / (4u * blocks)) : count;
+  struct Range {
+    size_t first, count, depth;
+  };
+  std::vector<Range> ranges;
+  std::function<void(size_t, size_t, size_t)> split = [&](size_t first, size_t count, size_t depth) {
+    if (count <= grain || depth >= max_depth) {
+      ranges.push_back({first, count, depth});
+      return;
+    }
+    size_t axis, left = morton_split(codes, first, count, axis);
+    split(first, left, depth + 1);
+    split(first + left, count - left, depth + 1);
+  };
+  split(0u, count, 1u);
+
+  std::vector<std::unique_ptr<Node>> subtrees(ranges.size());
+  auto build_subtree = [&](size_t k) {
+    subtrees[k] = build_morton(boxes, codes, ranges[k].first, ranges[k].count, max_leaf_size, ranges[k].depth);
+  };
+  if (blocks > 1 && ranges.size() > 1) {
+    pool->parallel_for(ranges.size(), build_subtree);
+  } else {
+    for (size_t k = 0; k < ranges.size(); k++) {
+      build_subtree(k);
+    }
+  }
+
+  // the same recursion as split(), the subtrees are taken in the order of ranges
+  size_t next = 0;
+  std::function<std::unique_ptr<Node>(size_t, size_t, size_t)> assemble = [&](size_t first, size_t count, size_t depth) {
+    if (count <= grain || depth >= max_depth) {
+      return std::move(subtrees[next++]);
+    }
+    size_t axis, left = morton_split(codes, first, count, axis);
+    std::unique_ptr<Node> left_child = assemble(first, left, depth + 1);
+    std::unique_ptr<Node> right_child = assemble(first + left, count - left, depth + 1);
+    AxisAlignedBoundingBox<FLOAT, N> bounds = left_child->bounds.merge(right_child->bounds);
+    return std::unique_ptr<Node>(new Node{bounds, std::move(left_child), std::move(right_child), first, 0u, axis});
+  };
+  tree = assemble(0u, count, 1u);
+}
+
+template <class FLOAT, size_t N>
+std::unique_ptr<typename BoundingVolumeHierarchy<FLOAT, N>::Node>
+BoundingVolumeHierarchy<FLOAT, N>::build_morton(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, const std::vector<uint64_t> & codes,
+                                                size_t first, size_t count, size_t max_leaf_size, size_t depth) {
+  auto range_bounds = [&](size_t first, size_t count) {
+    AxisAlignedBoundingBox<FLOAT, N> bounds = boxes[indices[first]];
+    for (size_t i = first + 1; i < first + count; i++) {
+      bounds = bounds.merge(boxes[indices[i]]);
+    }
+    return bounds;
+  };
+  bool identical = codes[first] == codes[first + count - 1];
+  if (count == 1 || depth >= max_depth || (identical && count <= max_leaf_size)) {
+    return std::unique_ptr<Node>(new Node{range_bounds(first, count), nullptr, nullptr, first, count, 0u});
+  }
+
+  size_t axis, left = morton_split(codes, first, count, axis);
+  if (count <= max_leaf_size) {
+    AxisAlignedBoundingBox<FLOAT, N> left_bounds = range_bounds(first, left),
+                                     right_bounds = range_bounds(first + left, count - left),
+                                     bounds = left_bounds.merge(right_bounds);
+    FLOAT area = bounds.surface_area();
+    FLOAT split_cost = area > 0.0 ? traversal_cost + intersection_cost * ( left_bounds.surface_area() * leaf_tests(left)
+                                                                         + right_bounds.surface_area() * leaf_tests(count - left) ) / area
+                                  : INFINITY;
+    if (intersection_cost * leaf_tests(count) <= split_cost) {
+      return std::unique_ptr<Node>(new Node{bounds, nullptr, nullptr, first, count, 0u});
+    }
+  }
+
+  std::unique_ptr<Node> node(new Node{boxes[indices[first]], nullptr, nullptr, first, 0u, axis});
+  node->left = build_morton(boxes, codes, first, left, max_leaf_size, depth + 1);
+  node->right = build_morton(boxes, codes, first + left, count - left, max_leaf_size, depth + 1);
+  node->bounds = node->left->bounds.merge(node->right->bounds);
+  return node;
+}
+
+// all codes of the range share the bits above the highest bit in which the first and the last code differ,
+// the codes with a zero at this bit precede the codes with a one since they are sorted
+template <class FLOAT, size_t N>
+size_t BoundingVolumeHierarchy<FLOAT, N>::morton_split(const std::vector<uint64_t> & codes, size_t first, size_t count, size_t & axis) {
+  uint64_t difference = codes[first] ^ codes[first + count - 1];
+  if (difference == 0) { // identical codes, split in the middle
+    axis = 0u;
+    return count / 2;
+  }
+  size_t bit = 63u - std::countl_zero(difference);
+  axis = bit % N;
+  size_t zero = first, one = first + count - 1;
+  while (one - zero > 1) {
+    size_t middle = zero + (one - zero) / 2;
+    if ((codes[middle] >> bit) & 1u) {
+      one = middle;
+    } else {
+      zero = middle;
+    }
+  }
+  return one - first;
+}
+
+template <class FLOAT, size_t N>
+uint64_t BoundingVolumeHierarchy<FLOAT, N>::morton_code(const std::array<uint64_t, N> & coordinates) {
+  // spreads the bits of x such that N - 1 zeros lie between each two bits
+  auto spread = [](uint64_t x) {
+    if constexpr (N == 3u) {
+      x &= 0x1fffffu;
+      x = (x | x << 32) & 0x1f00000000ffffu;
+      x = (x | x << 16) & 0x1f0000ff0000ffu;
+      x = (x | x << 8) & 0x100f00f00f00f00fu;
+      x = (x | x << 4) & 0x10c30c30c30c30c3u;
+      x = (x | x << 2) & 0x1249249249249249u;
+      return x;
+    } else if constexpr (N == 2u) {
+      x &= 0xffffffffu;
+      x = (x | x << 16) & 0x0000ffff0000ffffu;
+      x = (x | x << 8) & 0x00ff00ff00ff00ffu;
+      x = (x | x << 4) & 0x0f0f0f0f0f0f0f0fu;
+      x = (x | x << 2) & 0x3333333333333333u;
+      x = (x | x << 1) & 0x5555555555555555u;
+      return x;
+    } else {
+      uint64_t result = 0;
+      for (size_t i = 0; i < morton_bits; i++) {
+        result |= ((x >> i) & 1u) << (i * N);
+      }
+      return result;
+    }
+  };
+  uint64_t code = 0;
+  for (size_t k = 0; k < N; k++) {
+    code |= spread(coordinates[k]) << k;
+  }
+  return code;
+}
+
+template <class FLOAT, size_t N>
+size_t BoundingVolumeHierarchy<FLOAT, N>::leaf_tests(size_t count) const {
+  return (count + leaf_width - 1) / leaf_width;
+}
+
+template <class FLOAT, size_t N>
+const typename BoundingVolumeHierarchy<FLOAT, N>::Node * BoundingVolumeHierarchy<FLOAT, N>::root() const {
+  return tree.get();
+}
+
+template <class FLOAT, size_t N>
+const std::vector<size_t> & BoundingVolumeHierarchy<FLOAT, N>::primitive_indices() const {
+  return indices;
+}
+
+template <class FLOAT, size_t N>
+size_t BoundingVolumeHierarchy<FLOAT, N>::node_count() const {
+  size_t count = 0;
+  std::vector<const Node *> stack;
+  if (tree) {
+    stack.push_back(tree.get());
+  }
+  while (!stack.empty()) {
+    const Node * node = stack.back();
+    stack.pop_back();
+    count++;
+    if (node->count == 0) {
+      stack.push_back(node->left.get());
+      stack.push_back(node->right.get());
+    }
+  }
+  return count;
+}
+
+template <class FLOAT, size_t N>
+size_t BoundingVolumeHierarchy<FLOAT, N>::depth() const {
+  size_t depth = 0;
+  std::vector<std::pair<const Node *, size_t>> stack;
+  if (tree) {
+    stack.push_back({tree.get(), 1u});
+  }
+  while (!stack.empty()) {
+    auto [node, level] = stack.back();
+    stack.pop_back();
+    depth = std::max(depth, level);
+    if (node->count == 0) {
+      stack.push_back({node->left.get(), level + 1});
+      stack.push_back({node->right.get(), level + 1});
+    }
+  }
+  return depth;
+}
+
+template <class FLOAT, size_t N>
+FLOAT BoundingVolumeHierarchy<FLOAT, N>::sah_cost() const {
+  if (!tree || tree->bounds.surface_area() <= 0.0) {
+    return 0.0;
+  }
+  FLOAT cost = 0.0;
+  std::vector<const Node *> stack = { tree.get() };
+  while (!stack.empty()) {
+    const Node * node = stack.back();
+    stack.pop_back();
+    if (node->count > 0) {
+      cost += intersection_cost * leaf_tests(node->count) * node->bounds.surface_area();
+    } else {
+      cost += traversal_cost * node->bounds.surface_area();
+      stack.push_back(node->left.get());
+      stack.push_back(node->right.get());
+    }
+  }
+  return cost / tree->bounds.surface_area();
+}
+
+template <class FLOAT, size_t N>
+size_t BoundingVolumeHierarchy<FLOAT, N>::memory_size() const {
+  return node_count() * sizeof(Node) + indices.size() * sizeof(size_t);
+}
+
+template <class FLOAT, size_t N>
+double BoundingVolumeHierarchy<FLOAT, N>::build_time() const {
+  return seconds;
+}
+
+
+template <class FLOAT, size_t N>
+LinearBoundingVolumeHierarchy<FLOAT, N>::LinearBoundingVolumeHierarchy(const BoundingVolumeHierarchy<FLOAT, N> & bvh, const std::vector<Mask> & masks)
+  : index_storage(bvh.primitive_indices().begin(), bvh.primitive_indices().end()), mask_storage(index_storage.size(), all)
+{
+  if (bvh.primitive_indices().size() > UINT32_MAX) {
+    throw std::length_error("LinearBoundingVolumeHierarchy: more than UINT32_MAX primitive indices");
+  }
+  if (!masks.empty()) {
+    for (size_t k = 0; k < index_storage.size(); k++) {
+      assert(index_storage[k] < masks.size());
+      mask_storage[k] = masks[index_storage[k]];
+    }
+  }
+  node_storage.reserve(bvh.node_count());
+  if (bvh.root()) {
+    flatten(bvh.root());
+  }
+  own();
+  built_cost = sah_cost();
+}
+
+template <class FLOAT, size_t N>
+LinearBoundingVolumeHierarchy<FLOAT, N>::LinearBoundingVolumeHierarchy(const LinearBoundingVolumeHierarchy & other)
+  : node_storage(other.nodes.begin(), other.nodes.end()), index_storage(other.indices.begin(), other.indices.end()),
+    mask_storage(other.masks.begin(), other.masks.end()), built_cost(other.built_cost)
+{
+  own();
+}
+
+template <class FLOAT, size_t N>
+LinearBoundingVolumeHierarchy<FLOAT, N> & LinearBoundingVolumeHierarchy<FLOAT, N>::operator=(const LinearBoundingVolumeHierarchy & other) {
+  if (this != &other) {
+    *this = LinearBoundingVolumeHierarchy(other);
+  }
+  return *this;
+}
+
+template <class FLOAT, size_t N>
+void LinearBoundingVolumeHierarchy<FLOAT, N>::own() {
+  nodes = node_storage;
+  indices = index_storage;
+  masks = mask_storage;
+  mapping.reset();
+}
+
+// depth first order, returns the index of the flattened node
+template <class FLOAT, size_t N>
+uint32_t LinearBoundingVolumeHierarchy<FLOAT, N>::flatten(const typename BoundingVolumeHierarchy<FLOAT, N>::Node * node) {
+  if (node->count > 0) {
+    return flatten(node->bounds, node->first, node->count);
+  }
+  uint32_t index = add_node(node->bounds);
+  uint32_t first = flatten(node->left.get());
+  uint32_t second = flatten(node->right.get());
+  node_storage[index].offset = second;
+  node_storage[index].count = 0;
+  node_storage[index].axis = static_cast<uint8_t>(node->axis);
+  node_storage[index].mask = node_storage[first].mask | node_storage[second].mask;
+  return index;
+}
+
+// leaves are only limited by max_depth or max_leaf_size of the build, the halves of a larger leaf keep its
+// aabb because the aabbs of the primitives are not known here, refit() shrinks them
+template <class FLOAT, size_t N>
+uint32_t LinearBoundingVolumeHierarchy<FLOAT, N>::flatten(const AxisAlignedBoundingBox<FLOAT, N> & bounds, size_t first, size_t count) {
+  uint32_t index = add_node(bounds);
+  if (count <= max_leaf_count) {
+    node_storage[index].offset = static_cast<uint32_t>(first);
+    node_storage[index].count = static_cast<uint16_t>(count);
+    node_storage[index].mask = 0;
+    for (size_t k = first; k < first + count; k++) {
+      node_storage[index].mask |= mask_storage[k];
+    }
+  } else {
+    uint32_t left = flatten(bounds, first, count / 2u);
+    uint32_t right = flatten(bounds, first + count / 2u, count - count / 2u);
+    node_storage[index].offset = right;
+    node_storage[index].count = 0;
+    node_storage[index].mask = node_storage[left].mask | node_storage[right].mask;
+  }
+  return index;
+}
+
+template <class FLOAT, size_t N>
+uint32_t LinearBoundingVolumeHierarchy<FLOAT, N>::add_node(const AxisAlignedBoundingBox<FLOAT, N> & bounds) {
+  uint32_t index = static_cast<uint32_t>(node_storage.size());
+  node_storage.emplace_back();
+  Vector<FLOAT, N> lower = bounds.get_min(),
+                   upper = bounds.get_max();
+  for (size_t i = 0; i < N; i++) {
+    node_storage[index].lower[i] = lower[i];
+    node_storage[index].upper[i] = upper[i];
+  }
+  return index;
+}
+
+// the nodes are in depth first order, so the subtree of a node is a contiguous range that starts with the
+// node itself and ends after the last leaf reached by always taking the second child.
+// the upper levels are expanded until there are enough subtrees for the workers, the subtrees are refitted
+// in parallel and the upper nodes afterwards, again children before parents
+template <class FLOAT, size_t N>
+FLOAT LinearBoundingVolumeHierarchy<FLOAT, N>::refit(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, ThreadPool * pool) {
+  if (nodes.empty()) {
+    return degradation();
+  }
+  if (!pool || pool->size() < 2) {
+    refit(boxes, 0u, static_cast<uint32_t>(nodes.size()));
+    return degradation();
+  }
+
+  std::vector<uint32_t> upper, subtrees = { 0u };
+  while (subtrees.size() < 4u * pool->size()) {
+    std::vector<uint32_t> next;
+    for (uint32_t k : subtrees) {
+      if (nodes[k].count > 0) {
+        next.push_back(k);
+      } else {
+        upper.push_back(k);
+        next.push_back(k + 1);
+        next.push_back(nodes[k].offset);
+      }
+    }
+    if (next.size() == subtrees.size()) { // only leaves left
+      break;
+    }
+    subtrees.swap(next);
+  }
+
+  pool->parallel_for(subtrees.size(), [&](size_t s) {
+    uint32_t last = subtrees[s];
+    while (nodes[last].count == 0) {
+      last = nodes[last].offset;
+    }
+    refit(boxes, subtrees[s], last + 1);
+  });
+  std::sort(upper.begin(), upper.end());
+  for (auto k = upper.rbegin(); k != upper.rend(); ++k) {
+    refit(boxes, *k, *k + 1);
+  }
+  return degradation();
+}
+
+template <class FLOAT, size_t N>
+void LinearBoundingVolumeHierarchy<FLOAT, N>::refit(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, uint32_t first, uint32_t last) {
+  for (uint32_t k = last; k-- > first; ) {
+    Node & node = nodes[k];
+    if (node.count > 0) {
+      AxisAlignedBoundingBox<FLOAT, N> bounds = boxes[indices[node.offset]];
+      for (uint32_t i = node.offset + 1; i < node.offset + node.count; i++) {
+        bounds = bounds.merge(boxes[indices[i]]);
+      }
+      Vector<FLOAT, N> lower = bounds.get_min(),
+                       upper = bounds.get_max();
+      for (size_t i = 0; i < N; i++) {
+        node.lower[i] = lower[i];
+        node.upper[i] = upper[i];
+      }
+    } else {
+      const Node & first_child = nodes[k + 1], & second_child = nodes[node.offset];
+      for (size_t i = 0; i < N; i++) {
+        node.lower[i] = std::min(first_child.lower[i], second_child.lower[i]);
+        node.upper[i] = std::max(first_child.upper[i], second_child.upper[i]);
+      }
+    }
+  }
+}
+
+template <class FLOAT, size_t N>
+FLOAT LinearBoundingVolumeHierarchy<FLOAT, N>::sah_cost() const {
+  auto area = [](const Node & node) {
+    FLOAT sum = 0.0;
+    for (size_t i = 0; i < N; i++) {
+      FLOAT product = 1.0;
+      for (size_t j = 0; j < N; j++) {
+        product *= j == i ? FLOAT(1.0) : node.upper[j] - node.lower[j];
+      }
+      sum += product;
+    }
+    return 2 * sum;
+  };
+  if (nodes.empty() || area(nodes[0]) <= 0.0) {
+    return 0.0;
+  }
+  typedef BoundingVolumeHierarchy<FLOAT, N> BVH;
+  FLOAT cost = 0.0;
+  for (const Node & node : nodes) {
+    cost += (node.count > 0 ? BVH::intersection_cost * node.count : BVH::traversal_cost) * area(node);
+  }
+  return cost / area(nodes[0]);
+}
+
+template <class FLOAT, size_t N>
+FLOAT LinearBoundingVolumeHierarchy<FLOAT, N>::degradation() const {
+  return built_cost > 0.0 ? sah_cost() / built_cost : 1.0;
+}
+
+template <class FLOAT, size_t N>
+std::span<const typename LinearBoundingVolumeHierarchy<FLOAT, N>::Node> LinearBoundingVolumeHierarchy<FLOAT, N>::get_nodes() const {
+  return nodes;
+}
+
+template <class FLOAT, size_t N>
+std::span<const uint32_t> LinearBoundingVolumeHierarchy<FLOAT, N>::primitive_indices() const {
+  return indices;
+}
+
+template <class FLOAT, size_t N>
+std::span<const typename LinearBoundingVolumeHierarchy<FLOAT, N>::Mask> LinearBoundingVolumeHierarchy<FLOAT, N>::primitive_masks() const {
+  return masks;
+}
+
+template <class FLOAT, size_t N>
+size_t LinearBoundingVolumeHierarchy<FLOAT, N>::memory_size() const {
+  return nodes.size() * sizeof(Node) + indices.size() * (sizeof(uint32_t) + sizeof(Mask));
+}
+
+template <class FLOAT, size_t N>
+bool LinearBoundingVolumeHierarchy<FLOAT, N>::is_mapped() const {
+  return mapping != nullptr;
+}
+
+// each value is mixed with the finalizer of splitmix64 before it is combined with the hash,
+// so that a change of a single bit of a coordinate changes the whole key
+template <class FLOAT, size_t N>
+uint64_t LinearBoundingVolumeHierarchy<FLOAT, N>::hash(const std::vector<AxisAlignedBoundingBox<FLOAT, N>> & boxes, const std::vector<Mask> & masks, uint64_t seed) {
+  uint64_t hash = seed ^ 0x9E3779B97F4A7C15ull;
+  auto combine = [&](uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    value ^= value >> 31;
+    hash = (hash ^ value) * 0x100000001B3ull;
+  };
+  auto combine_vector = [&](const Vector<FLOAT, N> & vector) {
+    for (size_t i = 0; i < N; i++) {
+      uint64_t bits = 0u;
+      FLOAT value = vector[i];
+      std::memcpy(&bits, &value, sizeof(FLOAT));
+      combine(bits);
+    }
+  };
+
+  combine(boxes.size());
+  for (const auto & box : boxes) {
+    combine_vector(box.get_min());
+    combine_vector(box.get_max());
+  }
+  combine(masks.size());
+  for (Mask mask : masks) {
+    combine(mask);
+  }
+  return hash;
+}
+
+template <class FLOAT, size_t N>
+typename LinearBoundingVolumeHierarchy<FLOAT, N>::CacheHeader LinearBoundingVolumeHierarchy<FLOAT, N>::cache_header(uint64_t key) const {
+  static_assert(sizeof(CacheHeader) == 88u, "the cache header must not contain padding");
+  auto align = [](uint64_t offset) { return (offset + cache_alignment - 1u) / cache_alignment * cache_alignment; };
+  CacheHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, "RTLBVH\0\0", sizeof(header.magic));
+  header.version = cache_version;
+  header.byte_order = 0x01020304u;
+  header.float_size = sizeof(FLOAT);
+  header.dimension = N;
+  header.node_size = sizeof(Node);
+  header.mask_size = sizeof(Mask);
+  header.key = key;
+  header.node_count = nodes.size();
+  header.index_count = indices.size();
+  header.nodes_offset = align(sizeof(CacheHeader));
+  header.indices_offset = align(header.nodes_offset + nodes.size() * sizeof(Node));
+  header.masks_offset = align(header.indices_offset + indices.size() * sizeof(uint32_t));
+  header.built_cost = built_cost;
+  return header;
+}
+
+template <class FLOAT, size_t N>
+bool LinearBoundingVolumeHierarchy<FLOAT, N>::save(const std::string & path, uint64_t key) const {
+  CacheHeader header = cache_header(key);
+  // the temporary name is unique per process and thread, so that concurrent writers of the same key never
+  // share a file; the last rename wins and each renamed file is complete
+  std::string temporary = path + "." + std::to_string(getpid()) + "."
+                        + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+  std::error_code error;
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    const char padding[cache_alignment] = {};
+    uint64_t position = sizeof(header);
+    auto write = [&](const void * data, uint64_t size, uint64_t offset) {
+      file.write(padding, static_cast<std::streamsize>(offset - position));
+      file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+      position = offset + size;
+    };
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    write(nodes.data(), nodes.size() * sizeof(Node), header.nodes_offset);
+    write(indices.data(), indices.size() * sizeof(uint32_t), header.indices_offset);
+    write(masks.data(), masks.size() * sizeof(Mask), header.masks_offset);
+    file.close();
+    if (!file) {
+      std::filesystem::remove(temporary, error);
+      return false;
+    }
+  }
+  std::filesystem::rename(temporary, path, error);
+  return !error;
+}
+
+// the file is mapped private and writable, so that refit() can change the nodes in place; the kernel
+// copies a page only when it is written
+template <class FLOAT, size_t N>
+std::optional<LinearBoundingVolumeHierarchy<FLOAT, N>> LinearBoundingVolumeHierarchy<FLOAT, N>::load(const std::string & path, uint64_t key, size_t primitive_count) {
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    return std::nullopt;
+  }
+  struct stat status;
+  if (fstat(file, &status) != 0 || static_cast<uint64_t>(status.st_size) < sizeof(CacheHeader)) {
+    close(file);
+    return std::nullopt;
+  }
+  size_t size = static_cast<size_t>(status.st_size);
+  void * data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+  close(file);
+  if (data == MAP_FAILED) {
+    return std::nullopt;
+  }
+  std::shared_ptr<void> mapping(data, [size](void * address) { munmap(address, size); });
+
+  // the expected header is the one of a hierarchy with the sizes from the file, everything else has to match
+  // the node indices and primitive positions are 32 bit, this also keeps the array sizes below from overflowing
+  CacheHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (header.node_count > UINT32_MAX || header.index_count > UINT32_MAX) {
+    return std::nullopt;
+  }
+  LinearBoundingVolumeHierarchy bvh;
+  bvh.nodes = std::span<Node>(static_cast<Node *>(nullptr), header.node_count);
+  bvh.indices = std::span<const uint32_t>(static_cast<const uint32_t *>(nullptr), header.index_count);
+  bvh.masks = std::span<const Mask>(static_cast<const Mask *>(nullptr), header.index_count);
+  bvh.built_cost = static_cast<FLOAT>(header.built_cost);
+  CacheHeader expected = bvh.cache_header(key);
+  if (std::memcmp(&header, &expected, sizeof(header)) != 0 || expected.masks_offset + header.index_count * sizeof(Mask) > size) {
+    return std::nullopt;
+  }
+
+  char * base = static_cast<char *>(data);
+  bvh.nodes = std::span<Node>(reinterpret_cast<Node *>(base + header.nodes_offset), header.node_count);
+  bvh.indices = std::span<const uint32_t>(reinterpret_cast<const uint32_t *>(base + header.indices_offset), header.index_count);
+  bvh.masks = std::span<const Mask>(reinterpret_cast<const Mask *>(base + header.masks_offset), header.index_count);
+  if (!bvh.consistent()) {
+    return std::nullopt;
+  }
+  for (uint32_t index : bvh.indices) {
+    if (index >= primitive_count) {
+      return std::nullopt;
+    }
+  }
+  bvh.mapping = std::move(mapping);
+  return bvh;
+}
+
+// walks the nodes in array order with the stack of a traversal that always takes the first child: an inner
+// node pushes its second child, which has to come after the first one, and a leaf has to be followed by
+// the node on top of the stack. a traversal that takes the second child first pushes the first child
+// instead, so the stack holds up to one entry per inner node above the current one
+template <class FLOAT, size_t N>
+bool LinearBoundingVolumeHierarchy<FLOAT, N>::consistent() const {
+  struct Entry {
+    size_t node, depth;
+  };
+  Entry stack[max_depth];
+  size_t top = 0, depth = 0; // depth is the number of inner nodes above node k
+  for (size_t k = 0; k < nodes.size(); k++) {
+    const Node & node = nodes[k];
+    if (node.count > 0) {
+      if (static_cast<size_t>(node.offset) + node.count > indices.size()) {
+        return false;
+      }
+      if (top == 0) {
+        if (k + 1 != nodes.size()) {
+          return false;
+        }
+      } else {
+        Entry next = stack[--top];
+        if (next.node != k + 1) {
+          return false;
+        }
+        depth = next.depth;
+      }
+    } else {
+      if (node.axis >= N || node.offset <= k + 1 || node.offset >= nodes.size() || depth >= max_depth) {
+        return false;
+      }
+      stack[top++] = {node.offset, ++depth};
+    }
+  }
+  return true;
+}
@@ -0,0 +1,366 @@
+#include "bvh.h"
+#include "test_scenes.h"
+#include "thread_pool.h"
+#include "wide_bvh.h"
+#include "benchmark/benchmark.h"
+#include <cmath>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+// compares the closest hit search of a BVH with the linear search over all spheres
+// for growing scene sizes, the crossover point is where BVH_ClosestHit gets faster than Linear_ClosestHit
+// LinearBVH_ClosestHit uses the flattened hierarchy, items_per_second is the number of rays per second
+// and bytes_per_primitive the memory of nodes and indices divided by the number of spheres
+// WideBVH_ClosestHit<WIDTH> tests 4 or 8 child aabbs at once
+// *_AnyHit search any sphere within a distance of 4 like shadow rays, items_per_second is again the
+// number of rays per second and blocked the fraction of rays that hit a sphere
+// LinearBVH_Packet<SIZE> traces the primary rays of SIZE neighbouring pixels together, LinearBVH_PacketSingle
+// the same rays one by one, items_per_second is the number of rays per second in both cases
+// BVH_Build and BVH_MortonBuild build the sah and the morton hierarchy, items_per_second is the number of
+// primitives per second and sah_cost the quality of the resulting tree
+// LinearBVH_Refit updates the hierarchy to moving spheres without a build, degradation is the resulting
+// sah cost relative to the built tree
+// LinearBVH_CacheLoad starts from a saved hierarchy instead of BVH_Build: it hashes the aabbs, maps the cache
+// file and reads all nodes once, items_per_second is the number of primitives per second
+// LinearBVH_Slivers traces rays through small triangles and long thin slivers, once in the sah hierarchy of
+// their aabbs and once in a spatial split hierarchy, items_per_second is the number of rays per second,
+// leaves_per_ray and tests_per_ray the visited leaves and triangle tests of a ray
+
+namespace {
+
+void Linear_ClosestHit(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  std::vector<Ray3df> rays = rays_from_origin(1024);
+  size_t r = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    float t_min = INFINITY;
+    size_t hit = BVH3df::no_hit;
+    for (size_t i = 0; i < spheres.size(); i++) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_min) {
+        t_min = t;
+        hit = i;
+      }
+    }
+    benchmark::DoNotOptimize(hit);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BVH_ClosestHit(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  BVH3df bvh( bounding_boxes(spheres) );
+  std::vector<Ray3df> rays = rays_from_origin(1024);
+  size_t r = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    float t_min = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t_min, [&](size_t i, float & t_max) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_max) {
+        t_max = t;
+        return true;
+      }
+      return false;
+    });
+    benchmark::DoNotOptimize(hit);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["nodes"] = bvh.node_count();
+  state.counters["sah_cost"] = bvh.sah_cost();
+  state.counters["bytes_per_primitive"] = static_cast<double>(bvh.memory_size()) / spheres.size();
+}
+
+void LinearBVH_ClosestHit(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::vector<Ray3df> rays = rays_from_origin(1024);
+  size_t r = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    float t_min = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t_min, [&](size_t i, float & t_max) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_max) {
+        t_max = t;
+        return true;
+      }
+      return false;
+    });
+    benchmark::DoNotOptimize(hit);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["nodes"] = bvh.get_nodes().size();
+  state.counters["bytes_per_primitive"] = static_cast<double>(bvh.memory_size()) / spheres.size();
+}
+
+template <class WIDE_BVH>
+void WideBVH_ClosestHit(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  WIDE_BVH bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::vector<Ray3df> rays = rays_from_origin(1024);
+  size_t r = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    float t_min = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t_min, [&](size_t i, float & t_max) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_max) {
+        t_max = t;
+        return true;
+      }
+      return false;
+    });
+    benchmark::DoNotOptimize(hit);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["nodes"] = bvh.get_nodes().size();
+  state.counters["bytes_per_primitive"] = static_cast<double>(bvh.memory_size()) / spheres.size();
+}
+
+const float shadow_distance = 4.0f;
+
+void LinearBVH_AnyHit(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::vector<Ray3df> rays = rays_from_origin(1024);
+  size_t r = 0, blocked = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    size_t hit = bvh.any_hit(ray, 0.0f, shadow_distance, [&](size_t i) {
+      return spheres[i].occludes(ray, 0.0f, shadow_distance);
+    });
+    blocked += hit != LinearBVH3df::no_hit;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["blocked"] = static_cast<double>(blocked) / state.iterations();
+}
+
+// the closest hit search for the same shadow rays as a reference for LinearBVH_AnyHit
+void LinearBVH_ShadowClosestHit(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::vector<Ray3df> rays = rays_from_origin(1024);
+  size_t r = 0, blocked = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    float t = shadow_distance;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t, [&](size_t i, float & t_max) {
+      return spheres[i].intersects(ray, 0.0f, t_max);
+    });
+    blocked += hit != LinearBVH3df::no_hit;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["blocked"] = static_cast<double>(blocked) / state.iterations();
+}
+
+template <class WIDE_BVH>
+void WideBVH_AnyHit(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  WIDE_BVH bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::vector<Ray3df> rays = rays_from_origin(1024);
+  size_t r = 0, blocked = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    size_t hit = bvh.any_hit(ray, 0.0f, shadow_distance, [&](size_t i) {
+      return spheres[i].occludes(ray, 0.0f, shadow_distance);
+    });
+    blocked += hit != WIDE_BVH::no_hit;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["blocked"] = static_cast<double>(blocked) / state.iterations();
+}
+
+// the primary rays of a 256x256 screen with a field of view of 60 degrees, in blocks of 4 x (SIZE / 4) pixels
+template <size_t SIZE>
+std::vector<Ray3df> camera_rays(float distance) {
+  const size_t resolution = 256u, width = 4u, height = SIZE / width;
+  std::vector<Ray3df> rays;
+  for (size_t by = 0; by < resolution; by += height) {
+    for (size_t bx = 0; bx < resolution; bx += width) {
+      for (size_t l = 0; l < SIZE; l++) {
+        Vector3df d = { (2.0f * (bx + l % width) + 1.0f) / resolution - 1.0f, (2.0f * (by + l / width) + 1.0f) / resolution - 1.0f, -1.7f };
+        d.normalize();
+        rays.push_back( Ray3df{ {0.0, 0.0, distance}, d } );
+      }
+    }
+  }
+  return rays;
+}
+
+template <size_t SIZE>
+void LinearBVH_Packet(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::vector<Ray3df> rays = camera_rays<SIZE>(4.0f * std::cbrt(static_cast<float>(spheres.size())));
+  size_t r = 0;
+
+  for (auto _ : state) {
+    const Ray3df * packet_rays = rays.data() + (r++ * SIZE) % rays.size();
+    float t[SIZE];
+    size_t hit[SIZE];
+    std::fill(t, t + SIZE, INFINITY);
+    bvh.closest_hit(RayPacket<float, 3u, SIZE>(packet_rays, SIZE), 0.0f, t, hit, [&](size_t i, unsigned l, float & t_max) {
+      return spheres[i].intersects(packet_rays[l], 0.0f, t_max);
+    });
+    benchmark::DoNotOptimize(hit);
+  }
+  state.SetItemsProcessed(state.iterations() * SIZE);
+}
+
+void LinearBVH_PacketSingle(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::vector<Ray3df> rays = camera_rays<16u>(4.0f * std::cbrt(static_cast<float>(spheres.size())));
+  size_t r = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    float t = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t, [&](size_t i, float & t_max) {
+      return spheres[i].intersects(ray, 0.0f, t_max);
+    });
+    benchmark::DoNotOptimize(hit);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BVH_Build(benchmark::State & state) {
+  std::vector<AABB3df> boxes = bounding_boxes( constant_density_spheres(state.range(0)) );
+
+  for (auto _ : state) {
+    BVH3df bvh(boxes);
+    benchmark::DoNotOptimize(bvh.root());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["sah_cost"] = BVH3df(boxes).sah_cost();
+}
+
+// the second argument is the number of workers, zero builds without a thread pool
+void BVH_MortonBuild(benchmark::State & state) {
+  std::vector<AABB3df> boxes = bounding_boxes( constant_density_spheres(state.range(0)) );
+  std::unique_ptr<ThreadPool> pool( state.range(1) > 0 ? new ThreadPool(state.range(1)) : nullptr );
+
+  for (auto _ : state) {
+    BVH3df bvh(boxes, 4u, 1u, BVH3df::Builder::morton, pool.get());
+    benchmark::DoNotOptimize(bvh.root());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["sah_cost"] = BVH3df(boxes, 4u, 1u, BVH3df::Builder::morton).sah_cost();
+}
+
+
+// refits the hierarchy to the spheres of the next frame instead of building it again,
+// the second argument is the number of workers, zero refits without a thread pool
+void LinearBVH_Refit(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::vector<AABB3df> frames[2];
+  for (size_t f = 0; f < 2; f++) {
+    for (const auto & sphere : spheres) {
+      frames[f].push_back( Sphere3df( sphere.get_center() + Vector3df{ 0.1f * f, 0.0f, 0.0f }, sphere.get_radius() ).bounding_box() );
+    }
+  }
+  std::unique_ptr<ThreadPool> pool( state.range(1) > 0 ? new ThreadPool(state.range(1)) : nullptr );
+
+  size_t frame = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize( bvh.refit(frames[frame++ % 2], pool.get()) );
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["degradation"] = bvh.degradation();
+}
+
+void LinearBVH_CacheLoad(benchmark::State & state) {
+  std::vector<AABB3df> boxes = bounding_boxes( constant_density_spheres(state.range(0)) );
+  std::string path = (std::filesystem::temp_directory_path() / "bvh_benchmark.bvh").string();
+  LinearBVH3df( BVH3df(boxes) ).save(path, LinearBVH3df::hash(boxes));
+
+  for (auto _ : state) {
+    std::optional<LinearBVH3df> bvh = LinearBVH3df::load(path, LinearBVH3df::hash(boxes), boxes.size());
+    size_t primitives = 0;
+    for (const auto & node : bvh->get_nodes()) {
+      primitives += node.count;
+    }
+    benchmark::DoNotOptimize(primitives);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["file_bytes"] = static_cast<double>(std::filesystem::file_size(path));
+  std::filesystem::remove(path);
+}
+
+// the second argument is max_growth in percent, zero builds the sah hierarchy of the triangle aabbs
+void LinearBVH_Slivers(benchmark::State & state) {
+  std::vector<std::array<Vector3df, 3u>> vertices = random_slivers(state.range(0), state.range(0) / 10, 42u);
+  std::vector<Triangle3df> triangles;
+  std::vector<AABB3df> boxes;
+  for (const auto & v : vertices) {
+    triangles.push_back( Triangle3df(v[0], v[1], v[2]) );
+    boxes.push_back( triangles.back().bounding_box() );
+  }
+  BVH3df hierarchy = state.range(1) > 0 ? BVH3df(vertices, 0.01f * state.range(1)) : BVH3df(boxes);
+  LinearBVH3df bvh(hierarchy);
+  std::vector<Ray3df> rays = rays_from_origin(1024);
+  size_t r = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    float t = INFINITY, u, v;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t, [&](size_t i, float & t_max) {
+      return triangles[i].intersects(ray, 0.0f, t_max, u, v);
+    });
+    benchmark::DoNotOptimize(hit);
+  }
+
+  // counted in a separate pass to keep the measured loop free of bookkeeping
+  size_t leaves = 0, tests = 0;
+  for (const auto & ray : rays) {
+    float t = INFINITY, u, v;
+    bvh.closest_hit_leaves(ray, 0.0f, t, [&](uint32_t first, uint32_t count, float & t_max) {
+      size_t hit = LinearBVH3df::no_hit;
+      leaves++;
+      tests += count;
+      for (uint32_t k = first; k < first + count; k++) {
+        size_t i = bvh.primitive_indices()[k];
+        if (triangles[i].intersects(ray, 0.0f, t_max, u, v)) {
+          hit = i;
+        }
+      }
+      return hit;
+    });
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["leaves_per_ray"] = static_cast<double>(leaves) / rays.size();
+  state.counters["tests_per_ray"] = static_cast<double>(tests) / rays.size();
+  state.counters["sah_cost"] = hierarchy.sah_cost();
+  state.counters["references"] = static_cast<double>(hierarchy.primitive_indices().size()) / triangles.size();
+}
+
+}
+
+BENCHMARK(Linear_ClosestHit)->RangeMultiplier(2)->Range(1, 1 << 14);
+BENCHMARK(BVH_ClosestHit)->RangeMultiplier(2)->Range(1, 1 << 20);
+BENCHMARK(LinearBVH_ClosestHit)->RangeMultiplier(2)->Range(1, 1 << 20);
+BENCHMARK_TEMPLATE(WideBVH_ClosestHit, WideBVH4_3df)->RangeMultiplier(2)->Range(1, 1 << 20);
+BENCHMARK_TEMPLATE(WideBVH_ClosestHit, WideBVH8_3df)->RangeMultiplier(2)->Range(1, 1 << 20);
+BENCHMARK(LinearBVH_AnyHit)->RangeMultiplier(4)->Range(16, 1 << 20);
+BENCHMARK(LinearBVH_ShadowClosestHit)->RangeMultiplier(4)->Range(16, 1 << 20);
+BENCHMARK_TEMPLATE(WideBVH_AnyHit, WideBVH4_3df)->RangeMultiplier(4)->Range(16, 1 << 20);
+BENCHMARK_TEMPLATE(WideBVH_AnyHit, WideBVH8_3df)->RangeMultiplier(4)->Range(16, 1 << 20);
+BENCHMARK_TEMPLATE(LinearBVH_Packet, 8u)->RangeMultiplier(8)->Range(64, 1 << 18);
+BENCHMARK_TEMPLATE(LinearBVH_Packet, 16u)->RangeMultiplier(8)->Range(64, 1 << 18);
+BENCHMARK(LinearBVH_PacketSingle)->RangeMultiplier(8)->Range(64, 1 << 18);
+BENCHMARK(BVH_Build)->RangeMultiplier(4)->Range(16, 1 << 20);
+BENCHMARK(BVH_MortonBuild)->ArgsProduct({ benchmark::CreateRange(16, 1 << 20, 4), {0, 4} });
+BENCHMARK(LinearBVH_Refit)->ArgsProduct({ benchmark::CreateRange(16, 1 << 20, 4), {0, 4} });
+BENCHMARK(LinearBVH_CacheLoad)->RangeMultiplier(4)->Range(16, 1 << 20);
+BENCHMARK(LinearBVH_Slivers)->ArgsProduct({ benchmark::CreateRange(1 << 10, 1 << 16, 8), {0, 30} });
@@ -0,0 +1,928 @@
+#include "bvh.h"
+#include "test_scenes.h"
+#include "thread_pool.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <thread>
+
+namespace {
+
+// any_hit() has to find a blocker within [0, t_max] iff the linear search finds one,
+// t_max is chosen such that about half of the rays are blocked
+template <class HIERARCHY>
+void expect_any_hit_equals_linear_search(const HIERARCHY & bvh, const std::vector<Sphere3df> & spheres, unsigned seed) {
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+  const float t_max = 4.0f;
+
+  for (size_t r = 0; r < 200; r++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    d.normalize();
+    Ray3df ray = { {0.0, 0.0, 0.0}, d };
+
+    bool linear = false;
+    for (size_t i = 0; i < spheres.size(); i++) {
+      linear = linear || spheres[i].occludes(ray, 0.0f, t_max);
+    }
+
+    size_t calls = 0;
+    size_t hit = bvh.any_hit(ray, 0.0f, t_max, [&](size_t i) {
+      calls++;
+      return spheres[i].occludes(ray, 0.0f, t_max);
+    });
+
+    EXPECT_EQ(linear, hit != HIERARCHY::no_hit);
+    if (hit != HIERARCHY::no_hit) {
+      EXPECT_TRUE( spheres[hit].occludes(ray, 0.0f, t_max) );
+    }
+    EXPECT_LE(calls, spheres.size());
+  }
+}
+
+TEST(BVH, EmptyHierarchy) {
+  BVH3df bvh( {} );
+  Ray3df ray = { {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0} };
+  float t = INFINITY;
+
+  EXPECT_EQ(nullptr, bvh.root());
+  EXPECT_EQ(0u, bvh.node_count());
+  EXPECT_EQ(BVH3df::no_hit, bvh.closest_hit(ray, 0.0f, t, [](size_t, float &) { return true; }));
+  EXPECT_EQ(BVH3df::no_hit, bvh.any_hit(ray, 0.0f, t, [](size_t) { return true; }));
+}
+
+TEST(BVH, SinglePrimitiveIsLeaf) {
+  BVH3df bvh( { Sphere3df( {0.0, 0.0, 0.0}, 1.0 ).bounding_box() } );
+
+  ASSERT_NE(nullptr, bvh.root());
+  EXPECT_EQ(1u, bvh.root()->count);
+  EXPECT_EQ(1u, bvh.node_count());
+  EXPECT_EQ(1u, bvh.depth());
+}
+
+TEST(BVH, RootBoundsContainAllPrimitives) {
+  std::vector<Sphere3df> spheres = random_spheres(100, 1u);
+  BVH3df bvh( bounding_boxes(spheres) );
+
+  for (const auto & box : bounding_boxes(spheres)) {
+    for (size_t i = 0; i < 3; i++) {
+      EXPECT_LE(bvh.root()->bounds.get_min()[i], box.get_min()[i] + 0.0001f);
+      EXPECT_GE(bvh.root()->bounds.get_max()[i], box.get_max()[i] - 0.0001f);
+    }
+  }
+}
+
+TEST(BVH, EachPrimitiveOnce) {
+  BVH3df bvh( bounding_boxes( random_spheres(257, 2u) ) );
+  std::vector<size_t> indices = bvh.primitive_indices();
+  std::sort(indices.begin(), indices.end());
+
+  ASSERT_EQ(257u, indices.size());
+  for (size_t i = 0; i < indices.size(); i++) {
+    EXPECT_EQ(i, indices[i]);
+  }
+}
+
+TEST(BVH, SplitsSeparatedClusters) {
+  BVH3df bvh( { Sphere3df( {-5.0, 0.0, 0.0}, 0.5 ).bounding_box(), Sphere3df( {-5.0, 1.0, 0.0}, 0.5 ).bounding_box(),
+                Sphere3df( {5.0, 0.0, 0.0}, 0.5 ).bounding_box(), Sphere3df( {5.0, 1.0, 0.0}, 0.5 ).bounding_box() }, 1u );
+
+  ASSERT_EQ(0u, bvh.root()->count);
+  EXPECT_NEAR(-5.0, bvh.root()->left->bounds.get_center()[0], 0.00001);
+  EXPECT_NEAR(5.0, bvh.root()->right->bounds.get_center()[0], 0.00001);
+  EXPECT_EQ(7u, bvh.node_count());
+}
+
+// with 16 primitives tested at once a leaf of 16 costs the same as a leaf of 1, so the sah builds larger leaves
+TEST(BVH, LeafWidth) {
+  std::vector<AABB3df> boxes = bounding_boxes( random_spheres(1000, 9u) );
+  BVH3df narrow(boxes, 16u), wide(boxes, 16u, 16u);
+
+  EXPECT_LT(wide.node_count(), narrow.node_count() / 2);
+  EXPECT_EQ(1000u, wide.primitive_indices().size());
+  std::vector<const BVH3df::Node *> stack = { wide.root() };
+  while (!stack.empty()) {
+    const BVH3df::Node * node = stack.back();
+    stack.pop_back();
+    if (node->count == 0) {
+      stack.push_back(node->left.get());
+      stack.push_back(node->right.get());
+    } else {
+      EXPECT_LE(node->count, 16u);
+    }
+  }
+}
+
+TEST(BVH, IdenticalCentroids) {
+  std::vector<AABB3df> boxes( 20, Sphere3df( {1.0, 1.0, 1.0}, 0.5 ).bounding_box() );
+  BVH3df bvh( boxes, 4u );
+
+  EXPECT_EQ(20u, bvh.primitive_indices().size());
+  EXPECT_GT(bvh.node_count(), 1u);
+}
+
+TEST(BVH, ClosestHitEqualsLinearSearch) {
+  std::vector<Sphere3df> spheres = random_spheres(500, 3u);
+  BVH3df bvh( bounding_boxes(spheres) );
+  std::mt19937 generator(4u);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+  for (size_t r = 0; r < 200; r++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    d.normalize();
+    Ray3df ray = { {0.0, 0.0, 0.0}, d };
+
+    float t_linear = INFINITY;
+    size_t linear = BVH3df::no_hit;
+    for (size_t i = 0; i < spheres.size(); i++) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_linear) {
+        t_linear = t;
+        linear = i;
+      }
+    }
+
+    float t_bvh = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t_bvh, [&](size_t i, float & t_max) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_max) {
+        t_max = t;
+        return true;
+      }
+      return false;
+    });
+
+    EXPECT_EQ(linear, hit);
+    if (linear != BVH3df::no_hit) {
+      EXPECT_NEAR(t_linear, t_bvh, 0.00001);
+    }
+  }
+}
+
+TEST(LINEAR_BVH, NodeLayout) {
+  EXPECT_EQ(32u, sizeof(LinearBVH3df::Node));
+  EXPECT_EQ(32u, alignof(LinearBVH3df::Node));
+}
+
+TEST(LINEAR_BVH, EmptyHierarchy) {
+  LinearBVH3df bvh( BVH3df( {} ) );
+  Ray3df ray = { {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0} };
+  float t = INFINITY;
+
+  EXPECT_TRUE(bvh.get_nodes().empty());
+  EXPECT_EQ(LinearBVH3df::no_hit, bvh.closest_hit(ray, 0.0f, t, [](size_t, float &) { return true; }));
+  EXPECT_EQ(LinearBVH3df::no_hit, bvh.any_hit(ray, 0.0f, t, [](size_t) { return true; }));
+}
+
+TEST(LINEAR_BVH, DepthFirstOrder) {
+  BVH3df tree( { Sphere3df( {-5.0, 0.0, 0.0}, 0.5 ).bounding_box(), Sphere3df( {-5.0, 1.0, 0.0}, 0.5 ).bounding_box(),
+                 Sphere3df( {5.0, 0.0, 0.0}, 0.5 ).bounding_box(), Sphere3df( {5.0, 1.0, 0.0}, 0.5 ).bounding_box() }, 1u );
+  LinearBVH3df bvh(tree);
+  const auto & nodes = bvh.get_nodes();
+
+  ASSERT_EQ(7u, nodes.size());
+  EXPECT_EQ(0u, nodes[0].count);
+  EXPECT_EQ(0u, nodes[0].axis);
+  EXPECT_EQ(4u, nodes[0].offset);   // right child follows the left subtree
+  EXPECT_NEAR(-5.5, nodes[1].lower[0], 0.00001);
+  EXPECT_NEAR(4.5, nodes[4].lower[0], 0.00001);
+  EXPECT_EQ(1u, nodes[2].count);
+  EXPECT_EQ(4u * (sizeof(uint32_t) + 1u) + 7u * 32u, bvh.memory_size());
+}
+
+// leaves with more primitives than the 16 bit count of a node are split into several nodes
+TEST(LINEAR_BVH, LargeLeafIsSplit) {
+  const size_t count = 3u * LinearBVH3df::max_leaf_count;
+  std::vector<AABB3df> boxes(count, Sphere3df( {1.0, 2.0, 3.0}, 0.5 ).bounding_box());
+  BVH3df tree(boxes, count);
+  ASSERT_EQ(count, tree.root()->count);
+  std::vector<LinearBVH3df::Mask> masks(count, 1u);
+  masks[count - 1] = 2u;
+  LinearBVH3df bvh(tree, masks);
+
+  std::vector<size_t> seen;
+  for (const auto & node : bvh.get_nodes()) {
+    if (node.count > 0) {
+      for (size_t k = node.offset; k < node.offset + node.count; k++) {
+        seen.push_back(bvh.primitive_indices()[k]);
+      }
+    }
+  }
+  std::sort(seen.begin(), seen.end());
+  ASSERT_EQ(count, seen.size());
+  for (size_t i = 0; i < count; i++) {
+    EXPECT_EQ(i, seen[i]);
+  }
+  EXPECT_EQ(3u, bvh.get_nodes()[0].mask);
+
+  Ray3df ray = { {1.0, 2.0, -5.0}, {0.0, 0.0, 1.0} };
+  EXPECT_EQ(count - 1, bvh.any_hit(ray, 0.0f, INFINITY, [](size_t) { return true; }, 2u));
+}
+
+TEST(LINEAR_BVH, NodeMasks) {
+  BVH3df tree( { Sphere3df( {-5.0, 0.0, 0.0}, 0.5 ).bounding_box(), Sphere3df( {-5.0, 1.0, 0.0}, 0.5 ).bounding_box(),
+                 Sphere3df( {5.0, 0.0, 0.0}, 0.5 ).bounding_box(), Sphere3df( {5.0, 1.0, 0.0}, 0.5 ).bounding_box() }, 1u );
+  LinearBVH3df bvh(tree, {1u, 2u, 4u, 4u});
+  const auto & nodes = bvh.get_nodes();
+
+  ASSERT_EQ(7u, nodes.size());
+  EXPECT_EQ(7u, nodes[0].mask);
+  EXPECT_EQ(3u, nodes[1].mask);
+  EXPECT_EQ(4u, nodes[4].mask);
+  for (size_t k = 0; k < 4; k++) {
+    EXPECT_EQ((std::vector<uint8_t>{1u, 2u, 4u, 4u})[bvh.primitive_indices()[k]], bvh.primitive_masks()[k]);
+  }
+  EXPECT_EQ(LinearBVH3df::all, LinearBVH3df(tree).get_nodes()[0].mask);
+}
+
+// primitives without a common bit with the query mask are neither hit nor tested
+TEST(LINEAR_BVH, MaskedQueriesEqualLinearSearch) {
+  std::vector<Sphere3df> spheres = random_spheres(500, 10u);
+  std::vector<uint8_t> masks;
+  for (size_t i = 0; i < spheres.size(); i++) {
+    masks.push_back(i % 3 == 0 ? 1u : 2u);
+  }
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ), masks );
+  std::mt19937 generator(11u);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+  for (size_t r = 0; r < 200; r++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    d.normalize();
+    Ray3df ray = { {0.0, 0.0, 0.0}, d };
+
+    float t_linear = INFINITY;
+    size_t linear = LinearBVH3df::no_hit;
+    bool blocked = false;
+    for (size_t i = 0; i < spheres.size(); i += 3) {
+      float t = INFINITY;
+      if (spheres[i].intersects(ray, 0.0f, t) && t < t_linear) {
+        t_linear = t;
+        linear = i;
+      }
+      blocked = blocked || spheres[i].occludes(ray, 0.0f, 4.0f);
+    }
+
+    float t_bvh = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t_bvh, [&](size_t i, float & t_max) {
+      EXPECT_EQ(0u, i % 3);
+      return spheres[i].intersects(ray, 0.0f, t_max);
+    }, 1u);
+    size_t blocker = bvh.any_hit(ray, 0.0f, 4.0f, [&](size_t i) {
+      EXPECT_EQ(0u, i % 3);
+      return spheres[i].occludes(ray, 0.0f, 4.0f);
+    }, 1u);
+
+    EXPECT_EQ(linear, hit);
+    EXPECT_EQ(blocked, blocker != LinearBVH3df::no_hit);
+  }
+}
+
+TEST(LINEAR_BVH, ClosestHitEqualsLinearSearch) {
+  std::vector<Sphere3df> spheres = random_spheres(500, 6u);
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::mt19937 generator(7u);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+  for (size_t r = 0; r < 200; r++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    d.normalize();
+    Ray3df ray = { {0.0, 0.0, 0.0}, d };
+
+    float t_linear = INFINITY;
+    size_t linear = LinearBVH3df::no_hit;
+    for (size_t i = 0; i < spheres.size(); i++) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_linear) {
+        t_linear = t;
+        linear = i;
+      }
+    }
+
+    float t_bvh = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t_bvh, [&](size_t i, float & t_max) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_max) {
+        t_max = t;
+        return true;
+      }
+      return false;
+    });
+
+    EXPECT_EQ(linear, hit);
+    if (linear != LinearBVH3df::no_hit) {
+      EXPECT_NEAR(t_linear, t_bvh, 0.00001);
+    }
+  }
+}
+
+// moves the spheres by up to distance along each axis
+std::vector<Sphere3df> move_spheres(const std::vector<Sphere3df> & spheres, float distance, unsigned seed) {
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> offset(-distance, distance);
+  std::vector<Sphere3df> moved;
+  for (const auto & sphere : spheres) {
+    Vector3df center = sphere.get_center() + Vector3df{ offset(generator), offset(generator), offset(generator) };
+    moved.push_back( Sphere3df( center, sphere.get_radius() ) );
+  }
+  return moved;
+}
+
+TEST(LINEAR_BVH, RefitWithoutMotion) {
+  std::vector<AABB3df> boxes = bounding_boxes( random_spheres(500, 16u) );
+  LinearBVH3df bvh( (BVH3df(boxes)) );
+  std::vector<LinearBVH3df::Node> nodes(bvh.get_nodes().begin(), bvh.get_nodes().end());
+
+  EXPECT_NEAR(1.0f, bvh.refit(boxes), 0.0001f);
+  for (size_t k = 0; k < nodes.size(); k++) {
+    for (size_t i = 0; i < 3; i++) {
+      EXPECT_NEAR(nodes[k].lower[i], bvh.get_nodes()[k].lower[i], 0.0001f);
+      EXPECT_NEAR(nodes[k].upper[i], bvh.get_nodes()[k].upper[i], 0.0001f);
+    }
+  }
+}
+
+// each node has to contain the moved primitives below it, the parallel refit gives the same nodes
+TEST(LINEAR_BVH, RefitContainsMovedPrimitives) {
+  std::vector<Sphere3df> spheres = random_spheres(2000, 17u);
+  LinearBVH3df serial( BVH3df( bounding_boxes(spheres) ) ), parallel( BVH3df( bounding_boxes(spheres) ) );
+  std::vector<AABB3df> moved = bounding_boxes( move_spheres(spheres, 1.0f, 18u) );
+  ThreadPool pool(4u);
+
+  serial.refit(moved);
+  parallel.refit(moved, &pool);
+
+  std::span<const LinearBVH3df::Node> nodes = serial.get_nodes();
+  ASSERT_EQ(nodes.size(), parallel.get_nodes().size());
+  for (size_t k = 0; k < nodes.size(); k++) {
+    for (size_t i = 0; i < 3; i++) {
+      EXPECT_EQ(nodes[k].lower[i], parallel.get_nodes()[k].lower[i]);
+      EXPECT_EQ(nodes[k].upper[i], parallel.get_nodes()[k].upper[i]);
+    }
+    if (nodes[k].count == 0) {
+      const LinearBVH3df::Node & first = nodes[k + 1], & second = nodes[nodes[k].offset];
+      for (size_t i = 0; i < 3; i++) {
+        EXPECT_EQ(nodes[k].lower[i], std::min(first.lower[i], second.lower[i]));
+        EXPECT_EQ(nodes[k].upper[i], std::max(first.upper[i], second.upper[i]));
+      }
+      continue;
+    }
+    for (size_t j = nodes[k].offset; j < nodes[k].offset + nodes[k].count; j++) {
+      for (size_t i = 0; i < 3; i++) {
+        EXPECT_LE(nodes[k].lower[i], moved[serial.primitive_indices()[j]].get_min()[i] + 0.0001f);
+        EXPECT_GE(nodes[k].upper[i], moved[serial.primitive_indices()[j]].get_max()[i] - 0.0001f);
+      }
+    }
+  }
+  EXPECT_FLOAT_EQ(serial.degradation(), parallel.degradation());
+}
+
+TEST(LINEAR_BVH, RefitClosestHitEqualsLinearSearch) {
+  std::vector<Sphere3df> spheres = random_spheres(500, 19u);
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::vector<Sphere3df> moved = move_spheres(spheres, 2.0f, 20u);
+  bvh.refit( bounding_boxes(moved) );
+  std::mt19937 generator(21u);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+  for (size_t r = 0; r < 200; r++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    d.normalize();
+    Ray3df ray = { {0.0, 0.0, 0.0}, d };
+
+    float t_linear = INFINITY;
+    size_t linear = LinearBVH3df::no_hit;
+    for (size_t i = 0; i < moved.size(); i++) {
+      float t = moved[i].intersects(ray);
+      if (t > 0.0f && t < t_linear) {
+        t_linear = t;
+        linear = i;
+      }
+    }
+
+    float t_bvh = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t_bvh, [&](size_t i, float & t_max) {
+      return moved[i].intersects(ray, 0.0f, t_max);
+    });
+
+    EXPECT_EQ(linear, hit);
+    if (linear != LinearBVH3df::no_hit) {
+      EXPECT_NEAR(t_linear, t_bvh, 0.00001);
+    }
+  }
+}
+
+// small motions keep the tree usable, large motions make the nodes overlap and call for a rebuild
+TEST(LINEAR_BVH, RefitDegradation) {
+  std::vector<Sphere3df> spheres = random_spheres(2000, 22u);
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ) );
+
+  EXPECT_FLOAT_EQ(1.0f, bvh.degradation());
+  EXPECT_NEAR(bvh.sah_cost(), BVH3df( bounding_boxes(spheres) ).sah_cost(), 0.001f);
+  EXPECT_LT(bvh.refit( bounding_boxes( move_spheres(spheres, 0.05f, 23u) ) ), LinearBVH3df::max_degradation);
+  EXPECT_GT(bvh.refit( bounding_boxes( move_spheres(spheres, 8.0f, 24u) ) ), LinearBVH3df::max_degradation);
+}
+
+std::string cache_path(const char * name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+template <class T>
+bool equal_bytes(std::span<const T> a, std::span<const T> b) {
+  return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size_bytes()) == 0);
+}
+
+TEST(LINEAR_BVH, HashChangesWithInput) {
+  std::vector<AABB3df> boxes = bounding_boxes( random_spheres(100, 30u) );
+  std::vector<AABB3df> moved = boxes;
+  moved[57] = AABB3df( moved[57].get_center() + Vector3df{ 0.0f, 0.001f, 0.0f }, 0.5f * (moved[57].get_max() - moved[57].get_min()) );
+  std::vector<LinearBVH3df::Mask> masks(boxes.size(), 1u);
+
+  EXPECT_EQ(LinearBVH3df::hash(boxes), LinearBVH3df::hash(boxes));
+  EXPECT_NE(LinearBVH3df::hash(boxes), LinearBVH3df::hash(moved));
+  EXPECT_NE(LinearBVH3df::hash(boxes), LinearBVH3df::hash(boxes, masks));
+  EXPECT_NE(LinearBVH3df::hash(boxes), LinearBVH3df::hash(boxes, {}, 1u));
+  EXPECT_NE(LinearBVH3df::hash(boxes), LinearBVH3df::hash( std::vector<AABB3df>(boxes.begin(), boxes.end() - 1) ));
+}
+
+// the mapped hierarchy has exactly the arrays of the saved one and answers the same queries
+TEST(LINEAR_BVH, CacheRoundTrip) {
+  std::vector<Sphere3df> spheres = random_spheres(500, 31u);
+  std::vector<AABB3df> boxes = bounding_boxes(spheres);
+  std::vector<LinearBVH3df::Mask> masks;
+  for (size_t i = 0; i < spheres.size(); i++) {
+    masks.push_back(1u << (i % 3));
+  }
+  LinearBVH3df bvh( BVH3df(boxes), masks );
+  uint64_t key = LinearBVH3df::hash(boxes, masks);
+  std::string path = cache_path("bvh_test_round_trip.bvh");
+  ASSERT_TRUE(bvh.save(path, key));
+
+  std::optional<LinearBVH3df> cached = LinearBVH3df::load(path, key, boxes.size());
+  ASSERT_TRUE(cached.has_value());
+  EXPECT_TRUE(cached->is_mapped());
+  EXPECT_FALSE(bvh.is_mapped());
+  EXPECT_TRUE(equal_bytes(bvh.get_nodes(), cached->get_nodes()));
+  EXPECT_TRUE(equal_bytes(bvh.primitive_indices(), cached->primitive_indices()));
+  EXPECT_TRUE(equal_bytes(bvh.primitive_masks(), cached->primitive_masks()));
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(cached->get_nodes().data()) % alignof(LinearBVH3df::Node));
+  EXPECT_EQ(bvh.sah_cost(), cached->sah_cost());
+  EXPECT_FLOAT_EQ(1.0f, cached->degradation());
+  expect_any_hit_equals_linear_search(*cached, spheres, 32u);
+  std::filesystem::remove(path);
+}
+
+// writers of the same key use their own temporary files, the file in place is always one complete hierarchy
+TEST(LINEAR_BVH, CacheConcurrentSaves) {
+  std::vector<AABB3df> boxes = bounding_boxes( random_spheres(2000, 36u) );
+  LinearBVH3df bvh( (BVH3df(boxes)) );
+  uint64_t key = LinearBVH3df::hash(boxes);
+  std::string path = cache_path("bvh_test_concurrent.bvh");
+  std::vector<std::thread> writers;
+  std::atomic<size_t> saved = 0;
+  for (size_t w = 0; w < 4u; w++) {
+    writers.emplace_back([&]() {
+      for (size_t r = 0; r < 10u; r++) {
+        saved += bvh.save(path, key) ? 1u : 0u;
+      }
+    });
+  }
+  for (auto & writer : writers) {
+    writer.join();
+  }
+
+  EXPECT_EQ(40u, saved);
+  std::optional<LinearBVH3df> cached = LinearBVH3df::load(path, key, boxes.size());
+  ASSERT_TRUE(cached.has_value());
+  EXPECT_TRUE(equal_bytes(bvh.get_nodes(), cached->get_nodes()));
+  EXPECT_TRUE(equal_bytes(bvh.primitive_indices(), cached->primitive_indices()));
+  size_t files = 0;
+  for (const auto & entry : std::filesystem::directory_iterator(std::filesystem::temp_directory_path())) {
+    files += entry.path().filename().string().rfind("bvh_test_concurrent.bvh.", 0) == 0 ? 1u : 0u;
+  }
+  EXPECT_EQ(0u, files);
+  std::filesystem::remove(path);
+}
+
+TEST(LINEAR_BVH, CacheEmptyHierarchy) {
+  LinearBVH3df bvh( BVH3df( {} ) );
+  std::string path = cache_path("bvh_test_empty.bvh");
+  ASSERT_TRUE(bvh.save(path, 0u));
+
+  std::optional<LinearBVH3df> cached = LinearBVH3df::load(path, 0u, 0u);
+  ASSERT_TRUE(cached.has_value());
+  EXPECT_TRUE(cached->get_nodes().empty());
+  float t = INFINITY;
+  EXPECT_EQ(LinearBVH3df::no_hit, cached->closest_hit(Ray3df{ {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0} }, 0.0f, t, [](size_t, float &) { return true; }));
+  std::filesystem::remove(path);
+}
+
+TEST(LINEAR_BVH, CacheRejectsOtherFiles) {
+  std::vector<AABB3df> boxes = bounding_boxes( random_spheres(200, 33u) );
+  LinearBVH3df bvh( (BVH3df(boxes)) );
+  uint64_t key = LinearBVH3df::hash(boxes);
+  std::string path = cache_path("bvh_test_reject.bvh");
+  ASSERT_TRUE(bvh.save(path, key));
+
+  EXPECT_FALSE(LinearBVH3df::load(path, key + 1u, boxes.size()).has_value());
+  EXPECT_FALSE(LinearBVH2df::load(path, key, boxes.size()).has_value());
+  EXPECT_FALSE(LinearBVH3df::load(cache_path("bvh_test_missing.bvh"), key, boxes.size()).has_value());
+
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1u);
+  EXPECT_FALSE(LinearBVH3df::load(path, key, boxes.size()).has_value());
+  std::filesystem::resize_file(path, 40u);
+  EXPECT_FALSE(LinearBVH3df::load(path, key, boxes.size()).has_value());
+  std::filesystem::remove(path);
+}
+
+// overwrites the nodes of a cache file, they start at the first multiple of 64 bytes after the 88 byte header,
+// their number is at offset 40 of the header
+void patch_nodes(const std::string & path, const std::function<void(std::vector<LinearBVH3df::Node> &)> & patch) {
+  std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+  uint64_t count = 0;
+  file.seekg(40);
+  file.read(reinterpret_cast<char *>(&count), sizeof(count));
+  std::vector<LinearBVH3df::Node> nodes(count);
+  file.seekg(128);
+  file.read(reinterpret_cast<char *>(nodes.data()), nodes.size() * sizeof(LinearBVH3df::Node));
+  patch(nodes);
+  file.seekp(128);
+  file.write(reinterpret_cast<const char *>(nodes.data()), nodes.size() * sizeof(LinearBVH3df::Node));
+}
+
+// a chain of inner nodes whose first children are leaves, the last inner node has two leaves
+void make_chain(std::vector<LinearBVH3df::Node> & nodes) {
+  for (uint32_t k = 0; k < nodes.size(); k++) {
+    bool inner = k % 2u == 0u && k + 1u < nodes.size();
+    nodes[k].offset = inner ? k + 2u : 0u;
+    nodes[k].count = inner ? 0u : 1u;
+    nodes[k].axis = 0u;
+  }
+}
+
+// a file with the right key but broken nodes must not let a traversal leave the arrays or its stack
+TEST(LINEAR_BVH, CacheRejectsInconsistentNodes) {
+  std::string path = cache_path("bvh_test_inconsistent.bvh");
+  size_t primitives = 0;
+  auto save = [&](size_t count) {
+    primitives = count;
+    ASSERT_TRUE(LinearBVH3df( BVH3df( bounding_boxes( random_spheres(count, 37u) ), 1u ) ).save(path, 0u));
+  };
+  auto patched = [&](const std::function<void(std::vector<LinearBVH3df::Node> &)> & patch) {
+    patch_nodes(path, patch);
+    return LinearBVH3df::load(path, 0u, primitives).has_value();
+  };
+
+  save(83u);
+  ASSERT_EQ(165u, LinearBVH3df::load(path, 0u, primitives)->get_nodes().size());
+  EXPECT_FALSE(patched([](auto & nodes) { nodes[0].offset = static_cast<uint32_t>(nodes.size()); }));
+  save(83u);
+  EXPECT_FALSE(patched([](auto & nodes) { nodes[0].offset = 1u; }));
+  save(83u);
+  EXPECT_FALSE(patched([](auto & nodes) { nodes[0].axis = 3u; }));
+  save(83u);
+  EXPECT_FALSE(patched([](auto & nodes) { nodes.back().offset = 83u; }));
+  save(83u);
+  EXPECT_FALSE(patched([](auto & nodes) { nodes.back().count = 2u; }));
+  save(83u);
+  EXPECT_FALSE(patched([](auto & nodes) { nodes[1].count = 0u; nodes[1].offset = 2u; }));
+
+  // a node count at offset 40 of the header whose array size wraps around to the size of the saved nodes
+  save(83u);
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    uint64_t count = 165u + (uint64_t(1) << 59);
+    file.seekp(40);
+    file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  }
+  EXPECT_FALSE(LinearBVH3df::load(path, 0u, primitives).has_value());
+
+  // 82 inner nodes in a chain exceed the stack of LinearBVH3df::max_depth = 81 entries, 81 fit
+  save(83u);
+  EXPECT_FALSE(patched(make_chain));
+  save(82u);
+  EXPECT_TRUE(patched(make_chain));
+  std::filesystem::remove(path);
+}
+
+// the primitive indices start at the offset stored at byte 64 of the header, an index that is not less
+// than the number of primitives of the scene would let a callback read past its primitive array
+TEST(LINEAR_BVH, CacheRejectsOutOfRangeIndices) {
+  std::vector<AABB3df> boxes = bounding_boxes( random_spheres(200, 38u) );
+  std::string path = cache_path("bvh_test_indices.bvh");
+  ASSERT_TRUE(LinearBVH3df( (BVH3df(boxes)) ).save(path, 0u));
+  EXPECT_TRUE(LinearBVH3df::load(path, 0u, boxes.size()).has_value());
+  EXPECT_FALSE(LinearBVH3df::load(path, 0u, boxes.size() - 1u).has_value());
+
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    uint64_t offset = 0;
+    file.seekg(64);
+    file.read(reinterpret_cast<char *>(&offset), sizeof(offset));
+    uint32_t index = static_cast<uint32_t>(boxes.size());
+    file.seekp(static_cast<std::streamoff>(offset + 17u * sizeof(uint32_t)));
+    file.write(reinterpret_cast<const char *>(&index), sizeof(index));
+  }
+  EXPECT_FALSE(LinearBVH3df::load(path, 0u, boxes.size()).has_value());
+  std::filesystem::remove(path);
+}
+
+// refitting a mapped hierarchy changes only its private pages, a copy owns its arrays
+TEST(LINEAR_BVH, CacheRefitKeepsFile) {
+  std::vector<Sphere3df> spheres = random_spheres(500, 34u);
+  std::vector<AABB3df> boxes = bounding_boxes(spheres);
+  LinearBVH3df bvh( (BVH3df(boxes)) );
+  std::string path = cache_path("bvh_test_refit.bvh");
+  ASSERT_TRUE(bvh.save(path, 7u));
+
+  std::optional<LinearBVH3df> cached = LinearBVH3df::load(path, 7u, boxes.size());
+  ASSERT_TRUE(cached.has_value());
+  LinearBVH3df copy = *cached;
+  EXPECT_FALSE(copy.is_mapped());
+  EXPECT_TRUE(equal_bytes(cached->get_nodes(), copy.get_nodes()));
+
+  cached->refit( bounding_boxes( move_spheres(spheres, 2.0f, 35u) ) );
+  EXPECT_FALSE(equal_bytes(bvh.get_nodes(), cached->get_nodes()));
+  EXPECT_TRUE(equal_bytes(bvh.get_nodes(), copy.get_nodes()));
+  EXPECT_TRUE(equal_bytes(bvh.get_nodes(), LinearBVH3df::load(path, 7u, boxes.size())->get_nodes()));
+  std::filesystem::remove(path);
+}
+
+// the rays of a packet start at a common origin and point to a block of a screen like primary rays,
+// screens that cross an axis give packets that are not coherent and are traced ray by ray
+template <size_t SIZE>
+void expect_packets_equal_closest_hit(const LinearBVH3df & bvh, const std::vector<Sphere3df> & spheres, LinearBVH3df::Mask mask) {
+  for (size_t block = 0; block < 64; block++) {
+    std::vector<Ray3df> rays;
+    size_t count = block % 7 == 6 ? SIZE / 2 + 1 : SIZE;  // some packets are not full, like at the border of an image
+    for (size_t l = 0; l < count; l++) {
+      Vector3df d = { -0.75f + 0.1f * (block % 8) + 0.02f * (l % 4), -0.75f + 0.1f * (block / 8) + 0.02f * (l / 4), -1.0f };
+      d.normalize();
+      rays.push_back( Ray3df{ {0.0, 0.0, 12.0}, d } );
+    }
+    RayPacket<float, 3u, SIZE> packet(rays.data(), count);
+
+    float t[SIZE];
+    size_t hit[SIZE];
+    std::fill(t, t + SIZE, INFINITY);
+    std::fill(hit, hit + SIZE, LinearBVH3df::no_hit);
+    bvh.closest_hit(packet, 0.0f, t, hit, [&](size_t i, unsigned l, float & t_max) {
+      EXPECT_LT(l, count);
+      return spheres[i].intersects(rays[l], 0.0f, t_max);
+    }, mask);
+
+    for (size_t l = 0; l < count; l++) {
+      float t_single = INFINITY;
+      size_t single = bvh.closest_hit(rays[l], 0.0f, t_single, [&](size_t i, float & t_max) {
+        return spheres[i].intersects(rays[l], 0.0f, t_max);
+      }, mask);
+      EXPECT_EQ(single, hit[l]);
+      EXPECT_EQ(t_single, t[l]);
+    }
+  }
+}
+
+TEST(LINEAR_BVH, PacketsEqualClosestHit) {
+  std::vector<Sphere3df> spheres = random_spheres(500, 10u);
+  std::vector<LinearBVH3df::Mask> masks;
+  for (size_t i = 0; i < spheres.size(); i++) {
+    masks.push_back(i % 3 == 0 ? 1u : 2u);
+  }
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ), masks );
+
+  expect_packets_equal_closest_hit<8u>(bvh, spheres, LinearBVH3df::all);
+  expect_packets_equal_closest_hit<16u>(bvh, spheres, LinearBVH3df::all);
+  expect_packets_equal_closest_hit<8u>(bvh, spheres, 1u);
+  expect_packets_equal_closest_hit<16u>(bvh, spheres, 1u);
+}
+
+TEST(LINEAR_BVH, PacketIntersectsEqualsScalar) {
+  LinearBVH3df bvh( BVH3df( bounding_boxes( random_spheres(100, 11u) ) ) );
+  Ray3df rays[16] = {};
+  std::mt19937 generator(12u);
+  std::uniform_real_distribution<float> value(0.1f, 1.0f);
+  for (size_t l = 0; l < 16; l++) {
+    Vector3df d = { value(generator), -value(generator), l == 3 ? 0.0f : value(generator) };  // lane 3 runs parallel to the z slabs
+    rays[l] = Ray3df{ {-12.0, 12.0, -12.0}, d };
+  }
+  RayPacket8_3df packet8(rays, 7u);
+  RayPacket16_3df packet16(rays, 16u);
+  float t[16];
+  std::fill(t, t + 16, 30.0f);
+
+  for (const auto & node : bvh.get_nodes()) {
+    EXPECT_EQ(LinearBVH3df::intersects_scalar(node, packet8, 0.0f, t, packet8.active), LinearBVH3df::intersects(node, packet8, 0.0f, t, packet8.active));
+    EXPECT_EQ(LinearBVH3df::intersects_scalar(node, packet16, 0.0f, t, 0xFF0Fu), LinearBVH3df::intersects(node, packet16, 0.0f, t, 0xFF0Fu));
+  }
+}
+
+TEST(BVH, AnyHitEqualsLinearSearch) {
+  std::vector<Sphere3df> spheres = random_spheres(500, 8u);
+  BVH3df bvh( bounding_boxes(spheres) );
+
+  expect_any_hit_equals_linear_search(bvh, spheres, 9u);
+}
+
+TEST(LINEAR_BVH, AnyHitEqualsLinearSearch) {
+  std::vector<Sphere3df> spheres = random_spheres(500, 8u);
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres) ) );
+
+  expect_any_hit_equals_linear_search(bvh, spheres, 9u);
+}
+
+TEST(BVH, SahCostBelowLinearCost) {
+  BVH3df bvh( bounding_boxes( random_spheres(1000, 5u) ) );
+
+  EXPECT_LT(bvh.sah_cost(), 1000.0f / 10.0f);
+  EXPECT_LT(bvh.depth(), 40u);
+}
+
+TEST(MORTON_BVH, MortonCode) {
+  EXPECT_EQ(0u, BVH3df::morton_code({0u, 0u, 0u}));
+  EXPECT_EQ(0b001u, BVH3df::morton_code({1u, 0u, 0u}));
+  EXPECT_EQ(0b010u, BVH3df::morton_code({0u, 1u, 0u}));
+  EXPECT_EQ(0b100u, BVH3df::morton_code({0u, 0u, 1u}));
+  EXPECT_EQ(0b111000u, BVH3df::morton_code({2u, 2u, 2u}));
+  EXPECT_EQ(0x7fffffffffffffffu, BVH3df::morton_code({0x1fffffu, 0x1fffffu, 0x1fffffu}));
+  EXPECT_EQ(0b1001u, BVH2df::morton_code({1u, 2u}));
+  EXPECT_EQ(0xffffffffffffffffu, BVH2df::morton_code({0xffffffffu, 0xffffffffu}));
+}
+
+TEST(MORTON_BVH, EachPrimitiveOnce) {
+  std::vector<AABB3df> boxes = bounding_boxes( random_spheres(1000, 11u) );
+  BVH3df bvh(boxes, 4u, 1u, BVH3df::Builder::morton);
+  std::vector<size_t> indices = bvh.primitive_indices();
+  std::sort(indices.begin(), indices.end());
+
+  ASSERT_EQ(1000u, indices.size());
+  for (size_t i = 0; i < indices.size(); i++) {
+    EXPECT_EQ(i, indices[i]);
+  }
+  // each node contains the aabbs of its primitives, leaves have at most max_leaf_size primitives
+  std::vector<const BVH3df::Node *> stack = { bvh.root() };
+  size_t primitives = 0;
+  while (!stack.empty()) {
+    const BVH3df::Node * node = stack.back();
+    stack.pop_back();
+    if (node->count == 0) {
+      stack.push_back(node->left.get());
+      stack.push_back(node->right.get());
+      continue;
+    }
+    EXPECT_LE(node->count, 4u);
+    primitives += node->count;
+    for (size_t i = node->first; i < node->first + node->count; i++) {
+      for (size_t k = 0; k < 3; k++) {
+        EXPECT_LE(node->bounds.get_min()[k], boxes[bvh.primitive_indices()[i]].get_min()[k] + 0.0001f);
+        EXPECT_GE(node->bounds.get_max()[k], boxes[bvh.primitive_indices()[i]].get_max()[k] - 0.0001f);
+      }
+    }
+  }
+  EXPECT_EQ(1000u, primitives);
+  EXPECT_GT(bvh.build_time(), 0.0);
+}
+
+// the workers build the same tree as the serial build
+TEST(MORTON_BVH, ParallelEqualsSerial) {
+  std::vector<AABB3df> boxes = bounding_boxes( random_spheres(5000, 12u) );
+  ThreadPool pool(4u);
+  BVH3df serial(boxes, 4u, 1u, BVH3df::Builder::morton), parallel(boxes, 4u, 1u, BVH3df::Builder::morton, &pool);
+
+  EXPECT_EQ(serial.primitive_indices(), parallel.primitive_indices());
+  EXPECT_EQ(serial.node_count(), parallel.node_count());
+  EXPECT_EQ(serial.depth(), parallel.depth());
+  EXPECT_FLOAT_EQ(serial.sah_cost(), parallel.sah_cost());
+}
+
+TEST(MORTON_BVH, IdenticalCentroids) {
+  std::vector<AABB3df> boxes( 20, Sphere3df( {1.0, 1.0, 1.0}, 0.5 ).bounding_box() );
+  BVH3df bvh(boxes, 4u, 1u, BVH3df::Builder::morton);
+
+  EXPECT_EQ(20u, bvh.primitive_indices().size());
+  EXPECT_GT(bvh.node_count(), 1u);
+  EXPECT_LE(bvh.depth(), 4u);
+}
+
+TEST(MORTON_BVH, ClosestHitEqualsLinearSearch) {
+  std::vector<Sphere3df> spheres = random_spheres(500, 13u);
+  ThreadPool pool(2u);
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres), 4u, 1u, BVH3df::Builder::morton, &pool ) );
+  std::mt19937 generator(14u);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+  for (size_t r = 0; r < 200; r++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    d.normalize();
+    Ray3df ray = { {0.0, 0.0, 0.0}, d };
+
+    float t_linear = INFINITY;
+    size_t linear = LinearBVH3df::no_hit;
+    for (size_t i = 0; i < spheres.size(); i++) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_linear) {
+        t_linear = t;
+        linear = i;
+      }
+    }
+
+    float t_bvh = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t_bvh, [&](size_t i, float & t_max) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_max) {
+        t_max = t;
+        return true;
+      }
+      return false;
+    });
+
+    EXPECT_EQ(linear, hit);
+    if (linear != LinearBVH3df::no_hit) {
+      EXPECT_NEAR(t_linear, t_bvh, 0.00001);
+    }
+  }
+  expect_any_hit_equals_linear_search(bvh, spheres, 15u);
+}
+
+// the morton build trades tree quality for speed, but stays close to the sah build
+TEST(MORTON_BVH, SahCostNearSahBuild) {
+  std::vector<AABB3df> boxes = bounding_boxes( random_spheres(1000, 5u) );
+  BVH3df sah(boxes), morton(boxes, 4u, 1u, BVH3df::Builder::morton);
+
+  EXPECT_LT(morton.sah_cost(), 1.5f * sah.sah_cost());
+  EXPECT_LT(morton.depth(), 40u);
+}
+
+TEST(SBVH, EachTriangleAtLeastOnce) {
+  std::vector<std::array<Vector3df, 3u>> triangles = random_slivers(900, 100, 25u);
+  BVH3df bvh(triangles, 0.3f);
+  std::vector<size_t> indices = bvh.primitive_indices();
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+  EXPECT_EQ(1000u, indices.size());
+  EXPECT_GT(bvh.primitive_indices().size(), 1000u);
+  EXPECT_LE(bvh.primitive_indices().size(), 1300u);
+  EXPECT_GT(bvh.build_time(), 0.0);
+}
+
+// without budget for duplicated references only object splits are possible
+TEST(SBVH, ZeroGrowthEqualsSahBuild) {
+  std::vector<std::array<Vector3df, 3u>> triangles = random_slivers(900, 100, 26u);
+  BVH3df sbvh(triangles, 0.0f), sah( bounding_boxes(triangles) );
+
+  EXPECT_EQ(1000u, sbvh.primitive_indices().size());
+  EXPECT_NEAR(sah.sah_cost(), sbvh.sah_cost(), 0.01f * sah.sah_cost());
+}
+
+TEST(SBVH, SahCostBelowSahBuild) {
+  std::vector<std::array<Vector3df, 3u>> triangles = random_slivers(5000, 100, 27u);
+  BVH3df sbvh(triangles, 0.3f), sah( bounding_boxes(triangles) );
+
+  EXPECT_LT(sbvh.sah_cost(), 0.8f * sah.sah_cost());
+}
+
+// the clipped leaves must still contain the part of each triangle that a ray can hit there
+TEST(SBVH, ClosestHitEqualsLinearSearch) {
+  std::vector<std::array<Vector3df, 3u>> vertices = random_slivers(900, 100, 28u);
+  std::vector<Triangle3df> triangles;
+  for (const auto & v : vertices) {
+    triangles.push_back( Triangle3df(v[0], v[1], v[2]) );
+  }
+  LinearBVH3df bvh( BVH3df(vertices, 0.5f, 2u) );
+  std::mt19937 generator(29u);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+  for (size_t r = 0; r < 500; r++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    d.normalize();
+    Ray3df ray = { {0.0, 0.0, 0.0}, d };
+
+    float t_linear = INFINITY, u, v;
+    size_t linear = LinearBVH3df::no_hit;
+    for (size_t i = 0; i < triangles.size(); i++) {
+      if (triangles[i].intersects(ray, 0.0f, t_linear, u, v)) {
+        linear = i;
+      }
+    }
+
+    float t_bvh = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t_bvh, [&](size_t i, float & t_max) {
+      return triangles[i].intersects(ray, 0.0f, t_max, u, v);
+    });
+    size_t blocker = bvh.any_hit(ray, 0.0f, INFINITY, [&](size_t i) {
+      return triangles[i].occludes(ray, 0.0f, INFINITY);
+    });
+
+    EXPECT_EQ(linear, hit);
+    EXPECT_EQ(linear != LinearBVH3df::no_hit, blocker != LinearBVH3df::no_hit);
+    if (linear != LinearBVH3df::no_hit) {
+      EXPECT_EQ(t_linear, t_bvh);
+    }
+  }
+}
+
+}
@@ -1,17 +1,37 @@
 #include "geometry.h"
+#ifndef HEADER_ONLY_TEMPLATES
 #include "geometry.tcc"
+#endif
 
 template class Intersection_Context<float,3u>;
 
 template class Ray<float, 2u>;
 template class Ray<float, 3u>; 
 
+template class RayQuery<float, 2u>;
+template class RayQuery<float, 3u>;
+
+template class RayPacket<float, 3u, 8u>;
+template class RayPacket<float, 3u, 16u>;
+
 template class AxisAlignedBoundingBox<float, 2u>;
 template class AxisAlignedBoundingBox<float, 3u>; 
 
 template class Sphere<float, 2u>;
 template class Sphere<float, 3u>; 
 
+template class Plane<float, 2u>;
+template class Plane<float, 3u>;
+
+template class Box<float, 2u>;
+template class Box<float, 3u>;
+
 template class Triangle<float, 3u>; 
 
+template class TriangleMesh<float, 3u>;
+
+template class Transform<float, 2u>;
+template class Transform<float, 3u>;
+
 template bool refract<float, 3u>(float refraction_index, Vector<float, 3u> normal, Vector<float, 3u> direction, Vector<float, 3> & transmission);
+template bool intersects_triangle<float, 3u>(const Ray<float, 3u> &ray, Vector<float, 3u> a, Vector<float, 3u> ab, Vector<float, 3u> ac, float & t, float & u, float & v);
@@ -3,7 +3,12 @@
 
 
 #include "math.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <utility>
 #include <vector>
 
 // contains geometric shapes and related stuff, like spheres, triangles, intersection algorithms.
@@ -15,6 +20,41 @@ struct Ray {
                   direction;
 };
 
+// a ray prepared for many aabb tests, e.g. during the traversal of a bounding volume hierarchy
+// only the parameter interval [t_min, t_max] of the ray is considered
+template <class FLOAT, size_t N>
+struct RayQuery {
+  Vector<FLOAT,N> origin,
+                  direction,
+                  inverse_direction; // 1 / direction, +/- INFINITY for zero components
+  std::array<unsigned, N> negative;  // 1 iff direction[i] < 0 (or -0), otherwise 0
+  FLOAT t_min, t_max;
+
+  RayQuery(const Ray<FLOAT,N> &ray, FLOAT t_min = 0.0, FLOAT t_max = std::numeric_limits<FLOAT>::infinity());
+};
+
+// SIZE rays in structure of arrays layout, e.g. the primary rays of a block of neighbouring pixels,
+// so that an aabb can be tested against all rays of the packet at once (SIZE <= 32)
+// a packet is coherent if the directions of all rays have the same signs, only coherent packets
+// share one traversal order and can be traced together, other packets are traced ray by ray
+template <class FLOAT, size_t N, size_t SIZE>
+struct RayPacket {
+  static constexpr size_t size = SIZE;
+
+  alignas(64) FLOAT origin[N][SIZE],
+                    direction[N][SIZE],
+                    inverse_direction[N][SIZE];  // 1 / direction like in RayQuery
+  std::array<unsigned, N> negative;  // signs of the first ray, see RayQuery
+  uint32_t active;                   // bit l is set iff lane l holds a ray
+  bool coherent;
+
+  // lane l holds rays[l] for l < count, the remaining lanes repeat the first ray and are inactive
+  RayPacket(const Ray<FLOAT,N> * rays, size_t count);
+
+  // returns the ray of the given lane
+  Ray<FLOAT,N> ray(size_t lane) const;
+};
+
 // collection of intersection specific values, like intersection point, normal etc
 template <class FLOAT, size_t N>
 struct Intersection_Context {
@@ -33,6 +73,13 @@ struct Intersection_Context {
 template <class FLOAT, size_t N>
 bool refract(FLOAT refraction_index, Vector<FLOAT, N> normal, Vector<FLOAT, N> direction, Vector<FLOAT, N> & transmission);
 
+// Möller-Trumbore test of the ray against the triangle a, a + ab, a + ac without square roots
+// returns true if the ray intersects the triangle for t >= 0, t is set to a value with
+//   intersection = ray.origin + t * ray.direction
+//   u and v are set to the barycentric coordinates of a and a + ab of the intersection
+template <class FLOAT, size_t N>
+bool intersects_triangle(const Ray<FLOAT, N> &ray, Vector<FLOAT, N> a, Vector<FLOAT, N> ab, Vector<FLOAT, N> ac, FLOAT & t, FLOAT & u, FLOAT & v);
+
 
 
 /*
@@ -66,6 +113,29 @@ public:
   // checks if this aabb is intersected by the given ray
   bool intersects(Ray<FLOAT,N> ray) const;
 
+  // checks if this aabb is intersected by the given ray for a value t with
+  // t_min <= t <= t_max, where ray.origin + t * ray.direction is a point inside the aabb
+  bool intersects(const Ray<FLOAT,N> &ray, FLOAT t_min, FLOAT t_max) const;
+
+  // checks if this aabb is intersected by the given ray for a value t within [query.t_min, query.t_max]
+  // t_entry is set to the smallest such t, i.e. the entry value or query.t_min if the origin is inside
+  bool intersects(const RayQuery<FLOAT,N> &query, FLOAT & t_entry) const;
+
+  // returns the smallest aabb that contains this aabb and the given aabb
+  AxisAlignedBoundingBox<FLOAT,N> merge(AxisAlignedBoundingBox<FLOAT,N> aabb) const;
+
+  // returns the surface area of this aabb (the perimeter in the two-dimensional case)
+  FLOAT surface_area() const;
+
+  Vector<FLOAT,N> get_center() const;
+  Vector<FLOAT,N> get_half_edge_length() const;
+
+  // returns the corner with the smallest coordinates in each dimension
+  Vector<FLOAT,N> get_min() const;
+
+  // returns the corner with the largest coordinates in each dimension
+  Vector<FLOAT,N> get_max() const;
+
   // checks if an intersection exists with an aabb moving in the given direction
   bool intersects(AxisAlignedBoundingBox<FLOAT,N> aabb, Vector<FLOAT, N> direction) const;
   
@@ -94,6 +164,18 @@ public:
   // t is zero if no intersection occured
   FLOAT intersects(const Ray<FLOAT, N> &ray) const;
 
+  // returns true iff the given ray intersects this sphere for a value t with t_min < t < t_max
+  // t_max is set to the smallest such t, nothing else is computed, so that a closest hit search
+  // can use this test for all candidates and call finalize() only for the closest one
+  bool intersects(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t_max) const;
+
+  // sets context as intersects(ray, context) does for the intersection at t, e.g. found by intersects(ray, t_min, t_max)
+  void finalize(const Ray<FLOAT, N> &ray, FLOAT t, Intersection_Context<FLOAT, N> & context) const;
+
+  // returns true iff the given ray intersects this sphere for any t with t_min < t < t_max,
+  // e.g. for shadow rays, where only the existence of a blocker matters and not the closest one
+  bool occludes(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max) const;
+
   // returns true iff this Sphere intersects with the given sphere
   
   bool intersects(Sphere<FLOAT, N> sphere) const;
@@ -103,6 +185,73 @@ public:
   
   bool inside(const Vector<FLOAT, N> p) const;
 
+  // returns the smallest aabb that contains this Sphere
+  AxisAlignedBoundingBox<FLOAT, N> bounding_box() const;
+
+  Vector<FLOAT,N> get_center() const;
+  FLOAT get_radius() const;
+};
+
+// an infinite plane of the points p with normal * p == distance
+// the plane has no aabb and is hit from both sides, e.g. the walls of a room
+template <class FLOAT, size_t N>
+class Plane {
+protected:
+  Vector<FLOAT,N> normal; // normalized
+  FLOAT distance;
+public:
+  // creates the plane through point, the normal does not need to be normalized
+  Plane(Vector<FLOAT,N> point, Vector<FLOAT,N> normal);
+
+  // returns true iff the given ray intersects this plane for t > 0
+  // context.intersection, context.normal and context.t are set as by Sphere::intersects(ray, context),
+  // context.normal points to the side of the ray origin
+  bool intersects(const Ray<FLOAT, N> &ray, Intersection_Context<FLOAT, N> & context) const;
+
+  // returns true iff the given ray intersects this plane for a value t with t_min < t < t_max
+  // t_max is set to t, see Sphere::intersects(ray, t_min, t_max)
+  bool intersects(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t_max) const;
+
+  // sets context as intersects(ray, context) does for the intersection at t
+  void finalize(const Ray<FLOAT, N> &ray, FLOAT t, Intersection_Context<FLOAT, N> & context) const;
+
+  // returns true iff the given ray intersects this plane for a value t with t_min < t < t_max, see Sphere::occludes()
+  bool occludes(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max) const;
+
+  Vector<FLOAT,N> get_normal() const;
+  FLOAT get_distance() const;
+};
+
+// a solid axis aligned box given by its corners with the smallest and largest coordinates
+// the edge length may be zero for one axis, the box is an axis aligned rectangle (quad) in this case
+template <class FLOAT, size_t N>
+class Box {
+protected:
+  Vector<FLOAT,N> lower, upper;
+
+  // slab test, sets t_near and t_far to the values where the ray enters and leaves the box
+  // returns false if the ray misses the box
+  bool slabs(const Ray<FLOAT, N> &ray, FLOAT & t_near, FLOAT & t_far) const;
+public:
+  Box(Vector<FLOAT,N> lower, Vector<FLOAT,N> upper);
+
+  // returns true iff the given ray intersects the surface of this box for t > 0
+  // context.intersection, context.normal and context.t are set as by Sphere::intersects(ray, context),
+  // context.normal is the normal of the face that is hit, pointing to the side of the ray origin
+  bool intersects(const Ray<FLOAT, N> &ray, Intersection_Context<FLOAT, N> & context) const;
+
+  // returns true iff the given ray intersects the surface of this box for a value t with t_min < t < t_max
+  // t_max is set to the smallest such t, see Sphere::intersects(ray, t_min, t_max)
+  bool intersects(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t_max) const;
+
+  // sets context as intersects(ray, context) does for the intersection at t
+  void finalize(const Ray<FLOAT, N> &ray, FLOAT t, Intersection_Context<FLOAT, N> & context) const;
+
+  // returns true iff the given ray intersects the surface of this box for a value t with t_min < t < t_max, see Sphere::occludes()
+  bool occludes(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max) const;
+
+  // returns the aabb of this box
+  AxisAlignedBoundingBox<FLOAT, N> bounding_box() const;
 };
 
 template <class FLOAT, size_t N>
@@ -110,9 +259,10 @@ class Triangle {
 protected:
   Vector<FLOAT, N> a, b, c;
   Vector<FLOAT, N> na, nb, nc;  // normal vectors for each point
+  Vector<FLOAT, N> ab, ac;      // precomputed edges b - a and c - a
 public:
   // creates a triangle with the given edge points a,b,c
-  // the normals point away from the surface given by clockwise orientation of a,b,c
+  // the normals are (b - a) x (c - a) (right-handed), as for a TriangleMesh without vertex normals
   Triangle(Vector<FLOAT, N> a, Vector<FLOAT, N> b, Vector<FLOAT, N> c);
 
   // creates a triangle with the given edge points a,b,c 
@@ -127,28 +277,181 @@ public:
   // if an intersection occured, than intersection is set to the intersection point
   //   u and v are set to the barycentric coordinates of the intersection
   //   t is set to a value with intersection = ray.origin + t * ray.direction
-  //   normal points away from the surface (clockwise order of a,b, and c)
+  //   normal is set to interpolate_normal(u, v)
   bool intersects(const Ray<FLOAT, N> &ray, Vector<FLOAT, N> & normal, Vector<FLOAT, N> & intersection, FLOAT & u, FLOAT & v, FLOAT & t) const;
 
   // returns true if this Triangle intersects the given ray
   // if an intersection occured, than context.intersection is set to the intersection point
   //   context.u and context.v are set to the barycentric coordinates of the intersection
   //   context.t is set to a value with intersection = ray.origin + t * ray.direction
-  //   context.normal points away from the surface (clockwise order of a,b, and c)
+  //   context.normal is set to interpolate_normal(u, v)
   bool intersects(const Ray<FLOAT, N> &ray, Intersection_Context<FLOAT, N> & context) const;
+
+  // returns true if this Triangle intersects the given ray (Möller-Trumbore test without square roots)
+  // if an intersection occured, than t is set to a value with intersection = ray.origin + t * ray.direction
+  //   u and v are set to the barycentric coordinates of the intersection as above
+  // the closest hit search should use this test and compute the normal only for the closest triangle
+  bool intersects(const Ray<FLOAT, N> &ray, FLOAT & t, FLOAT & u, FLOAT & v) const;
+
+  // returns true iff the given ray intersects this Triangle for a value t with t_min < t < t_max
+  // t_max is set to this t and u and v to the barycentric coordinates, see Sphere::intersects(ray, t_min, t_max)
+  bool intersects(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t_max, FLOAT & u, FLOAT & v) const;
+
+  // sets context as intersects(ray, context) does for the intersection at t, u, v, e.g. found by intersects(ray, t_min, t_max, u, v)
+  void finalize(const Ray<FLOAT, N> &ray, FLOAT t, FLOAT u, FLOAT v, Intersection_Context<FLOAT, N> & context) const;
+
+  // returns true iff the given ray intersects this Triangle for a value t with t_min < t < t_max, see Sphere::occludes()
+  bool occludes(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max) const;
+
+  // returns the normal at the point with the barycentric coordinates u and v,
+  // interpolated from na, nb, and nc and not normalized
+  Vector<FLOAT, N> interpolate_normal(FLOAT u, FLOAT v) const;
+
+  // returns the smallest aabb that contains this Triangle
+  AxisAlignedBoundingBox<FLOAT, N> bounding_box() const;
+};
+
+/*
+ a triangle mesh with shared vertices, each triangle is a triple of 32 bit indices into the vertex buffer
+
+   vertices  | v0 | v1 | v2 | v3 | ...
+   triangles | 0 1 2 | 2 1 3 | ...
+
+ normals and uvs are optional and, if given, hold one entry per vertex
+ the buffers are contiguous, so that a mesh can be loaded or copied in single bulk copies
+*/
+template <class FLOAT, size_t N>
+class TriangleMesh {
+public:
+  typedef std::array<uint32_t, 3u> Indices;
+
+  // takes over the buffers, e.g. after reading them from a file
+  TriangleMesh(std::vector<Vector<FLOAT, N>> vertices, std::vector<Indices> triangles,
+               std::vector<Vector<FLOAT, N>> normals = {}, std::vector<Vector<FLOAT, 2u>> uvs = {});
+
+  // returns the number of triangles
+  size_t size() const;
+
+  // returns true if the given triangle intersects the ray, see Triangle::intersects(ray, t, u, v)
+  bool intersects(size_t triangle, const Ray<FLOAT, N> &ray, FLOAT & t, FLOAT & u, FLOAT & v) const;
+
+  // returns true iff the ray intersects the given triangle for t_min < t < t_max, t_max is set to t
+  // see Triangle::intersects(ray, t_min, t_max, u, v)
+  bool intersects(size_t triangle, const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t_max, FLOAT & u, FLOAT & v) const;
+
+  // returns true iff the ray intersects the given triangle for t_min < t < t_max, see Triangle::occludes()
+  bool occludes(size_t triangle, const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max) const;
+
+  // returns the normal of the given triangle at the barycentric coordinates u and v, not normalized
+  // the normal is interpolated from the vertex normals, without normals it is (b - a) x (c - a) (right-handed)
+  Vector<FLOAT, N> normal(size_t triangle, FLOAT u, FLOAT v) const;
+
+  // returns the texture coordinates of the given triangle at the barycentric coordinates u and v
+  // without uvs, (u, v) is returned
+  Vector<FLOAT, 2u> uv(size_t triangle, FLOAT u, FLOAT v) const;
+
+  // returns the smallest aabb that contains the given triangle
+  AxisAlignedBoundingBox<FLOAT, N> bounding_box(size_t triangle) const;
+
+  const std::vector<Vector<FLOAT, N>> & get_vertices() const;
+  const std::vector<Indices> & get_triangles() const;
+  const std::vector<Vector<FLOAT, N>> & get_normals() const;
+  const std::vector<Vector<FLOAT, 2u>> & get_uvs() const;
+
+  // returns the number of bytes used by all buffers
+  size_t memory_size() const;
+
+private:
+  std::vector<Vector<FLOAT, N>> vertices;
+  std::vector<Indices> triangles;
+  std::vector<Vector<FLOAT, N>> normals;
+  std::vector<Vector<FLOAT, 2u>> uvs;
+};
+
+/*
+ an affine transformation x -> A x + b, e.g. to place an instance of a shared mesh in the scene
+
+ points are multiplied with A and moved by b, directions are only multiplied with A.
+ a transformed ray keeps its parameter t, since its direction is not normalized:
+
+   A (origin + t * direction) + b = (A origin + b) + t * (A direction)
+
+ normals have to be multiplied with the transposed inverse of A to stay orthogonal to the surface,
+ i.e. with inverse().transposed_direction()
+*/
+template <class FLOAT, size_t N>
+class Transform {
+public:
+  // creates the identity
+  Transform();
+
+  // creates the transformation with the given rows of A and b = translation
+  Transform(const std::array<Vector<FLOAT, N>, N> & rows, Vector<FLOAT, N> translation);
+
+  // returns the transformation that moves each point by offset
+  static Transform translation(Vector<FLOAT, N> offset);
+
+  // returns the transformation that multiplies the i-th coordinate with factors[i]
+  static Transform scaling(Vector<FLOAT, N> factors);
+
+  // returns the rotation by angle (in radians) in the plane of two axes, axis first is turned towards axis second
+  static Transform rotation(size_t first, size_t second, FLOAT angle);
+
+  // returns the transformation that applies transform first and this transformation afterwards
+  Transform operator*(const Transform & transform) const;
+
+  // returns the inverse transformation, A has to be invertible
+  Transform inverse() const;
+
+  // returns A point + b
+  Vector<FLOAT, N> point(Vector<FLOAT, N> point) const;
+
+  // returns A direction
+  Vector<FLOAT, N> direction(Vector<FLOAT, N> direction) const;
+
+  // returns the transposed of A multiplied with direction, see above
+  Vector<FLOAT, N> transposed_direction(Vector<FLOAT, N> direction) const;
+
+  // returns the transformed ray with the same parameter t for corresponding points, see above
+  Ray<FLOAT, N> ray(const Ray<FLOAT, N> & ray) const;
+
+  // returns the smallest aabb that contains the transformed aabb
+  AxisAlignedBoundingBox<FLOAT, N> bounding_box(const AxisAlignedBoundingBox<FLOAT, N> & aabb) const;
+
+private:
+  FLOAT a[N][N];           // A, a[i] is the i-th row
+  Vector<FLOAT, N> offset; // b
 };
 
 
 typedef Ray<float, 2u> Ray2df;
 typedef Ray<float, 3u> Ray3df;
 
+typedef RayPacket<float, 3u, 8u> RayPacket8_3df;
+typedef RayPacket<float, 3u, 16u> RayPacket16_3df;
+
 typedef AxisAlignedBoundingBox<float, 2u> AABB2df;
 typedef AxisAlignedBoundingBox<float, 3u> AABB3df;
 
 typedef Sphere<float, 2u> Sphere2df;
 typedef Sphere<float, 3u> Sphere3df;
 
+typedef Plane<float, 2u> Plane2df;
+typedef Plane<float, 3u> Plane3df;
+
+typedef Box<float, 2u> Box2df;
+typedef Box<float, 3u> Box3df;
+
 typedef Triangle<float, 3u> Triangle3df;
 
+typedef TriangleMesh<float, 3u> TriangleMesh3df;
+
+typedef Transform<float, 2u> Transform2df;
+typedef Transform<float, 3u> Transform3df;
+
+// see math.h, the instantiations are in geometry.cc
+#ifdef HEADER_ONLY_TEMPLATES
+#include "geometry.tcc"
+#endif
 
 #endif
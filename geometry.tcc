@@ -1,3 +1,47 @@
+template <class FLOAT, size_t N>
+RayQuery<FLOAT, N>::RayQuery(const Ray<FLOAT,N> &ray, FLOAT t_min, FLOAT t_max)
+  : origin(ray.origin), direction(ray.direction), inverse_direction(ray.direction), t_min(t_min), t_max(t_max)
+{
+  for (size_t i = 0; i < N; i++) {
+    negative[i] = std::signbit(direction[i]) ? 1u : 0u;
+    inverse_direction[i] = static_cast<FLOAT>(1.0) / direction[i]; // +/- INFINITY for +/- 0
+  }
+}
+
+template <class FLOAT, size_t N, size_t SIZE>
+RayPacket<FLOAT, N, SIZE>::RayPacket(const Ray<FLOAT,N> * rays, size_t count)
+  : active(0u), coherent(true)
+{
+  static_assert(SIZE <= 32u, "the lanes of a packet are bits of a 32 bit mask");
+  for (size_t l = 0; l < SIZE; l++) {
+    const Ray<FLOAT,N> & ray = rays[l < count ? l : 0];
+    for (size_t i = 0; i < N; i++) {
+      origin[i][l] = ray.origin[i];
+      direction[i][l] = ray.direction[i];
+      inverse_direction[i][l] = static_cast<FLOAT>(1.0) / ray.direction[i];
+    }
+  }
+  for (size_t i = 0; i < N; i++) {
+    negative[i] = std::signbit(direction[i][0]) ? 1u : 0u;
+  }
+  for (size_t l = 0; l < count && l < SIZE; l++) {
+    active |= 1u << l;
+    for (size_t i = 0; i < N; i++) {
+      coherent = coherent && (std::signbit(direction[i][l]) ? 1u : 0u) == negative[i];
+    }
+  }
+}
+
+template <class FLOAT, size_t N, size_t SIZE>
+Ray<FLOAT,N> RayPacket<FLOAT, N, SIZE>::ray(size_t lane) const {
+  Ray<FLOAT,N> ray = { Vector<FLOAT,N>({}), Vector<FLOAT,N>({}) };
+  for (size_t i = 0; i < N; i++) {
+    ray.origin[i] = origin[i][lane];
+    ray.direction[i] = direction[i][lane];
+  }
+  return ray;
+}
+
 template <class FLOAT, size_t N>
 AxisAlignedBoundingBox<FLOAT, N>::AxisAlignedBoundingBox(Vector<FLOAT,N> center, Vector<FLOAT,N> half_edge_length)
   : center(center), half_edge_length(half_edge_length)
@@ -17,20 +61,81 @@ bool AxisAlignedBoundingBox<FLOAT, N>::intersects(AxisAlignedBoundingBox<FLOAT,N
 
 template <class FLOAT, size_t N>
 bool AxisAlignedBoundingBox<FLOAT, N>::intersects(Ray<FLOAT,N> ray) const {
-    FLOAT tmin;
-    FLOAT tmax;
-    FLOAT tminimum = -INFINITY;
-    FLOAT tmaximum = INFINITY;
-    
+    FLOAT t_entry;
+    return intersects( RayQuery<FLOAT, N>(ray, -INFINITY, INFINITY), t_entry );
+}
+
+
+template <class FLOAT, size_t N>
+bool AxisAlignedBoundingBox<FLOAT, N>::intersects(const Ray<FLOAT,N> &ray, FLOAT t_min, FLOAT t_max) const {
+    FLOAT t_entry;
+    return intersects( RayQuery<FLOAT, N>(ray, t_min, t_max), t_entry );
+}
+
+// slab test: the near (far) plane of each axis is selected by the sign of the ray direction,
+// so that no min/max of the two plane distances is needed
+// for a zero direction component the distances are +/- INFINITY, or NaN (0 * INFINITY) if the origin
+// lies on the plane; NaN fails both comparisons, so the slab does not restrict [t_min, t_max] then
+template <class FLOAT, size_t N>
+bool AxisAlignedBoundingBox<FLOAT, N>::intersects(const RayQuery<FLOAT,N> &query, FLOAT & t_entry) const {
+    FLOAT t_min = query.t_min;
+    FLOAT t_max = query.t_max;
     for (size_t i = 0; i < N; i++) {
-      tmin = (center[i] - ray.origin[i] - half_edge_length[i]) / ray.direction[i];
-      tmax = (center[i] - ray.origin[i] + half_edge_length[i]) / ray.direction[i];
-      tminimum = std::max(tminimum, std::min(tmin, tmax) );
-      tmaximum = std::min(tmaximum, std::max(tmin, tmax) );      
+      FLOAT planes[2] = { center[i] - half_edge_length[i], center[i] + half_edge_length[i] };
+      FLOAT t_near = (planes[query.negative[i]] - query.origin[i]) * query.inverse_direction[i];
+      FLOAT t_far = (planes[1u - query.negative[i]] - query.origin[i]) * query.inverse_direction[i];
+      t_min = t_near > t_min ? t_near : t_min;
+      t_max = t_far < t_max ? t_far : t_max;
+    }
+    t_entry = t_min;
+    return t_min <= t_max;
+}
+
+template <class FLOAT, size_t N>
+AxisAlignedBoundingBox<FLOAT, N> AxisAlignedBoundingBox<FLOAT, N>::merge(AxisAlignedBoundingBox<FLOAT,N> aabb) const {
+  Vector<FLOAT, N> lower = {0.0, }, upper = {0.0, };
+  for (size_t i = 0; i < N; i++) {
+    lower[i] = std::min(center[i] - half_edge_length[i], aabb.center[i] - aabb.half_edge_length[i]);
+    upper[i] = std::max(center[i] + half_edge_length[i], aabb.center[i] + aabb.half_edge_length[i]);
+  }
+  return AxisAlignedBoundingBox<FLOAT, N>( static_cast<FLOAT>(0.5) * (lower + upper), static_cast<FLOAT>(0.5) * (upper - lower) );
+}
+
+// sum of the areas of all 2*N faces, each face spans all axis except one
+template <class FLOAT, size_t N>
+FLOAT AxisAlignedBoundingBox<FLOAT, N>::surface_area() const {
+  FLOAT area = 0.0;
+  for (size_t i = 0; i < N; i++) {
+    FLOAT face = 2.0;
+    for (size_t j = 0; j < N; j++) {
+      if (j != i) {
+        face *= 2.0 * half_edge_length[j];
+      }
     }
-    return tmaximum >= tminimum;
+    area += face;
+  }
+  return area;
 }
 
+template <class FLOAT, size_t N>
+Vector<FLOAT, N> AxisAlignedBoundingBox<FLOAT, N>::get_center() const {
+  return center;
+}
+
+template <class FLOAT, size_t N>
+Vector<FLOAT, N> AxisAlignedBoundingBox<FLOAT, N>::get_half_edge_length() const {
+  return half_edge_length;
+}
+
+template <class FLOAT, size_t N>
+Vector<FLOAT, N> AxisAlignedBoundingBox<FLOAT, N>::get_min() const {
+  return center - half_edge_length;
+}
+
+template <class FLOAT, size_t N>
+Vector<FLOAT, N> AxisAlignedBoundingBox<FLOAT, N>::get_max() const {
+  return center + half_edge_length;
+}
 
 template <class FLOAT, size_t N>
 bool AxisAlignedBoundingBox<FLOAT, N>::intersects(AxisAlignedBoundingBox<FLOAT,N> aabb, Vector<FLOAT, N> direction) const {
@@ -101,6 +206,53 @@ bool Sphere<FLOAT,N>::intersects(const Ray<FLOAT, N> &ray, Intersection_Context<
   if (t <= 0.0) {
     return false;
   }
+  finalize(ray, t, context);
+  return true;
+}
+
+// the near solution is taken if it is within (t_min, t_max), otherwise the far one,
+// e.g. for rays that start inside the sphere
+template <class FLOAT, size_t N>
+bool Sphere<FLOAT,N>::intersects(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t_max) const {
+  Vector<FLOAT,N> om = ray.origin - center;
+  FLOAT  a = ray.direction * ray.direction,
+         b = 2.0 * (om * ray.direction),
+         c = om * om - radius * radius,
+         d = b * b - 4.0 * a * c;
+  if (d < 0) {
+   return false;
+  }
+  d = sqrt(d);
+  FLOAT t = 0.5 * (-b - d) / a;
+  if (t <= t_min) {
+    t = 0.5 * (-b + d) / a;
+  }
+  if (t <= t_min || t >= t_max) {
+    return false;
+  }
+  t_max = t;
+  return true;
+}
+
+// the ray hits the sphere within (t_min, t_max) if one of both solutions is inside this interval
+template <class FLOAT, size_t N>
+bool Sphere<FLOAT,N>::occludes(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max) const {
+  Vector<FLOAT,N> om = ray.origin - center;
+  FLOAT  a = ray.direction * ray.direction,
+         b = 2.0 * (om * ray.direction),
+         c = om * om - radius * radius,
+         d = b * b - 4.0 * a * c;
+  if (d < 0) {
+   return false;
+  }
+  d = sqrt(d);
+  FLOAT t_near = 0.5 * (-b - d) / a,
+        t_far = 0.5 * (-b + d) / a;
+  return (t_near > t_min && t_near < t_max) || (t_far > t_min && t_far < t_max);
+}
+
+template <class FLOAT, size_t N>
+void Sphere<FLOAT,N>::finalize(const Ray<FLOAT, N> &ray, FLOAT t, Intersection_Context<FLOAT, N> & context) const {
   context.t = t;
   context.intersection = ray.origin + t * ray.direction;
   context.normal = context.intersection - center;
@@ -108,12 +260,36 @@ bool Sphere<FLOAT,N>::intersects(const Ray<FLOAT, N> &ray, Intersection_Context<
   if ( inside( ray.origin ) ) {
     context.normal = static_cast<FLOAT>(-1.0) * context.normal; // ray starts inside sphere, normal points to the inside;
   }
-  return true;
+}
+
+template <class FLOAT, size_t N>
+AxisAlignedBoundingBox<FLOAT, N> Sphere<FLOAT,N>::bounding_box() const {
+  return AxisAlignedBoundingBox<FLOAT, N>(center, Vector<FLOAT, N>{radius});
+}
+
+template <class FLOAT, size_t N>
+Vector<FLOAT,N> Sphere<FLOAT,N>::get_center() const {
+  return center;
+}
+
+template <class FLOAT, size_t N>
+FLOAT Sphere<FLOAT,N>::get_radius() const {
+  return radius;
+}
+
+// the right-handed cross product x times y (Vector::cross_product() negates the y component)
+template <class FLOAT, size_t N>
+Vector<FLOAT, N> right_handed_cross_product(Vector<FLOAT, N> x, Vector<FLOAT, N> y) {
+  Vector<FLOAT, N> product = x;
+  product[0] = x[1] * y[2] - x[2] * y[1];
+  product[1] = x[2] * y[0] - x[0] * y[2];
+  product[2] = x[0] * y[1] - x[1] * y[0];
+  return product;
 }
 
 template <class FLOAT, size_t N>
 Triangle<FLOAT, N>::Triangle(Vector<FLOAT, N> a, Vector<FLOAT, N> b, Vector<FLOAT, N> c, Vector<FLOAT, N> na, Vector<FLOAT, N> nb, Vector<FLOAT, N> nc)
- : a(a), b(b), c(c), na(na), nb(nb), nc(nc) { }
+ : a(a), b(b), c(c), na(na), nb(nb), nc(nc), ab(b - a), ac(c - a) { }
 
 
 template <class FLOAT, size_t N>
@@ -122,7 +298,7 @@ Triangle<FLOAT, N>::Triangle(Vector<FLOAT, N> a, Vector<FLOAT, N> b, Vector<FLOA
 
 template <class FLOAT, size_t N>
 Triangle<FLOAT, N>::Triangle(Vector<FLOAT, N> a, Vector<FLOAT, N> b, Vector<FLOAT, N> c)
-  :  Triangle<FLOAT, N>::Triangle(a, b, c, (c - a).cross_product(b - a) ) { }
+  :  Triangle<FLOAT, N>::Triangle(a, b, c, right_handed_cross_product(b - a, c - a) ) { }
 
   
 template <class FLOAT, size_t N>
@@ -133,46 +309,92 @@ bool Triangle<FLOAT, N>::intersects(const Ray<FLOAT, N> &ray, Intersection_Conte
 
 template <class FLOAT, size_t N>
 bool Triangle<FLOAT, N>::intersects(const Ray<FLOAT, N> &ray, Vector<FLOAT, N> & normal, Vector<FLOAT, N> & p, FLOAT & u, FLOAT & v, FLOAT & t) const {
-    const FLOAT EPSILON = 10e-7;
-    normal =  (b-a).cross_product(c-a);  // points away from triangle surface (clockwise order)
+    if ( !intersects(ray, t, u, v) ) {
+      return false;
+    }
+    p = ray.origin + t * ray.direction;
+    normal = interpolate_normal(u, v);
+    return true;
+}
 
-    FLOAT normalRayProduct =  normal * ray.direction;
-    FLOAT area = normal.length(); // used for u-v-parameter calculation
+template <class FLOAT, size_t N>
+bool Triangle<FLOAT, N>::intersects(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t_max, FLOAT & u, FLOAT & v) const {
+  FLOAT t, hit_u, hit_v;
+  if ( !intersects_triangle(ray, a, ab, ac, t, hit_u, hit_v) || t <= t_min || t >= t_max ) {
+    return false;
+  }
+  t_max = t;
+  u = hit_u;
+  v = hit_v;
+  return true;
+}
 
+template <class FLOAT, size_t N>
+bool Triangle<FLOAT, N>::occludes(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max) const {
+  FLOAT t, u, v;
+  return intersects_triangle(ray, a, ab, ac, t, u, v) && t > t_min && t < t_max;
+}
 
-    if ( fabs(normalRayProduct) < EPSILON ) { // backface culling off
-      return false;
-    }
+template <class FLOAT, size_t N>
+void Triangle<FLOAT, N>::finalize(const Ray<FLOAT, N> &ray, FLOAT t, FLOAT u, FLOAT v, Intersection_Context<FLOAT, N> & context) const {
+  context.t = t;
+  context.u = u;
+  context.v = v;
+  context.intersection = ray.origin + t * ray.direction;
+  context.normal = interpolate_normal(u, v);
+}
+
+template <class FLOAT, size_t N>
+bool Triangle<FLOAT, N>::intersects(const Ray<FLOAT, N> &ray, FLOAT & t, FLOAT & u, FLOAT & v) const {
+  return intersects_triangle(ray, a, ab, ac, t, u, v);
+}
 
-    FLOAT d = normal * a;
-    t = (d - normal * ray.origin) / normalRayProduct;
+template <class FLOAT, size_t N>
+Vector<FLOAT, N> Triangle<FLOAT, N>::interpolate_normal(FLOAT u, FLOAT v) const {
+  return u * na + v * nb + (static_cast<FLOAT>(1.0) - u - v) * nc;
+}
 
-    if ( t < 0.0 ) {
+template <class FLOAT, size_t N>
+AxisAlignedBoundingBox<FLOAT, N> Triangle<FLOAT, N>::bounding_box() const {
+  Vector<FLOAT, N> lower = a, upper = a;
+  for (size_t i = 0; i < N; i++) {
+    lower[i] = std::min( {a[i], b[i], c[i]} );
+    upper[i] = std::max( {a[i], b[i], c[i]} );
+  }
+  return AxisAlignedBoundingBox<FLOAT, N>( static_cast<FLOAT>(0.5) * (lower + upper), static_cast<FLOAT>(0.5) * (upper - lower) );
+}
+
+// solves ray.origin + t * ray.direction = a + beta * ab + gamma * ac with cramer's rule,
+// the weights of a and b = a + ab are u = 1 - beta - gamma and v = beta
+template <class FLOAT, size_t N>
+bool intersects_triangle(const Ray<FLOAT, N> &ray, Vector<FLOAT, N> a, Vector<FLOAT, N> ab, Vector<FLOAT, N> ac, FLOAT & t, FLOAT & u, FLOAT & v) {
+    const FLOAT EPSILON = 10e-7;
+    Vector<FLOAT, N> p = right_handed_cross_product(ray.direction, ac);
+    FLOAT determinant = ab * p;
+
+    if ( fabs(determinant) < EPSILON ) { // ray parallel to the triangle, backface culling off
       return false;
     }
-   
-    p = ray.origin + t * ray.direction;
-   
-    Vector<FLOAT, N> vector = (b - a).cross_product(p - a );
-    if ( normal * vector < 0.0 ) { 
+    FLOAT inverse = static_cast<FLOAT>(1.0) / determinant;
+
+    Vector<FLOAT, N> s = ray.origin - a;
+    FLOAT beta = (s * p) * inverse;
+    if ( beta < 0.0 || beta > 1.0 ) {
       return false;
     }
 
-    
-    vector = (c - b).cross_product(p - b );
-    if ( normal * vector < 0.0 ) { 
+    Vector<FLOAT, N> q = right_handed_cross_product(s, ab);
+    FLOAT gamma = (ray.direction * q) * inverse;
+    if ( gamma < 0.0 || beta + gamma > 1.0 ) {
       return false;
     }
 
-    u = vector.length()  / area;
-
-    vector = (a-c).cross_product(p - c );
-    if (normal * vector < 0.0 ) {
+    t = (ac * q) * inverse;
+    if ( t < 0.0 ) {
       return false;
     }
-
-    v = vector.length() / area;
-
+    u = static_cast<FLOAT>(1.0) - beta - gamma;
+    v = beta;
     return true;
 }
 
@@ -209,3 +431,381 @@ bool Sphere<FLOAT, N>::inside(const Vector<FLOAT, N> p) const {
     return distance_squared <= (radius * radius);
 }
 
+template <class FLOAT, size_t N>
+TriangleMesh<FLOAT, N>::TriangleMesh(std::vector<Vector<FLOAT, N>> vertices, std::vector<Indices> triangles,
+                                     std::vector<Vector<FLOAT, N>> normals, std::vector<Vector<FLOAT, 2u>> uvs)
+  : vertices(std::move(vertices)), triangles(std::move(triangles)), normals(std::move(normals)), uvs(std::move(uvs))
+{
+}
+
+template <class FLOAT, size_t N>
+size_t TriangleMesh<FLOAT, N>::size() const {
+  return triangles.size();
+}
+
+template <class FLOAT, size_t N>
+bool TriangleMesh<FLOAT, N>::intersects(size_t triangle, const Ray<FLOAT, N> &ray, FLOAT & t, FLOAT & u, FLOAT & v) const {
+  const Indices & i = triangles[triangle];
+  Vector<FLOAT, N> a = vertices[i[0]];
+  return intersects_triangle(ray, a, vertices[i[1]] - a, vertices[i[2]] - a, t, u, v);
+}
+
+template <class FLOAT, size_t N>
+bool TriangleMesh<FLOAT, N>::intersects(size_t triangle, const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t_max, FLOAT & u, FLOAT & v) const {
+  FLOAT t, hit_u, hit_v;
+  if ( !intersects(triangle, ray, t, hit_u, hit_v) || t <= t_min || t >= t_max ) {
+    return false;
+  }
+  t_max = t;
+  u = hit_u;
+  v = hit_v;
+  return true;
+}
+
+template <class FLOAT, size_t N>
+bool TriangleMesh<FLOAT, N>::occludes(size_t triangle, const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max) const {
+  FLOAT t, u, v;
+  return intersects(triangle, ray, t, u, v) && t > t_min && t < t_max;
+}
+
+template <class FLOAT, size_t N>
+Vector<FLOAT, N> TriangleMesh<FLOAT, N>::normal(size_t triangle, FLOAT u, FLOAT v) const {
+  const Indices & i = triangles[triangle];
+  if (normals.empty()) {
+    Vector<FLOAT, N> a = vertices[i[0]];
+    return right_handed_cross_product(vertices[i[1]] - a, vertices[i[2]] - a);
+  }
+  return u * normals[i[0]] + v * normals[i[1]] + (static_cast<FLOAT>(1.0) - u - v) * normals[i[2]];
+}
+
+template <class FLOAT, size_t N>
+Vector<FLOAT, 2u> TriangleMesh<FLOAT, N>::uv(size_t triangle, FLOAT u, FLOAT v) const {
+  if (uvs.empty()) {
+    return Vector<FLOAT, 2u>{u, v};
+  }
+  const Indices & i = triangles[triangle];
+  return u * uvs[i[0]] + v * uvs[i[1]] + (static_cast<FLOAT>(1.0) - u - v) * uvs[i[2]];
+}
+
+template <class FLOAT, size_t N>
+AxisAlignedBoundingBox<FLOAT, N> TriangleMesh<FLOAT, N>::bounding_box(size_t triangle) const {
+  const Indices & i = triangles[triangle];
+  Vector<FLOAT, N> a = vertices[i[0]], b = vertices[i[1]], c = vertices[i[2]];
+  Vector<FLOAT, N> lower = a, upper = a;
+  for (size_t k = 0; k < N; k++) {
+    lower[k] = std::min( {a[k], b[k], c[k]} );
+    upper[k] = std::max( {a[k], b[k], c[k]} );
+  }
+  return AxisAlignedBoundingBox<FLOAT, N>( static_cast<FLOAT>(0.5) * (lower + upper), static_cast<FLOAT>(0.5) * (upper - lower) );
+}
+
+template <class FLOAT, size_t N>
+const std::vector<Vector<FLOAT, N>> & TriangleMesh<FLOAT, N>::get_vertices() const {
+  return vertices;
+}
+
+template <class FLOAT, size_t N>
+const std::vector<typename TriangleMesh<FLOAT, N>::Indices> & TriangleMesh<FLOAT, N>::get_triangles() const {
+  return triangles;
+}
+
+template <class FLOAT, size_t N>
+const std::vector<Vector<FLOAT, N>> & TriangleMesh<FLOAT, N>::get_normals() const {
+  return normals;
+}
+
+template <class FLOAT, size_t N>
+const std::vector<Vector<FLOAT, 2u>> & TriangleMesh<FLOAT, N>::get_uvs() const {
+  return uvs;
+}
+
+template <class FLOAT, size_t N>
+size_t TriangleMesh<FLOAT, N>::memory_size() const {
+  return vertices.size() * sizeof(Vector<FLOAT, N>) + triangles.size() * sizeof(Indices)
+       + normals.size() * sizeof(Vector<FLOAT, N>) + uvs.size() * sizeof(Vector<FLOAT, 2u>);
+}
+
+
+template <class FLOAT, size_t N>
+Plane<FLOAT, N>::Plane(Vector<FLOAT,N> point, Vector<FLOAT,N> normal)
+  : normal(normal), distance(0.0)
+{
+  this->normal.normalize();
+  distance = this->normal * point;
+}
+
+template <class FLOAT, size_t N>
+bool Plane<FLOAT, N>::intersects(const Ray<FLOAT, N> &ray, Intersection_Context<FLOAT, N> & context) const {
+  FLOAT t = std::numeric_limits<FLOAT>::infinity();
+  if ( !intersects(ray, 0.0, t) ) {
+    return false;
+  }
+  finalize(ray, t, context);
+  return true;
+}
+
+// one division and no square root, rays parallel to the plane give t = +/- INFINITY or NaN and miss
+template <class FLOAT, size_t N>
+bool Plane<FLOAT, N>::intersects(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t_max) const {
+  FLOAT t = (distance - normal * ray.origin) / (normal * ray.direction);
+  if ( !(t > t_min && t < t_max) ) {
+    return false;
+  }
+  t_max = t;
+  return true;
+}
+
+template <class FLOAT, size_t N>
+void Plane<FLOAT, N>::finalize(const Ray<FLOAT, N> &ray, FLOAT t, Intersection_Context<FLOAT, N> & context) const {
+  context.t = t;
+  context.intersection = ray.origin + t * ray.direction;
+  context.normal = normal * ray.direction > 0.0 ? static_cast<FLOAT>(-1.0) * normal : normal;
+}
+
+template <class FLOAT, size_t N>
+bool Plane<FLOAT, N>::occludes(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max) const {
+  FLOAT t = (distance - normal * ray.origin) / (normal * ray.direction);
+  return t > t_min && t < t_max;
+}
+
+template <class FLOAT, size_t N>
+Vector<FLOAT,N> Plane<FLOAT, N>::get_normal() const {
+  return normal;
+}
+
+template <class FLOAT, size_t N>
+FLOAT Plane<FLOAT, N>::get_distance() const {
+  return distance;
+}
+
+
+template <class FLOAT, size_t N>
+Box<FLOAT, N>::Box(Vector<FLOAT,N> lower, Vector<FLOAT,N> upper)
+  : lower(lower), upper(upper)
+{
+}
+
+// NaN values, e.g. 0 * INFINITY for an origin on a face parallel to the ray, are ignored like in the aabb test
+template <class FLOAT, size_t N>
+bool Box<FLOAT, N>::slabs(const Ray<FLOAT, N> &ray, FLOAT & t_near, FLOAT & t_far) const {
+  t_near = -std::numeric_limits<FLOAT>::infinity();
+  t_far = std::numeric_limits<FLOAT>::infinity();
+  for (size_t i = 0; i < N; i++) {
+    FLOAT inverse = static_cast<FLOAT>(1.0) / ray.direction[i];
+    FLOAT t0 = (lower[i] - ray.origin[i]) * inverse,
+          t1 = (upper[i] - ray.origin[i]) * inverse;
+    if (inverse < 0.0) {
+      std::swap(t0, t1);
+    }
+    t_near = t0 > t_near ? t0 : t_near;
+    t_far = t1 < t_far ? t1 : t_far;
+  }
+  return t_near <= t_far;
+}
+
+template <class FLOAT, size_t N>
+bool Box<FLOAT, N>::intersects(const Ray<FLOAT, N> &ray, Intersection_Context<FLOAT, N> & context) const {
+  FLOAT t = std::numeric_limits<FLOAT>::infinity();
+  if ( !intersects(ray, 0.0, t) ) {
+    return false;
+  }
+  finalize(ray, t, context);
+  return true;
+}
+
+// the entry value is taken if it is within (t_min, t_max), otherwise the exit value, e.g. for rays that start inside the box
+template <class FLOAT, size_t N>
+bool Box<FLOAT, N>::intersects(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t_max) const {
+  FLOAT t_near, t_far;
+  if ( !slabs(ray, t_near, t_far) ) {
+    return false;
+  }
+  FLOAT t = t_near > t_min ? t_near : t_far;
+  if (t <= t_min || t >= t_max) {
+    return false;
+  }
+  t_max = t;
+  return true;
+}
+
+// the face that is hit is the one closest to the intersection point, both when entering and when leaving
+// the box the normal of this face pointing to the ray origin is opposite to the direction of the ray
+template <class FLOAT, size_t N>
+void Box<FLOAT, N>::finalize(const Ray<FLOAT, N> &ray, FLOAT t, Intersection_Context<FLOAT, N> & context) const {
+  context.t = t;
+  context.intersection = ray.origin + t * ray.direction;
+  size_t axis = 0;
+  FLOAT closest = std::numeric_limits<FLOAT>::infinity();
+  for (size_t i = 0; i < N; i++) {
+    FLOAT distance = std::min( std::fabs(context.intersection[i] - lower[i]), std::fabs(context.intersection[i] - upper[i]) );
+    if (distance < closest) {
+      closest = distance;
+      axis = i;
+    }
+  }
+  for (size_t i = 0; i < N; i++) {
+    context.normal[i] = 0.0;
+  }
+  context.normal[axis] = ray.direction[axis] > 0.0 ? -1.0 : 1.0;
+}
+
+template <class FLOAT, size_t N>
+bool Box<FLOAT, N>::occludes(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max) const {
+  FLOAT t_near, t_far;
+  return slabs(ray, t_near, t_far) && ( (t_near > t_min && t_near < t_max) || (t_far > t_min && t_far < t_max) );
+}
+
+template <class FLOAT, size_t N>
+AxisAlignedBoundingBox<FLOAT, N> Box<FLOAT, N>::bounding_box() const {
+  return AxisAlignedBoundingBox<FLOAT, N>( static_cast<FLOAT>(0.5) * (lower + upper), static_cast<FLOAT>(0.5) * (upper - lower) );
+}
+
+
+template <class FLOAT, size_t N>
+Transform<FLOAT, N>::Transform()
+  : offset({0.0})
+{
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      a[i][j] = i == j ? 1.0 : 0.0;
+    }
+  }
+}
+
+template <class FLOAT, size_t N>
+Transform<FLOAT, N>::Transform(const std::array<Vector<FLOAT, N>, N> & rows, Vector<FLOAT, N> translation)
+  : offset(translation)
+{
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      a[i][j] = rows[i][j];
+    }
+  }
+}
+
+template <class FLOAT, size_t N>
+Transform<FLOAT, N> Transform<FLOAT, N>::translation(Vector<FLOAT, N> offset) {
+  Transform<FLOAT, N> transform;
+  transform.offset = offset;
+  return transform;
+}
+
+template <class FLOAT, size_t N>
+Transform<FLOAT, N> Transform<FLOAT, N>::scaling(Vector<FLOAT, N> factors) {
+  Transform<FLOAT, N> transform;
+  for (size_t i = 0; i < N; i++) {
+    transform.a[i][i] = factors[i];
+  }
+  return transform;
+}
+
+template <class FLOAT, size_t N>
+Transform<FLOAT, N> Transform<FLOAT, N>::rotation(size_t first, size_t second, FLOAT angle) {
+  Transform<FLOAT, N> transform;
+  FLOAT cos = std::cos(angle), sin = std::sin(angle);
+  transform.a[first][first] = cos;
+  transform.a[first][second] = -sin;
+  transform.a[second][first] = sin;
+  transform.a[second][second] = cos;
+  return transform;
+}
+
+// A1 (A2 x + b2) + b1 = (A1 A2) x + (A1 b2 + b1)
+template <class FLOAT, size_t N>
+Transform<FLOAT, N> Transform<FLOAT, N>::operator*(const Transform<FLOAT, N> & transform) const {
+  Transform<FLOAT, N> product;
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      FLOAT sum = 0.0;
+      for (size_t k = 0; k < N; k++) {
+        sum += a[i][k] * transform.a[k][j];
+      }
+      product.a[i][j] = sum;
+    }
+  }
+  product.offset = point(transform.offset);
+  return product;
+}
+
+// gauss-jordan elimination with partial pivoting on [A | I], the inverse is x -> A^-1 x - A^-1 b
+template <class FLOAT, size_t N>
+Transform<FLOAT, N> Transform<FLOAT, N>::inverse() const {
+  FLOAT m[N][N];
+  std::copy(&a[0][0], &a[0][0] + N * N, &m[0][0]);
+  Transform<FLOAT, N> inverse;
+  for (size_t column = 0; column < N; column++) {
+    size_t pivot = column;
+    for (size_t i = column + 1; i < N; i++) {
+      if (std::fabs(m[i][column]) > std::fabs(m[pivot][column])) {
+        pivot = i;
+      }
+    }
+    for (size_t j = 0; j < N; j++) {
+      std::swap(m[column][j], m[pivot][j]);
+      std::swap(inverse.a[column][j], inverse.a[pivot][j]);
+    }
+    FLOAT scale = static_cast<FLOAT>(1.0) / m[column][column];
+    for (size_t j = 0; j < N; j++) {
+      m[column][j] *= scale;
+      inverse.a[column][j] *= scale;
+    }
+    for (size_t i = 0; i < N; i++) {
+      FLOAT factor = m[i][column];
+      if (i == column || factor == 0.0) {
+        continue;
+      }
+      for (size_t j = 0; j < N; j++) {
+        m[i][j] -= factor * m[column][j];
+        inverse.a[i][j] -= factor * inverse.a[column][j];
+      }
+    }
+  }
+  inverse.offset = static_cast<FLOAT>(-1.0) * inverse.direction(offset);
+  return inverse;
+}
+
+template <class FLOAT, size_t N>
+Vector<FLOAT, N> Transform<FLOAT, N>::point(Vector<FLOAT, N> point) const {
+  return direction(point) + offset;
+}
+
+template <class FLOAT, size_t N>
+Vector<FLOAT, N> Transform<FLOAT, N>::direction(Vector<FLOAT, N> direction) const {
+  Vector<FLOAT, N> result = {0.0};
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      result[i] += a[i][j] * direction[j];
+    }
+  }
+  return result;
+}
+
+template <class FLOAT, size_t N>
+Vector<FLOAT, N> Transform<FLOAT, N>::transposed_direction(Vector<FLOAT, N> direction) const {
+  Vector<FLOAT, N> result = {0.0};
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      result[j] += a[i][j] * direction[i];
+    }
+  }
+  return result;
+}
+
+template <class FLOAT, size_t N>
+Ray<FLOAT, N> Transform<FLOAT, N>::ray(const Ray<FLOAT, N> & ray) const {
+  return Ray<FLOAT, N>{ point(ray.origin), direction(ray.direction) };
+}
+
+// the center is transformed as a point, the half edge length along axis i is the largest
+// extent of the transformed box along i, i.e. sum_j |A_ij| * half_edge_length_j (arvo)
+template <class FLOAT, size_t N>
+AxisAlignedBoundingBox<FLOAT, N> Transform<FLOAT, N>::bounding_box(const AxisAlignedBoundingBox<FLOAT, N> & aabb) const {
+  Vector<FLOAT, N> half_edge_length = aabb.get_half_edge_length(),
+                   extent = {0.0};
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < N; j++) {
+      extent[i] += std::fabs(a[i][j]) * half_edge_length[j];
+    }
+  }
+  return AxisAlignedBoundingBox<FLOAT, N>( point(aabb.get_center()), extent );
+}
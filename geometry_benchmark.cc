@@ -0,0 +1,334 @@
+#include "geometry.h"
+#include "benchmark/benchmark.h"
+#include <random>
+
+// micro benchmarks of the Vector operations and the intersection tests of Sphere, Plane, Box, Triangle and AxisAlignedBoundingBox
+// geometry_benchmark_scalar runs the same benchmarks with MATH_NO_SIMD, i.e. the scalar template code
+// the inputs are random with a fixed seed, so that runs can be compared, e.g. with
+//   geometry_benchmark --benchmark_out=before.json --benchmark_out_format=json
+// or with the target geometry_benchmark_json, which writes geometry_benchmark.json in the build directory
+
+namespace {
+
+const size_t count = 1024u;
+
+std::vector<Vector3df> random_vectors(size_t count, unsigned seed, float min = -1.0f, float max = 1.0f) {
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> value(min, max);
+  std::vector<Vector3df> vectors;
+  for (size_t i = 0; i < count; i++) {
+    vectors.push_back( Vector3df{value(generator), value(generator), value(generator)} );
+  }
+  return vectors;
+}
+
+std::vector<Vector3df> random_directions(size_t count, unsigned seed) {
+  std::vector<Vector3df> directions = random_vectors(count, seed);
+  for (auto & direction : directions) {
+    direction.normalize();
+  }
+  return directions;
+}
+
+void Vector_Add(benchmark::State & state) {
+  std::vector<Vector3df> vectors = random_vectors(count, 42u);
+  size_t i = 0;
+  for (auto _ : state) {
+    Vector3df sum = vectors[i % count] + vectors[(i + 1) % count];
+    benchmark::DoNotOptimize(sum);
+    i++;
+  }
+}
+
+void Vector_Subtract(benchmark::State & state) {
+  std::vector<Vector3df> vectors = random_vectors(count, 42u);
+  size_t i = 0;
+  for (auto _ : state) {
+    Vector3df difference = vectors[i % count] - vectors[(i + 1) % count];
+    benchmark::DoNotOptimize(difference);
+    i++;
+  }
+}
+
+void Vector_Scale(benchmark::State & state) {
+  std::vector<Vector3df> vectors = random_vectors(count, 42u);
+  size_t i = 0;
+  for (auto _ : state) {
+    Vector3df scaled = vectors[i % count][0] * vectors[(i + 1) % count];
+    benchmark::DoNotOptimize(scaled);
+    i++;
+  }
+}
+
+void Vector_ScalarProduct(benchmark::State & state) {
+  std::vector<Vector3df> vectors = random_vectors(count, 42u);
+  size_t i = 0;
+  for (auto _ : state) {
+    float product = vectors[i % count] * vectors[(i + 1) % count];
+    benchmark::DoNotOptimize(product);
+    i++;
+  }
+}
+
+void Vector_CrossProduct(benchmark::State & state) {
+  std::vector<Vector3df> vectors = random_vectors(count, 42u);
+  size_t i = 0;
+  for (auto _ : state) {
+    Vector3df product = vectors[i % count].cross_product(vectors[(i + 1) % count]);
+    benchmark::DoNotOptimize(product);
+    i++;
+  }
+}
+
+void Vector_Length(benchmark::State & state) {
+  std::vector<Vector3df> vectors = random_vectors(count, 42u);
+  size_t i = 0;
+  for (auto _ : state) {
+    float length = vectors[i++ % count].length();
+    benchmark::DoNotOptimize(length);
+  }
+}
+
+void Vector_Normalize(benchmark::State & state) {
+  std::vector<Vector3df> vectors = random_vectors(count, 42u);
+  size_t i = 0;
+  for (auto _ : state) {
+    Vector3df normalized = vectors[i++ % count];
+    normalized.normalize();
+    benchmark::DoNotOptimize(normalized);
+  }
+}
+
+// rays from the origin in random directions, only a few percent hit the sphere
+void Sphere_Intersects(benchmark::State & state) {
+  std::vector<Vector3df> directions = random_vectors(count, 42u);
+  Sphere3df sphere( {0.0, 0.0, -5.0}, 2.0 );
+  Intersection_Context<float, 3u> context;
+  size_t i = 0;
+  for (auto _ : state) {
+    Ray3df ray = { {0.0, 0.0, 0.0}, directions[i++ % count] };
+    benchmark::DoNotOptimize( sphere.intersects(ray, context) );
+  }
+}
+
+// rays from the origin towards random points inside the sphere
+void Sphere_IntersectsHit(benchmark::State & state) {
+  std::vector<Vector3df> targets = random_vectors(count, 43u, -1.0f, 1.0f);
+  Sphere3df sphere( {0.0, 0.0, -5.0}, 2.0 );
+  Intersection_Context<float, 3u> context;
+  std::vector<Ray3df> rays;
+  for (const auto & target : targets) {
+    Vector3df direction = Vector3df{0.0, 0.0, -5.0} + target;
+    direction.normalize();
+    rays.push_back( Ray3df{ {0.0, 0.0, 0.0}, direction } );
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize( sphere.intersects(rays[i++ % count], context) );
+  }
+}
+
+// the same rays with the test that only computes t, as used by the closest hit search
+void Sphere_IntersectsHitDeferred(benchmark::State & state) {
+  std::vector<Vector3df> targets = random_vectors(count, 43u, -1.0f, 1.0f);
+  Sphere3df sphere( {0.0, 0.0, -5.0}, 2.0 );
+  std::vector<Ray3df> rays;
+  for (const auto & target : targets) {
+    Vector3df direction = Vector3df{0.0, 0.0, -5.0} + target;
+    direction.normalize();
+    rays.push_back( Ray3df{ {0.0, 0.0, 0.0}, direction } );
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    float t = INFINITY;
+    benchmark::DoNotOptimize( sphere.intersects(rays[i++ % count], 0.0f, t) );
+    benchmark::DoNotOptimize(t);
+  }
+}
+
+// rays from the origin away from the sphere
+void Sphere_IntersectsMiss(benchmark::State & state) {
+  std::vector<Vector3df> directions = random_directions(count, 44u);
+  Sphere3df sphere( {0.0, 0.0, -5.0}, 2.0 );
+  Intersection_Context<float, 3u> context;
+  std::vector<Ray3df> rays;
+  for (auto direction : directions) {
+    direction[2] = std::abs(direction[2]);
+    rays.push_back( Ray3df{ {0.0, 0.0, 0.0}, direction } );
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize( sphere.intersects(rays[i++ % count], context) );
+  }
+}
+
+// rays from random points inside the sphere in random directions
+void Sphere_IntersectsInside(benchmark::State & state) {
+  std::vector<Vector3df> origins = random_vectors(count, 45u, -1.0f, 1.0f);
+  std::vector<Vector3df> directions = random_directions(count, 46u);
+  Sphere3df sphere( {0.0, 0.0, -5.0}, 2.0 );
+  Intersection_Context<float, 3u> context;
+  std::vector<Ray3df> rays;
+  for (size_t i = 0; i < count; i++) {
+    rays.push_back( Ray3df{ Vector3df{0.0, 0.0, -5.0} + origins[i], directions[i] } );
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize( sphere.intersects(rays[i++ % count], context) );
+  }
+}
+
+// rays from the origin into the half space z < -5, tested against a wall at z = -5 modelled as
+// a sphere with radius 1000 (as the walls of the cornell box used to be), a plane and an axis aligned quad
+std::vector<Ray3df> wall_rays() {
+  std::vector<Vector3df> targets = random_vectors(count, 49u, -4.0f, 4.0f);
+  std::vector<Ray3df> rays;
+  for (const auto & target : targets) {
+    Vector3df direction = { target[0], target[1], -5.0f };
+    direction.normalize();
+    rays.push_back( Ray3df{ {0.0, 0.0, 0.0}, direction } );
+  }
+  return rays;
+}
+
+void WallSphere_IntersectsHit(benchmark::State & state) {
+  std::vector<Ray3df> rays = wall_rays();
+  Sphere3df wall( {0.0, 0.0, -1005.0}, 1000.0 );
+  size_t i = 0;
+  for (auto _ : state) {
+    float t = INFINITY;
+    benchmark::DoNotOptimize( wall.intersects(rays[i++ % count], 0.0f, t) );
+    benchmark::DoNotOptimize(t);
+  }
+}
+
+void Plane_IntersectsHit(benchmark::State & state) {
+  std::vector<Ray3df> rays = wall_rays();
+  Plane3df wall( {0.0, 0.0, -5.0}, {0.0, 0.0, 1.0} );
+  size_t i = 0;
+  for (auto _ : state) {
+    float t = INFINITY;
+    benchmark::DoNotOptimize( wall.intersects(rays[i++ % count], 0.0f, t) );
+    benchmark::DoNotOptimize(t);
+  }
+}
+
+void Box_IntersectsHit(benchmark::State & state) {
+  std::vector<Ray3df> rays = wall_rays();
+  Box3df wall( {-5.0, -5.0, -5.0}, {5.0, 5.0, -5.0} );
+  size_t i = 0;
+  for (auto _ : state) {
+    float t = INFINITY;
+    benchmark::DoNotOptimize( wall.intersects(rays[i++ % count], 0.0f, t) );
+    benchmark::DoNotOptimize(t);
+  }
+}
+
+void Triangle_Intersects(benchmark::State & state) {
+  std::vector<Vector3df> directions = random_vectors(count, 42u);
+  Triangle3df triangle( {-1.0, -1.0, -3.0}, {1.0, -1.0, -3.0}, {0.0, 1.0, -3.0} );
+  Intersection_Context<float, 3u> context;
+  size_t i = 0;
+  for (auto _ : state) {
+    Ray3df ray = { {0.0, 0.0, 0.0}, directions[i++ % count] };
+    benchmark::DoNotOptimize( triangle.intersects(ray, context) );
+  }
+}
+
+// rays from the origin towards random points inside the triangle
+void Triangle_IntersectsHit(benchmark::State & state) {
+  std::vector<Vector3df> weights = random_vectors(count, 50u, 0.0f, 1.0f);
+  Triangle3df triangle( {-1.0, -1.0, -3.0}, {1.0, -1.0, -3.0}, {0.0, 1.0, -3.0} );
+  Intersection_Context<float, 3u> context;
+  std::vector<Ray3df> rays;
+  for (const auto & w : weights) {
+    float sum = w[0] + w[1] + w[2] + 0.001f;
+    Vector3df direction = (w[0] / sum) * Vector3df{-1.0, -1.0, -3.0} + (w[1] / sum) * Vector3df{1.0, -1.0, -3.0} + ((w[2] + 0.001f) / sum) * Vector3df{0.0, 1.0, -3.0};
+    rays.push_back( Ray3df{ {0.0, 0.0, 0.0}, direction } );
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize( triangle.intersects(rays[i++ % count], context) );
+  }
+}
+
+// the same rays with the test that only computes t and the barycentric coordinates
+void Triangle_IntersectsBarycentric(benchmark::State & state) {
+  std::vector<Vector3df> weights = random_vectors(count, 50u, 0.0f, 1.0f);
+  Triangle3df triangle( {-1.0, -1.0, -3.0}, {1.0, -1.0, -3.0}, {0.0, 1.0, -3.0} );
+  std::vector<Ray3df> rays;
+  for (const auto & w : weights) {
+    float sum = w[0] + w[1] + w[2] + 0.001f;
+    Vector3df direction = (w[0] / sum) * Vector3df{-1.0, -1.0, -3.0} + (w[1] / sum) * Vector3df{1.0, -1.0, -3.0} + ((w[2] + 0.001f) / sum) * Vector3df{0.0, 1.0, -3.0};
+    rays.push_back( Ray3df{ {0.0, 0.0, 0.0}, direction } );
+  }
+  size_t i = 0;
+  float t, u, v;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize( triangle.intersects(rays[i++ % count], t, u, v) );
+  }
+}
+
+// rays from the origin in random directions through a box around (0, 0, -5)
+void AABB_IntersectsRay(benchmark::State & state) {
+  std::vector<Vector3df> directions = random_directions(count, 47u);
+  AABB3df box( {0.0, 0.0, -5.0}, {2.0, 2.0, 2.0} );
+  size_t i = 0;
+  for (auto _ : state) {
+    Ray3df ray = { {0.0, 0.0, 0.0}, directions[i++ % count] };
+    benchmark::DoNotOptimize( box.intersects(ray) );
+  }
+}
+
+// the same rays, with the precomputed RayQuery used by the bvh traversal
+void AABB_IntersectsRayQuery(benchmark::State & state) {
+  std::vector<Vector3df> directions = random_directions(count, 47u);
+  AABB3df box( {0.0, 0.0, -5.0}, {2.0, 2.0, 2.0} );
+  std::vector<RayQuery<float, 3u>> queries;
+  for (const auto & direction : directions) {
+    queries.push_back( RayQuery<float, 3u>( Ray3df{ {0.0, 0.0, 0.0}, direction } ) );
+  }
+  size_t i = 0;
+  float t_entry;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize( box.intersects(queries[i++ % count], t_entry) );
+  }
+}
+
+// unit boxes at random positions moving in random directions, tested against a box at the origin
+void AABB_SweepIntersects(benchmark::State & state) {
+  std::vector<Vector3df> positions = random_vectors(count, 48u, -10.0f, 10.0f);
+  std::vector<Vector3df> directions = random_vectors(count, 49u);
+  AABB3df box( {0.0, 0.0, 0.0}, {2.0, 2.0, 2.0} );
+  size_t i = 0;
+  for (auto _ : state) {
+    AABB3df moving( positions[i % count], {0.5, 0.5, 0.5} );
+    Vector3df normal = box.sweep_intersects(moving, directions[i % count]);
+    benchmark::DoNotOptimize(normal);
+    i++;
+  }
+}
+
+}
+
+BENCHMARK(Vector_Add);
+BENCHMARK(Vector_Subtract);
+BENCHMARK(Vector_Scale);
+BENCHMARK(Vector_ScalarProduct);
+BENCHMARK(Vector_CrossProduct);
+BENCHMARK(Vector_Length);
+BENCHMARK(Vector_Normalize);
+BENCHMARK(Sphere_Intersects);
+BENCHMARK(Sphere_IntersectsHit);
+BENCHMARK(Sphere_IntersectsHitDeferred);
+BENCHMARK(Sphere_IntersectsMiss);
+BENCHMARK(Sphere_IntersectsInside);
+BENCHMARK(WallSphere_IntersectsHit);
+BENCHMARK(Plane_IntersectsHit);
+BENCHMARK(Box_IntersectsHit);
+BENCHMARK(Triangle_Intersects);
+BENCHMARK(Triangle_IntersectsHit);
+BENCHMARK(Triangle_IntersectsBarycentric);
+BENCHMARK(AABB_IntersectsRay);
+BENCHMARK(AABB_IntersectsRayQuery);
+BENCHMARK(AABB_SweepIntersects);
@@ -135,6 +135,125 @@ TEST(AABB, SweepIntersects2df_5) {
   EXPECT_NEAR(0.0, normal[1], 0.00001);
 }
 
+TEST(AABB, IntersectsWithRayInInterval_1) {
+  AABB2df box = { {0.0, 0.0}, {1.0, 1.0} };
+  Ray2df ray = { {-3.0, 0.0}, {1.0, 0.0} };
+
+  EXPECT_TRUE( box.intersects(ray, 0.0f, 10.0f) );
+  EXPECT_TRUE( box.intersects(ray, 3.5f, 3.6f) );
+  EXPECT_FALSE( box.intersects(ray, 0.0f, 1.5f) );
+  EXPECT_FALSE( box.intersects(ray, 4.5f, 10.0f) );
+}
+
+TEST(AABB, IntersectsWithRayInInterval_2) {
+  AABB2df box = { {0.0, 0.0}, {1.0, 1.0} };
+  Ray2df ray = { {3.0, 0.0}, {1.0, 0.0} }; // box lies behind the ray origin
+
+  EXPECT_TRUE( box.intersects(ray) );
+  EXPECT_FALSE( box.intersects(ray, 0.0f, INFINITY) );
+}
+
+TEST(AABB, RayQuery3df) {
+  RayQuery<float, 3u> query( Ray3df{ {1.0, 2.0, 3.0}, {2.0, -0.5, 0.0} }, 0.5f, 10.0f );
+
+  EXPECT_NEAR(0.5, query.inverse_direction[0], 0.00001);
+  EXPECT_NEAR(-2.0, query.inverse_direction[1], 0.00001);
+  EXPECT_TRUE(std::isinf(query.inverse_direction[2]));
+  EXPECT_EQ(0u, query.negative[0]);
+  EXPECT_EQ(1u, query.negative[1]);
+  EXPECT_EQ(0u, query.negative[2]);
+  EXPECT_NEAR(0.5, query.t_min, 0.00001);
+  EXPECT_NEAR(10.0, query.t_max, 0.00001);
+}
+
+TEST(AABB, RayPacket3df) {
+  Ray3df rays[] = { { {1.0, 2.0, 3.0}, {2.0, -0.5, 0.0} }, { {0.0, 0.0, 0.0}, {1.0, -1.0, 1.0} }, { {4.0, 5.0, 6.0}, {1.0, -2.0, 0.5} } };
+  RayPacket8_3df packet(rays, 3u);
+
+  EXPECT_EQ(0x7u, packet.active);
+  EXPECT_TRUE(packet.coherent);
+  EXPECT_EQ(0u, packet.negative[0]);
+  EXPECT_EQ(1u, packet.negative[1]);
+  EXPECT_EQ(0u, packet.negative[2]);
+  EXPECT_NEAR(-0.5, packet.inverse_direction[1][2], 0.00001);
+  EXPECT_TRUE(std::isinf(packet.inverse_direction[2][0]));
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_EQ(rays[2].origin[i], packet.ray(2).origin[i]);
+    EXPECT_EQ(rays[2].direction[i], packet.ray(2).direction[i]);
+    EXPECT_EQ(rays[0].direction[i], packet.ray(7).direction[i]); // inactive lanes repeat the first ray
+  }
+
+  rays[1].direction[0] = -1.0f;
+  EXPECT_FALSE( RayPacket8_3df(rays, 3u).coherent );
+  EXPECT_TRUE( RayPacket8_3df(rays, 1u).coherent );
+}
+
+TEST(AABB, IntersectsWithRayQueryEntry) {
+  AABB2df box = { {0.0, 0.0}, {1.0, 1.0} };
+  float t_entry;
+
+  EXPECT_TRUE( box.intersects( RayQuery<float, 2u>( Ray2df{ {-3.0, 0.5}, {2.0, 0.0} } ), t_entry ) );
+  EXPECT_NEAR(1.0, t_entry, 0.00001);
+  EXPECT_TRUE( box.intersects( RayQuery<float, 2u>( Ray2df{ {0.0, 0.0}, {1.0, 1.0} } ), t_entry ) ); // origin inside
+  EXPECT_NEAR(0.0, t_entry, 0.00001);
+  EXPECT_FALSE( box.intersects( RayQuery<float, 2u>( Ray2df{ {-3.0, 0.5}, {1.0, 0.0} }, 0.0f, 1.5f ), t_entry ) );
+}
+
+TEST(AABB, IntersectsWithRayOnSlabPlane) {
+  // the ray runs inside the plane y = 1 of the box border: 0 / 0 must not produce NaN
+  AABB2df box = { {0.0, 0.0}, {1.0, 1.0} };
+  Ray2df ray = { {-3.0, 1.0}, {1.0, 0.0} };
+  float t_entry;
+
+  EXPECT_TRUE( box.intersects(ray) );
+  EXPECT_TRUE( box.intersects(ray, 0.0f, INFINITY) );
+  EXPECT_TRUE( box.intersects( RayQuery<float, 2u>(ray), t_entry ) );
+  EXPECT_NEAR(2.0, t_entry, 0.00001);
+  EXPECT_FALSE( box.intersects( Ray2df{ {-3.0, 1.5}, {1.0, 0.0} }, 0.0f, INFINITY) );
+  EXPECT_FALSE( box.intersects( Ray2df{ {-3.0, 1.0}, {-1.0, -0.0} }, 0.0f, INFINITY) );
+}
+
+TEST(AABB, Merge2df) {
+  AABB2df box1 = { {0.0, 0.0}, {1.0, 1.0} };
+  AABB2df box2 = { {3.0, 0.5}, {1.0, 1.0} };
+
+  AABB2df merged = box1.merge(box2);
+
+  EXPECT_NEAR(-1.0, merged.get_min()[0], 0.00001);
+  EXPECT_NEAR(-1.0, merged.get_min()[1], 0.00001);
+  EXPECT_NEAR(4.0, merged.get_max()[0], 0.00001);
+  EXPECT_NEAR(1.5, merged.get_max()[1], 0.00001);
+}
+
+TEST(AABB, SurfaceArea) {
+  AABB2df box2df = { {0.0, 0.0}, {1.0, 2.0} };
+  AABB3df box3df = { {5.0, 0.0, 0.0}, {1.0, 2.0, 3.0} };
+
+  EXPECT_NEAR(12.0, box2df.surface_area(), 0.00001);
+  EXPECT_NEAR(2.0 * (2.0 * 4.0 + 4.0 * 6.0 + 2.0 * 6.0), box3df.surface_area(), 0.00001);
+}
+
+TEST(AABB, SphereBoundingBox) {
+  Sphere3df sphere = { {1.0, 2.0, 3.0}, 0.5 };
+  AABB3df box = sphere.bounding_box();
+
+  EXPECT_NEAR(0.5, box.get_min()[0], 0.00001);
+  EXPECT_NEAR(1.5, box.get_min()[1], 0.00001);
+  EXPECT_NEAR(3.5, box.get_max()[2], 0.00001);
+}
+
+TEST(AABB, TriangleBoundingBox) {
+  Triangle3df triangle = { {0.0, 0.0, 0.0}, {0.0, 3.0, 1.0}, {3.0, -1.0, 0.0} };
+  AABB3df box = triangle.bounding_box();
+
+  EXPECT_NEAR(0.0, box.get_min()[0], 0.00001);
+  EXPECT_NEAR(-1.0, box.get_min()[1], 0.00001);
+  EXPECT_NEAR(0.0, box.get_min()[2], 0.00001);
+  EXPECT_NEAR(3.0, box.get_max()[0], 0.00001);
+  EXPECT_NEAR(3.0, box.get_max()[1], 0.00001);
+  EXPECT_NEAR(1.0, box.get_max()[2], 0.00001);
+}
+
 /**/
 TEST(SPHERE, Intersects2dfWithSphere_1) {
   Sphere2df sphere1 = { {0.0, 0.0}, 1.0 };
@@ -256,6 +375,50 @@ TEST(SPHERE, Intersects3dfWithRay_7) {
 /**/
 
 /**/ 
+TEST(SPHERE, IntersectsInterval) {
+  Sphere3df sphere = { {0.0, 0.0, -5.0}, 1.0 };
+  Ray3df ray{ {0.0, 0.0, 0.0}, {0.0, 0.0, -1.0} };
+  float t = INFINITY;
+
+  EXPECT_TRUE( sphere.intersects(ray, 0.0f, t) );
+  EXPECT_NEAR(4.0, t, 0.00001);
+
+  t = 3.0f;   // a closer hit was found before
+  EXPECT_FALSE( sphere.intersects(ray, 0.0f, t) );
+  EXPECT_NEAR(3.0, t, 0.00001);
+
+  t = INFINITY;   // the near intersection is before t_min, the far one is taken
+  EXPECT_TRUE( sphere.intersects(ray, 4.5f, t) );
+  EXPECT_NEAR(6.0, t, 0.00001);
+}
+
+TEST(SPHERE, Occludes) {
+  Sphere3df sphere = { {0.0, 0.0, -5.0}, 1.0 };
+  Ray3df ray{ {0.0, 0.0, 0.0}, {0.0, 0.0, -1.0} };
+
+  EXPECT_TRUE( sphere.occludes(ray, 0.0f, INFINITY) );
+  EXPECT_FALSE( sphere.occludes(ray, 0.0f, 3.0f) );   // the light is in front of the sphere
+  EXPECT_TRUE( sphere.occludes(ray, 4.5f, INFINITY) ); // only the far intersection is within the interval
+  EXPECT_FALSE( sphere.occludes(ray, 6.5f, INFINITY) );
+  EXPECT_FALSE( sphere.occludes(Ray3df{ {0.0, 0.0, 0.0}, {0.0, 1.0, 0.0} }, 0.0f, INFINITY) );
+}
+
+TEST(SPHERE, FinalizeEqualsContext) {
+  Sphere3df sphere = { {0.0, 0.0, 0.0}, 1.0 };
+  Ray3df ray{ {-2.0, -3.0, 0.0}, {1.0, 1.0, 0.0} };
+  Intersection_Context<float,3u> expected, context;
+  float t = INFINITY;
+
+  ASSERT_TRUE( sphere.intersects(ray, expected) );
+  ASSERT_TRUE( sphere.intersects(ray, 0.0f, t) );
+  sphere.finalize(ray, t, context);
+  EXPECT_EQ(expected.t, context.t);
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_EQ(expected.intersection[i], context.intersection[i]);
+    EXPECT_EQ(expected.normal[i], context.normal[i]);
+  }
+}
+
 TEST(SPHERE, Inside_1) {
   Sphere3df sphere = { {3.0f, 3.0f, 0.0f}, 3.0f };
   
@@ -268,6 +431,107 @@ TEST(SPHERE, NotInside_1) {
   EXPECT_FALSE( sphere.inside( Vector3df{-0.5f, 0.0f, 0.0f}) );
 }
 /**/
+TEST(PLANE, IntersectsWithContext) {
+  Plane3df plane( {0.0, 2.0, 0.0}, {0.0, -3.0, 0.0} );
+  Ray3df ray{ {1.0, 0.0, 1.0}, {0.0, 1.0, 1.0} };
+  Intersection_Context<float,3u> context;
+
+  EXPECT_NEAR(-2.0, plane.get_distance(), 0.00001);
+  ASSERT_TRUE( plane.intersects(ray, context) );
+  EXPECT_NEAR(2.0, context.t, 0.00001);
+  EXPECT_NEAR(1.0, context.intersection[0], 0.00001);
+  EXPECT_NEAR(2.0, context.intersection[1], 0.00001);
+  EXPECT_NEAR(3.0, context.intersection[2], 0.00001);
+  EXPECT_NEAR(0.0, context.normal[0], 0.00001);
+  EXPECT_NEAR(-1.0, context.normal[1], 0.00001);
+  EXPECT_NEAR(0.0, context.normal[2], 0.00001);
+}
+
+TEST(PLANE, NormalFacesRayOrigin) {
+  Plane3df plane( {0.0, 2.0, 0.0}, {0.0, -1.0, 0.0} );
+  Ray3df ray{ {0.0, 4.0, 0.0}, {0.0, -1.0, 0.0} };
+  Intersection_Context<float,3u> context;
+
+  ASSERT_TRUE( plane.intersects(ray, context) );
+  EXPECT_NEAR(2.0, context.t, 0.00001);
+  EXPECT_NEAR(1.0, context.normal[1], 0.00001);
+}
+
+TEST(PLANE, MissesParallelAndBehind) {
+  Plane3df plane( {0.0, 2.0, 0.0}, {0.0, 1.0, 0.0} );
+  Intersection_Context<float,3u> context;
+
+  EXPECT_FALSE( plane.intersects(Ray3df{ {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0} }, context) );
+  EXPECT_FALSE( plane.intersects(Ray3df{ {0.0, 2.0, 0.0}, {1.0, 0.0, 0.0} }, context) );
+  EXPECT_FALSE( plane.intersects(Ray3df{ {0.0, 0.0, 0.0}, {0.0, -1.0, 0.0} }, context) );
+}
+
+TEST(PLANE, IntersectsIntervalAndOccludes) {
+  Plane3df plane( {0.0, 0.0, -5.0}, {0.0, 0.0, 1.0} );
+  Ray3df ray{ {0.0, 0.0, 0.0}, {0.0, 0.0, -1.0} };
+  float t = 4.0f;
+
+  EXPECT_FALSE( plane.intersects(ray, 0.0f, t) );
+  EXPECT_FALSE( plane.occludes(ray, 0.0f, 4.0f) );
+  EXPECT_TRUE( plane.occludes(ray, 0.0f, 6.0f) );
+  t = INFINITY;
+  EXPECT_TRUE( plane.intersects(ray, 0.0f, t) );
+  EXPECT_NEAR(5.0, t, 0.00001);
+}
+
+TEST(BOX, IntersectsFromOutside) {
+  Box3df box( {-1.0, -1.0, -6.0}, {1.0, 1.0, -4.0} );
+  Ray3df ray{ {0.5, 0.0, 0.0}, {0.0, 0.0, -1.0} };
+  Intersection_Context<float,3u> context;
+
+  ASSERT_TRUE( box.intersects(ray, context) );
+  EXPECT_NEAR(4.0, context.t, 0.00001);
+  EXPECT_NEAR(0.5, context.intersection[0], 0.00001);
+  EXPECT_NEAR(-4.0, context.intersection[2], 0.00001);
+  EXPECT_NEAR(0.0, context.normal[0], 0.00001);
+  EXPECT_NEAR(0.0, context.normal[1], 0.00001);
+  EXPECT_NEAR(1.0, context.normal[2], 0.00001);
+}
+
+TEST(BOX, IntersectsFromInside) {
+  Box3df box( {-1.0, -1.0, -1.0}, {1.0, 1.0, 1.0} );
+  Ray3df ray{ {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0} };
+  Intersection_Context<float,3u> context;
+
+  ASSERT_TRUE( box.intersects(ray, context) );
+  EXPECT_NEAR(1.0, context.t, 0.00001);
+  EXPECT_NEAR(-1.0, context.normal[0], 0.00001); // points to the inside like the normal of a sphere
+}
+
+TEST(BOX, QuadAndParallelRays) {
+  Box3df quad( {-2.0, 0.0, -2.0}, {2.0, 2.0, -2.0} );
+  Intersection_Context<float,3u> context;
+
+  ASSERT_TRUE( quad.intersects(Ray3df{ {0.0, 1.0, 5.0}, {0.0, 0.0, -1.0} }, context) );
+  EXPECT_NEAR(7.0, context.t, 0.00001);
+  EXPECT_NEAR(1.0, context.normal[2], 0.00001);
+  ASSERT_TRUE( quad.intersects(Ray3df{ {0.0, 1.0, -5.0}, {0.0, 0.0, 1.0} }, context) );
+  EXPECT_NEAR(-1.0, context.normal[2], 0.00001);   // a quad is hit from both sides
+  EXPECT_FALSE( quad.intersects(Ray3df{ {0.0, 3.0, 5.0}, {0.0, 0.0, -1.0} }, context) );
+  EXPECT_FALSE( quad.intersects(Ray3df{ {0.0, 1.0, 0.0}, {1.0, 0.0, 0.0} }, context) );
+}
+
+TEST(BOX, IntersectsIntervalAndOccludes) {
+  Box3df box( {-1.0, -1.0, -6.0}, {1.0, 1.0, -4.0} );
+  Ray3df ray{ {0.0, 0.0, 0.0}, {0.0, 0.0, -1.0} };
+  float t = INFINITY;
+
+  EXPECT_TRUE( box.intersects(ray, 4.5f, t) ); // the entry is before t_min, the exit is taken
+  EXPECT_NEAR(6.0, t, 0.00001);
+  EXPECT_FALSE( box.occludes(ray, 0.0f, 3.0f) );
+  EXPECT_TRUE( box.occludes(ray, 4.5f, 7.0f) );
+  EXPECT_FALSE( box.occludes(ray, 6.5f, INFINITY) );
+
+  AABB3df aabb = box.bounding_box();
+  EXPECT_NEAR(-5.0, aabb.get_center()[2], 0.00001);
+  EXPECT_NEAR(1.0, aabb.get_half_edge_length()[0], 0.00001);
+}
+
 TEST(TRIANGLE, Intersects3dfWithRay_1) {
   Triangle3df triangle = { {0.0, 0.0, 0.0}, {0.0, 3.0, 0.0},{3.0, 0.0, 0.0}  };
   Ray3df ray{ {0.0, 0.0, 2.0}, {0.0, 0.0, -1.0} };
@@ -416,6 +680,181 @@ TEST(TRIANGLE, Intersects3dfWithRay_10) {
   EXPECT_TRUE(triangle1.intersects(ray, normal, intersection, u, v, t) );
 }
 
+TEST(TRIANGLE, IntersectsTiltedTriangle) {
+  Triangle3df triangle = { {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0} };
+  Ray3df ray{ {0.0, 0.0, 0.0}, {1.0, 1.0, 1.0} };
+  float t, u, v;
+
+  EXPECT_TRUE( triangle.intersects(ray, t, u, v) );
+  EXPECT_NEAR(1.0 / 3.0, t, 0.00001);
+  EXPECT_NEAR(1.0 / 3.0, u, 0.00001);
+  EXPECT_NEAR(1.0 / 3.0, v, 0.00001);
+}
+
+TEST(TRIANGLE, BarycentricCoordinates) {
+  Triangle3df triangle = { {0.0, 0.0, 0.0}, {0.0, 3.0, 0.0}, {3.0, 0.0, 0.0} };
+  Ray3df ray{ {0.0, 1.5, 2.0}, {0.0, 0.0, -1.0} };
+  float t, u, v;
+
+  EXPECT_TRUE( triangle.intersects(ray, t, u, v) );
+  EXPECT_NEAR(2.0, t, 0.00001);
+  EXPECT_NEAR(0.5, u, 0.00001);
+  EXPECT_NEAR(0.5, v, 0.00001);
+}
+
+TEST(TRIANGLE, MissesOutsideParallelAndBehind) {
+  Triangle3df triangle = { {0.0, 0.0, 0.0}, {0.0, 3.0, 0.0}, {3.0, 0.0, 0.0} };
+  float t, u, v;
+
+  EXPECT_FALSE( triangle.intersects(Ray3df{ {2.0, 2.0, 2.0}, {0.0, 0.0, -1.0} }, t, u, v) );
+  EXPECT_FALSE( triangle.intersects(Ray3df{ {1.0, 1.0, 2.0}, {1.0, 0.0, 0.0} }, t, u, v) );
+  EXPECT_FALSE( triangle.intersects(Ray3df{ {1.0, 1.0, 2.0}, {0.0, 0.0, 1.0} }, t, u, v) );
+}
+
+TEST(TRIANGLE, IntersectsIntervalAndFinalize) {
+  Triangle3df triangle = { {0.0, 0.0, 0.0}, {0.0, 3.0, 0.0}, {3.0, 0.0, 0.0} };
+  Ray3df ray{ {1.0, 1.0, 2.0}, {0.0, 0.0, -1.0} };
+  Intersection_Context<float,3u> expected, context;
+  float t = 1.5f, u, v;
+
+  EXPECT_FALSE( triangle.intersects(ray, 0.0f, t, u, v) );
+  t = INFINITY;
+  ASSERT_TRUE( triangle.intersects(ray, 0.0f, t, u, v) );
+  EXPECT_NEAR(2.0, t, 0.00001);
+
+  ASSERT_TRUE( triangle.intersects(ray, expected) );
+  triangle.finalize(ray, t, u, v, context);
+  EXPECT_EQ(expected.u, context.u);
+  EXPECT_EQ(expected.v, context.v);
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_EQ(expected.intersection[i], context.intersection[i]);
+    EXPECT_EQ(expected.normal[i], context.normal[i]);
+  }
+}
+
+TEST(TRIANGLE, Occludes) {
+  Triangle3df triangle = { {0.0, 0.0, 0.0}, {0.0, 3.0, 0.0}, {3.0, 0.0, 0.0} };
+  Ray3df ray{ {1.0, 1.0, 2.0}, {0.0, 0.0, -1.0} };
+
+  EXPECT_TRUE( triangle.occludes(ray, 0.0f, INFINITY) );
+  EXPECT_FALSE( triangle.occludes(ray, 0.0f, 1.5f) );
+  EXPECT_FALSE( triangle.occludes(ray, 2.5f, INFINITY) );
+  EXPECT_FALSE( triangle.occludes(Ray3df{ {4.0, 4.0, 2.0}, {0.0, 0.0, -1.0} }, 0.0f, INFINITY) );
+}
+
+TEST(TRIANGLE, InterpolateNormal) {
+  Triangle3df triangle = { {0.0, 0.0, 0.0}, {0.0, 3.0, 0.0}, {3.0, 0.0, 0.0}, {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0} };
+  Vector3df normal = triangle.interpolate_normal(0.25, 0.5);
+
+  EXPECT_NEAR(0.25, normal[0], 0.00001);
+  EXPECT_NEAR(0.5, normal[1], 0.00001);
+  EXPECT_NEAR(0.25, normal[2], 0.00001);
+}
+
+// a square of two triangles in the plane z = 0 with the shared edge (1, 0, 0) - (0, 1, 0)
+TriangleMesh3df square_mesh(std::vector<Vector3df> normals = {}, std::vector<Vector2df> uvs = {}) {
+  return TriangleMesh3df( { {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {1.0, 1.0, 0.0} },
+                          { {0u, 1u, 2u}, {2u, 1u, 3u} }, normals, uvs );
+}
+
+TEST(TRIANGLE_MESH, IntersectsSharedVertices) {
+  TriangleMesh3df mesh = square_mesh();
+  Ray3df ray{ {0.75, 0.75, 2.0}, {0.0, 0.0, -1.0} };
+  float t, u, v;
+
+  ASSERT_EQ(2u, mesh.size());
+  EXPECT_FALSE( mesh.intersects(0u, ray, t, u, v) );
+  EXPECT_TRUE( mesh.intersects(1u, ray, t, u, v) );
+  EXPECT_NEAR(2.0, t, 0.00001);
+  EXPECT_NEAR(0.25, u, 0.00001); // weight of vertex 2
+  EXPECT_NEAR(0.25, v, 0.00001); // weight of vertex 1
+}
+
+TEST(TRIANGLE_MESH, Occludes) {
+  TriangleMesh3df mesh = square_mesh();
+  Ray3df ray{ {0.75, 0.75, 2.0}, {0.0, 0.0, -1.0} };
+
+  EXPECT_FALSE( mesh.occludes(0u, ray, 0.0f, INFINITY) );
+  EXPECT_TRUE( mesh.occludes(1u, ray, 0.0f, INFINITY) );
+  EXPECT_FALSE( mesh.occludes(1u, ray, 0.0f, 2.0f) );
+}
+
+TEST(TRIANGLE_MESH, FaceNormal) {
+  TriangleMesh3df mesh = square_mesh();
+  Vector3df normal = mesh.normal(0u, 0.2, 0.3);
+
+  EXPECT_NEAR(0.0, normal[0], 0.00001);
+  EXPECT_NEAR(0.0, normal[1], 0.00001);
+  EXPECT_NEAR(1.0, normal[2], 0.00001);
+}
+
+// ein Dreieck und ein TriangleMesh aus denselben Eckpunkten haben am selben Schnittpunkt dieselbe Normale
+TEST(TRIANGLE_MESH, NormalMatchesTriangle) {
+  Vector3df a = {1.0, 0.0, 0.0}, b = {0.0, 2.0, 0.0}, c = {0.0, 0.0, 3.0};
+  Triangle3df triangle(a, b, c);
+  TriangleMesh3df mesh( {a, b, c}, { {0u, 1u, 2u} } );
+  Ray3df ray{ {1.0, 1.0, 1.0}, {-1.0, -1.0, -1.0} };
+  Intersection_Context<float,3u> context;
+  float t, u, v;
+
+  ASSERT_TRUE( triangle.intersects(ray, context) );
+  ASSERT_TRUE( mesh.intersects(0u, ray, t, u, v) );
+  Vector3df normal = mesh.normal(0u, u, v);
+  EXPECT_NEAR(6.0, normal[0], 0.00001); // (b - a) x (c - a)
+  EXPECT_NEAR(3.0, normal[1], 0.00001);
+  EXPECT_NEAR(2.0, normal[2], 0.00001);
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_NEAR(normal[i], context.normal[i], 0.00001);
+  }
+}
+
+TEST(TRIANGLE_MESH, InterpolatedNormalAndUV) {
+  TriangleMesh3df mesh = square_mesh( { {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}, {0.0, 0.0, 1.0} },
+                                      { {0.0, 0.0}, {1.0, 0.0}, {0.0, 1.0}, {1.0, 1.0} } );
+  Vector3df normal = mesh.normal(0u, 0.5, 0.25);
+  Vector2df uv = mesh.uv(0u, 0.5, 0.25);
+
+  EXPECT_NEAR(0.5, normal[0], 0.00001);
+  EXPECT_NEAR(0.25, normal[1], 0.00001);
+  EXPECT_NEAR(0.25, normal[2], 0.00001);
+  EXPECT_NEAR(0.25, uv[0], 0.00001);
+  EXPECT_NEAR(0.25, uv[1], 0.00001);
+}
+
+TEST(TRIANGLE_MESH, BoundingBox) {
+  AABB3df box = square_mesh().bounding_box(1u);
+
+  EXPECT_NEAR(0.0, box.get_min()[0], 0.00001);
+  EXPECT_NEAR(0.0, box.get_min()[1], 0.00001);
+  EXPECT_NEAR(1.0, box.get_max()[0], 0.00001);
+  EXPECT_NEAR(1.0, box.get_max()[1], 0.00001);
+}
+
+TEST(TRIANGLE_MESH, MemoryPerTriangle) {
+  // a grid of 100 x 100 squares with normals and uvs
+  const uint32_t n = 100u;
+  std::vector<Vector3df> vertices, normals;
+  std::vector<Vector2df> uvs;
+  std::vector<TriangleMesh3df::Indices> triangles;
+  for (uint32_t y = 0; y <= n; y++) {
+    for (uint32_t x = 0; x <= n; x++) {
+      vertices.push_back( Vector3df{static_cast<float>(x), static_cast<float>(y), 0.0f} );
+      normals.push_back( Vector3df{0.0f, 0.0f, 1.0f} );
+      uvs.push_back( Vector2df{static_cast<float>(x) / n, static_cast<float>(y) / n} );
+    }
+  }
+  for (uint32_t y = 0; y < n; y++) {
+    for (uint32_t x = 0; x < n; x++) {
+      uint32_t i = y * (n + 1) + x;
+      triangles.push_back( {i, i + 1, i + n + 1} );
+      triangles.push_back( {i + n + 1, i + 1, i + n + 2} );
+    }
+  }
+  TriangleMesh3df mesh(vertices, triangles, normals, uvs);
+
+  EXPECT_LT(3.0 * mesh.memory_size() / mesh.size(), sizeof(Triangle3df));
+}
+
 TEST(FRESNEL, Refract_1) {
   Vector3df eye = {0.0f, 0.0f, 0.0f};
   Vector3df direction = {0.0f, -1.0f, 0.0f};
@@ -487,4 +926,74 @@ TEST(SPHERE, InsidePoint_4) {
   EXPECT_TRUE(sphere.inside(point));
 }
 
+TEST(TRANSFORM, IdentityAndTranslation) {
+  Vector3df p = {1.0f, -2.0f, 3.0f};
+  Vector3df q = Transform3df().point(p);
+  Vector3df r = Transform3df::translation({1.0f, 2.0f, 3.0f}).point(p);
+  Vector3df d = Transform3df::translation({1.0f, 2.0f, 3.0f}).direction(p);
+
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_FLOAT_EQ(p[i], q[i]);
+    EXPECT_FLOAT_EQ(p[i], d[i]);
+  }
+  EXPECT_FLOAT_EQ(2.0f, r[0]);
+  EXPECT_FLOAT_EQ(0.0f, r[1]);
+  EXPECT_FLOAT_EQ(6.0f, r[2]);
+}
+
+TEST(TRANSFORM, RotationAndComposition) {
+  // rotates x towards y by 90 degrees, then moves by (0, 0, 1)
+  Transform3df transform = Transform3df::translation({0.0f, 0.0f, 1.0f}) * Transform3df::rotation(0, 1, static_cast<float>(PI / 2.0));
+  Vector3df p = transform.point({1.0f, 0.0f, 0.0f});
+
+  EXPECT_NEAR(0.0f, p[0], 0.00001f);
+  EXPECT_NEAR(1.0f, p[1], 0.00001f);
+  EXPECT_NEAR(1.0f, p[2], 0.00001f);
+}
+
+TEST(TRANSFORM, Inverse) {
+  Transform3df transform = Transform3df::translation({1.0f, -2.0f, 0.5f}) * Transform3df::rotation(1, 2, 0.7f)
+                         * Transform3df::scaling({2.0f, 0.5f, 3.0f}) * Transform3df::rotation(0, 2, -1.3f);
+  Transform3df inverse = transform.inverse();
+  Vector3df p = {0.3f, -4.0f, 2.5f};
+  Vector3df q = inverse.point(transform.point(p));
+  Vector3df r = (transform * inverse).point(p);
+
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_NEAR(p[i], q[i], 0.0001f);
+    EXPECT_NEAR(p[i], r[i], 0.0001f);
+  }
+}
+
+// the object space ray hits the sphere at the same t as the world space ray hits the transformed sphere,
+// the normal transformed with the inverse transpose is the world space normal
+TEST(TRANSFORM, RayAndNormal) {
+  Transform3df transform = Transform3df::translation({5.0f, 0.0f, 0.0f}) * Transform3df::scaling({2.0f, 2.0f, 2.0f});
+  Transform3df inverse = transform.inverse();
+  Sphere3df object( {0.0f, 0.0f, 0.0f}, 1.0f ), world( {5.0f, 0.0f, 0.0f}, 2.0f );
+  Ray3df ray = { {5.0f, 0.0f, -10.0f}, {0.0f, 0.0f, 1.0f} };
+
+  float t_object = INFINITY, t_world = INFINITY;
+  ASSERT_TRUE(object.intersects(inverse.ray(ray), 0.0f, t_object));
+  ASSERT_TRUE(world.intersects(ray, 0.0f, t_world));
+  EXPECT_NEAR(t_world, t_object, 0.0001f);
+
+  Vector3df normal = inverse.transposed_direction({0.0f, 0.0f, -1.0f});
+  normal.normalize();
+  EXPECT_NEAR(-1.0f, normal[2], 0.00001f);
+}
+
+TEST(TRANSFORM, BoundingBox) {
+  AABB3df box( {1.0f, 0.0f, 0.0f}, {1.0f, 0.5f, 0.25f} );
+  AABB3df rotated = (Transform3df::translation({0.0f, 0.0f, 2.0f}) * Transform3df::rotation(0, 1, static_cast<float>(PI / 2.0))).bounding_box(box);
+
+  EXPECT_NEAR(0.0f, rotated.get_center()[0], 0.00001f);
+  EXPECT_NEAR(1.0f, rotated.get_center()[1], 0.00001f);
+  EXPECT_NEAR(2.0f, rotated.get_center()[2], 0.00001f);
+  EXPECT_NEAR(0.5f, rotated.get_half_edge_length()[0], 0.00001f);
+  EXPECT_NEAR(1.0f, rotated.get_half_edge_length()[1], 0.00001f);
+  EXPECT_NEAR(0.25f, rotated.get_half_edge_length()[2], 0.00001f);
+}
+
+
 }
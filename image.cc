@@ -0,0 +1,39 @@
+#include "image.h"
+#include <bit>
+#include <cassert>
+#include <sstream>
+
+ImageWriter::ImageWriter(const std::string & filename, Format format, size_t width, size_t height)
+  : file(filename, std::ios::binary), format(format), width(width), height(height)
+{
+  std::ostringstream header;
+  if (format == Format::P6) {
+    header << "P6\n" << width << " " << height << "\n255\n";
+  } else {
+    // the sign of the scale is the byte order of the floats, negative for little endian
+    header << "PF\n" << width << " " << height << (std::endian::native == std::endian::little ? "\n-1.0\n" : "\n1.0\n");
+  }
+  file << header.str();
+  header_size = static_cast<std::streamoff>(header.str().size());
+}
+
+bool ImageWriter::good() const {
+  return file.good();
+}
+
+void ImageWriter::write_rows(size_t first_row, const RGB8 * pixels, size_t rows) {
+  assert(format == Format::P6 && first_row + rows <= height);
+  std::streamoff row_size = static_cast<std::streamoff>(width * sizeof(RGB8));
+  file.seekp(header_size + static_cast<std::streamoff>(first_row) * row_size);
+  file.write(reinterpret_cast<const char *>(pixels), rows * row_size);
+}
+
+void ImageWriter::write_rows(size_t first_row, const float * rgb, size_t rows) {
+  assert(format == Format::PFM && first_row + rows <= height);
+  // the rows are stored bottom to top, so consecutive rows are written in reverse order
+  std::streamoff row_size = static_cast<std::streamoff>(3u * width * sizeof(float));
+  for (size_t i = 0; i < rows; i++) {
+    file.seekp(header_size + static_cast<std::streamoff>(height - 1 - first_row - i) * row_size);
+    file.write(reinterpret_cast<const char *>(rgb + 3u * width * i), row_size);
+  }
+}
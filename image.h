@@ -0,0 +1,56 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// contains a writer for binary portable pixmaps (P6, 8 bit per channel) and
+// portable float maps (PFM, 32 bit float per channel) that writes rows in large blocks.
+
+
+// a pixel of an 8 bit framebuffer, 3 bytes without padding as in a P6 file
+struct RGB8 {
+  uint8_t r, g, b;
+};
+
+static_assert(sizeof(RGB8) == 3u);
+
+
+/*
+ the header is written by the constructor, the rows can then be written in any order
+ and in parts, e.g. each row of tiles as soon as it is rendered, so that the whole image
+ does not need to be in memory:
+
+   | header | row 0 | row 1 | ... | row height - 1 |    P6, top to bottom
+   | header | row height - 1 | ... | row 1 | row 0 |    PFM, bottom to top, native byte order
+
+ row 0 is the top row of the image in both formats
+*/
+class ImageWriter {
+public:
+  enum class Format { P6, PFM };
+
+  // creates the file and writes the header, check good() for errors
+  ImageWriter(const std::string & filename, Format format, size_t width, size_t height);
+
+  // returns false if the file could not be opened or written
+  bool good() const;
+
+  // writes rows [first_row, first_row + rows) of a P6 image, pixels holds width * rows pixels
+  void write_rows(size_t first_row, const RGB8 * pixels, size_t rows);
+
+  // writes rows [first_row, first_row + rows) of a PFM image, rgb holds 3 * width * rows values
+  void write_rows(size_t first_row, const float * rgb, size_t rows);
+
+private:
+  std::ofstream file;
+  Format format;
+  size_t width, height;
+  std::streamoff header_size;
+};
+
+
+#endif
@@ -0,0 +1,79 @@
+#include "image.h"
+#include "benchmark/benchmark.h"
+#include <cstdio>
+#include <vector>
+
+// writes square images with an edge length of up to 16k pixels
+// P3_Write is the former ASCII output of Screen::saveAsPPM() with three ints per pixel,
+// P6_Write writes a whole RGB8 framebuffer at once and P6_Stream / PFM_Stream write bands of 16 rows,
+// as if each band was rendered before it is written. the files are created in the working directory.
+
+namespace {
+
+const char * filename = "image_benchmark.out";
+const size_t band = 16u;
+
+void P3_Write(benchmark::State & state) {
+  struct Pixel {
+    int r, g, b;
+  };
+  size_t size = state.range(0);
+  std::vector<Pixel> pixels(size * size, {255, 128, 0});
+
+  for (auto _ : state) {
+    std::ofstream file(filename);
+    file << "P3\n" << size << " " << size << "\n255\n";
+    for (const auto & pixel : pixels) {
+      file << pixel.r << " " << pixel.g << " " << pixel.b << "\n";
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * size * size * 3);
+  std::remove(filename);
+}
+
+void P6_Write(benchmark::State & state) {
+  size_t size = state.range(0);
+  std::vector<RGB8> pixels(size * size, {255, 128, 0});
+
+  for (auto _ : state) {
+    ImageWriter writer(filename, ImageWriter::Format::P6, size, size);
+    writer.write_rows(0u, pixels.data(), size);
+  }
+  state.SetBytesProcessed(state.iterations() * size * size * 3);
+  std::remove(filename);
+}
+
+void P6_Stream(benchmark::State & state) {
+  size_t size = state.range(0);
+  std::vector<RGB8> pixels(size * band, {255, 128, 0});
+
+  for (auto _ : state) {
+    ImageWriter writer(filename, ImageWriter::Format::P6, size, size);
+    for (size_t top = 0; top < size; top += band) {
+      writer.write_rows(top, pixels.data(), std::min(band, size - top));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * size * size * 3);
+  std::remove(filename);
+}
+
+void PFM_Stream(benchmark::State & state) {
+  size_t size = state.range(0);
+  std::vector<float> rgb(3 * size * band, 0.5f);
+
+  for (auto _ : state) {
+    ImageWriter writer(filename, ImageWriter::Format::PFM, size, size);
+    for (size_t top = 0; top < size; top += band) {
+      writer.write_rows(top, rgb.data(), std::min(band, size - top));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * size * size * 3 * sizeof(float));
+  std::remove(filename);
+}
+
+}
+
+BENCHMARK(P3_Write)->RangeMultiplier(4)->Range(1 << 10, 1 << 14)->Unit(benchmark::kMillisecond)->Iterations(1);
+BENCHMARK(P6_Write)->RangeMultiplier(4)->Range(1 << 10, 1 << 14)->Unit(benchmark::kMillisecond)->Iterations(1);
+BENCHMARK(P6_Stream)->RangeMultiplier(4)->Range(1 << 10, 1 << 14)->Unit(benchmark::kMillisecond)->Iterations(1);
+BENCHMARK(PFM_Stream)->RangeMultiplier(4)->Range(1 << 10, 1 << 14)->Unit(benchmark::kMillisecond)->Iterations(1);
@@ -0,0 +1,81 @@
+#include "image.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+std::string read_file(const std::string & filename) {
+  std::ifstream file(filename, std::ios::binary);
+  return std::string( std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() );
+}
+
+TEST(IMAGE, RGB8Layout) {
+  RGB8 pixels[2] = { {1, 2, 3}, {4, 5, 6} };
+
+  EXPECT_EQ(6u, sizeof(pixels));
+  EXPECT_EQ(4, reinterpret_cast<const uint8_t *>(pixels)[3]);
+}
+
+TEST(IMAGE, P6) {
+  std::string filename = "image_test_p6.ppm";
+  std::vector<RGB8> pixels = { {255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {10, 20, 30}, {40, 50, 60}, {70, 80, 90} };
+  {
+    ImageWriter writer(filename, ImageWriter::Format::P6, 3u, 2u);
+    writer.write_rows(0u, pixels.data(), 2u);
+    EXPECT_TRUE(writer.good());
+  }
+
+  std::string header = "P6\n3 2\n255\n";
+  std::string content = read_file(filename);
+  ASSERT_EQ(header.size() + 18u, content.size());
+  EXPECT_EQ(header, content.substr(0, header.size()));
+  EXPECT_EQ(0, std::memcmp(pixels.data(), content.data() + header.size(), 18u));
+  std::remove(filename.c_str());
+}
+
+TEST(IMAGE, RowsInAnyOrder) {
+  std::string filename = "image_test_rows.ppm";
+  std::vector<RGB8> rows = { {1, 1, 1}, {2, 2, 2}, {3, 3, 3}, {4, 4, 4} };
+  {
+    ImageWriter writer(filename, ImageWriter::Format::P6, 2u, 2u);
+    writer.write_rows(1u, rows.data() + 2, 1u);
+    writer.write_rows(0u, rows.data(), 1u);
+    EXPECT_TRUE(writer.good());
+  }
+
+  std::string content = read_file(filename);
+  std::string header = "P6\n2 2\n255\n";
+  ASSERT_EQ(header.size() + 12u, content.size());
+  EXPECT_EQ(0, std::memcmp(rows.data(), content.data() + header.size(), 12u));
+  std::remove(filename.c_str());
+}
+
+TEST(IMAGE, PFMBottomToTop) {
+  std::string filename = "image_test.pfm";
+  std::vector<float> top = { 0.0f, 0.25f, 0.5f }, bottom = { 1.0f, 2.0f, 3.0f };
+  {
+    ImageWriter writer(filename, ImageWriter::Format::PFM, 1u, 2u);
+    writer.write_rows(0u, top.data(), 1u);
+    writer.write_rows(1u, bottom.data(), 1u);
+    EXPECT_TRUE(writer.good());
+  }
+
+  std::string content = read_file(filename);
+  std::string header = "PF\n1 2\n-1.0\n";
+  ASSERT_EQ(header.size() + 24u, content.size());
+  EXPECT_EQ(header, content.substr(0, header.size()));
+  EXPECT_EQ(0, std::memcmp(bottom.data(), content.data() + header.size(), 12u));
+  EXPECT_EQ(0, std::memcmp(top.data(), content.data() + header.size() + 12u, 12u));
+  std::remove(filename.c_str());
+}
+
+TEST(IMAGE, InvalidFilename) {
+  ImageWriter writer("no_such_directory/image.ppm", ImageWriter::Format::P6, 1u, 1u);
+
+  EXPECT_FALSE(writer.good());
+}
+
+}
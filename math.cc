@@ -1,5 +1,7 @@
 #include "math.h"
+#ifndef HEADER_ONLY_TEMPLATES
 #include "math.tcc"
+#endif
 
 // contains template instantiations for the 2-, 3- and 4-dimensional cases
 //   to create pre-compiled object files
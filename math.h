@@ -96,4 +96,14 @@ typedef Vector<float, 2u> Vector2df;
 typedef Vector<float, 3u> Vector3df;
 typedef Vector<float, 4u> Vector4df;
 
+// no padding, e.g. for the vertex arrays of a TriangleMesh; the SSE code in math.tcc loads and stores the
+// components explicitly and does not need aligned Vectors
+static_assert(sizeof(Vector3df) == 12u && sizeof(Vector4df) == 16u);
+
+// with HEADER_ONLY_TEMPLATES the definitions are visible in every translation unit and can be inlined,
+// otherwise they are compiled once with the instantiations in math.cc
+#ifdef HEADER_ONLY_TEMPLATES
+#include "math.tcc"
+#endif
+
 #endif
@@ -1,5 +1,51 @@
 #include <cassert>
 
+#if defined(__SSE2__) && !defined(MATH_NO_SIMD)
+#include <immintrin.h>
+#include <type_traits>
+
+// SSE implementation of the Vector operations for Vector<float, 3u> and Vector<float, 4u>
+// a Vector<float, 3u> only has three floats, load() sets the fourth lane to zero and store() ignores it
+namespace sse {
+
+template <class FLOAT_TYPE, size_t N>
+constexpr bool packed = std::is_same_v<FLOAT_TYPE, float> && (N == 3u || N == 4u);
+
+// the components are set individually instead of using _mm_load_ps, so that the compiler can
+// take them from registers: Vectors passed by value arrive in two registers with two floats each
+// and a 16 byte load of their two 8 byte spills would stall on store forwarding
+template <size_t N>
+inline __m128 load(const Vector<float, N> & v) {
+  return _mm_setr_ps(v.vector[0], v.vector[1], v.vector[2], N == 4u ? v.vector[N - 1] : 0.0f);
+}
+
+// only the N components are written, Vectors are not aligned to 16 bytes
+template <size_t N>
+inline void store(Vector<float, N> & v, __m128 value) {
+  if constexpr (N == 4u) {
+    _mm_storeu_ps(v.vector.data(), value);
+  } else {
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, value);
+    for (size_t i = 0; i < N; i++) {
+      v.vector[i] = lanes[i];
+    }
+  }
+}
+
+// adds the four lanes in the same order as the scalar loop: ((v0 + v1) + v2) + v3
+inline float sum(__m128 v) {
+  __m128 high = _mm_movehl_ps(v, v);
+  __m128 sum = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 2, 1)));
+  sum = _mm_add_ss(sum, high);
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(high, high, _MM_SHUFFLE(3, 2, 1, 1)));
+  return _mm_cvtss_f32(sum);
+}
+
+}
+#define MATH_SSE
+#endif
+
 template <class FLOAT_TYPE, size_t N>
 Vector<FLOAT_TYPE, N>::Vector( std::initializer_list<FLOAT_TYPE> values ) {
   auto iterator = values.begin();
@@ -19,6 +65,12 @@ Vector<FLOAT_TYPE, N>::Vector(FLOAT_TYPE angle ) {
 
 template <class FLOAT_TYPE, size_t N>  
 Vector<FLOAT_TYPE, N> & Vector<FLOAT_TYPE, N>::operator+=(const Vector<FLOAT_TYPE, N> addend) {
+#ifdef MATH_SSE
+  if constexpr (sse::packed<FLOAT_TYPE, N>) {
+    sse::store(*this, _mm_add_ps(sse::load(*this), sse::load(addend)));
+    return *this;
+  }
+#endif
   for (size_t i = 0u; i < N; i++) {
     vector[i] += addend.vector[i];
   }
@@ -27,6 +79,12 @@ Vector<FLOAT_TYPE, N> & Vector<FLOAT_TYPE, N>::operator+=(const Vector<FLOAT_TYP
 
 template <class FLOAT_TYPE, size_t N>  
 Vector<FLOAT_TYPE, N> & Vector<FLOAT_TYPE, N>::operator-=(const Vector<FLOAT_TYPE, N> minuend) {
+#ifdef MATH_SSE
+  if constexpr (sse::packed<FLOAT_TYPE, N>) {
+    sse::store(*this, _mm_sub_ps(sse::load(*this), sse::load(minuend)));
+    return *this;
+  }
+#endif
   for (size_t i = 0u; i < N; i++) {
     vector[i] -= minuend.vector[i];
   }
@@ -35,6 +93,12 @@ Vector<FLOAT_TYPE, N> & Vector<FLOAT_TYPE, N>::operator-=(const Vector<FLOAT_TYP
 
 template <class FLOAT_TYPE, size_t N>  
 Vector<FLOAT_TYPE, N> & Vector<FLOAT_TYPE, N>::operator*=(const FLOAT_TYPE factor) {
+#ifdef MATH_SSE
+  if constexpr (sse::packed<FLOAT_TYPE, N>) {
+    sse::store(*this, _mm_mul_ps(sse::load(*this), _mm_set1_ps(factor)));
+    return *this;
+  }
+#endif
   for (size_t i = 0u; i < N; i++) {
     vector[i] *= factor;
   }
@@ -43,6 +107,12 @@ Vector<FLOAT_TYPE, N> & Vector<FLOAT_TYPE, N>::operator*=(const FLOAT_TYPE facto
 
 template <class FLOAT_TYPE, size_t N>  
 Vector<FLOAT_TYPE, N> & Vector<FLOAT_TYPE, N>::operator/=(const FLOAT_TYPE factor) {
+#ifdef MATH_SSE
+  if constexpr (sse::packed<FLOAT_TYPE, N>) {
+    sse::store(*this, _mm_div_ps(sse::load(*this), _mm_set1_ps(factor)));
+    return *this;
+  }
+#endif
   for (size_t i = 0u; i < N; i++) {
     vector[i] /= factor;
   }
@@ -87,6 +157,19 @@ FLOAT_TYPE Vector<FLOAT_TYPE, N>::operator[](std::size_t i) const {
 template <class FLOAT_TYPE, size_t N>
 Vector<FLOAT_TYPE, 3u> Vector<FLOAT_TYPE, N>::cross_product(const Vector<FLOAT_TYPE, 3u> v) const {
   assert(N >= 3u);
+#ifdef MATH_SSE
+  if constexpr (sse::packed<FLOAT_TYPE, N> && N == 3u) {
+    __m128 a = sse::load(*this),
+           b = sse::load(v);
+    __m128 a_yxx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 0, 1)),
+           a_zzy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 2, 2)),
+           b_yxx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 0, 1)),
+           b_zzy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 2, 2));
+    Vector<FLOAT_TYPE, 3u> product = v;
+    sse::store(product, _mm_sub_ps(_mm_mul_ps(a_yxx, b_zzy), _mm_mul_ps(a_zzy, b_yxx)));
+    return product;
+  }
+#endif
   return {this->vector[1] * v.vector[2] - this->vector[2] * v.vector[1],
           this->vector[0] * v.vector[2] - this->vector[2] * v.vector[0],
           this->vector[0] * v.vector[1] - this->vector[1] * v.vector[0] };
@@ -104,6 +187,12 @@ FLOAT_TYPE Vector<FLOAT_TYPE, N>::length() const {
 // Quadrat der Laenge
 template <class FLOAT_TYPE, size_t N>
 FLOAT_TYPE Vector<FLOAT_TYPE, N>::square_of_length() const {
+#ifdef MATH_SSE
+    if constexpr (sse::packed<FLOAT_TYPE, N>) {
+      __m128 value = sse::load(*this);
+      return sse::sum(_mm_mul_ps(value, value));
+    }
+#endif
     FLOAT_TYPE sum = 0;
     for (size_t i = 0u; i < N; i++) { //0u um implizierten cast zu vermeiden
         sum += vector[i] * vector[i];
@@ -114,6 +203,11 @@ FLOAT_TYPE Vector<FLOAT_TYPE, N>::square_of_length() const {
 // Skalarprodukt
 template <class F, size_t K>
 F operator*(const Vector<F, K> vector1, const Vector<F, K> vector2) {
+#ifdef MATH_SSE
+    if constexpr (sse::packed<F, K>) {
+      return sse::sum(_mm_mul_ps(sse::load(vector1), sse::load(vector2)));
+    }
+#endif
     F result = 0;
     for (size_t i = 0u; i < K; i++) {
         result += vector1.vector[i] * vector2.vector[i];
@@ -447,5 +447,42 @@ TEST(VECTOR, ScalarProduct3df2) {
   
   EXPECT_NEAR(32.0, result, 0.00001);
 }
+
+// Vector3df hat keine Füllbytes, die SSE-Operationen schreiben nicht in den folgenden Vektor eines Arrays
+TEST(VECTOR, Packed3df) {
+  Vector3df vectors[2] = { {1.0, 2.0, 3.0}, {4.0, 5.0, 6.0} };
+
+  EXPECT_EQ(3 * sizeof(float), reinterpret_cast<char *>(&vectors[1]) - reinterpret_cast<char *>(&vectors[0]));
+  vectors[0] += vectors[1];
+  vectors[0] *= 2.0f;
+  EXPECT_NEAR(10.0, vectors[0][0], 0.00001);
+  EXPECT_NEAR(14.0, vectors[0][1], 0.00001);
+  EXPECT_NEAR(18.0, vectors[0][2], 0.00001);
+  EXPECT_NEAR(4.0, vectors[1][0], 0.00001);
+  EXPECT_NEAR(5.0, vectors[1][1], 0.00001);
+  EXPECT_NEAR(6.0, vectors[1][2], 0.00001);
+  Vector3df cross = vectors[1].cross_product(vectors[1]);
+  EXPECT_NEAR(0.0, cross[0], 0.00001);
+  EXPECT_NEAR(0.0, cross[1], 0.00001);
+  EXPECT_NEAR(0.0, cross[2], 0.00001);
+}
+
+// Testet die Rechenoperationen für 4D-Vektoren
+TEST(VECTOR, Arithmetic4df) {
+  Vector4df vector1 = {1.0, 2.0, 3.0, 4.0};
+  Vector4df vector2 = {0.5, -1.0, 2.0, -4.0};
+
+  Vector4df sum = vector1 + vector2;
+  Vector4df difference = vector1 - vector2;
+  vector1 /= 2.0f;
+
+  EXPECT_NEAR(1.5, sum[0], 0.00001);
+  EXPECT_NEAR(0.0, sum[3], 0.00001);
+  EXPECT_NEAR(0.5, difference[0], 0.00001);
+  EXPECT_NEAR(8.0, difference[3], 0.00001);
+  EXPECT_NEAR(0.5, vector1[0], 0.00001);
+  EXPECT_NEAR(2.0, vector1[3], 0.00001);
+  EXPECT_NEAR(-5.75, vector1 * vector2, 0.00001);
+}
 }
 
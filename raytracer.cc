@@ -1,18 +1,30 @@
 #include "math.h"
 #include "geometry.h"
+#include "bvh.h"
+#include "wide_bvh.h"
+#include "thread_pool.h"
+#include "image.h"
 #include <iostream>
 #include <vector>
 #include <algorithm>
-#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <variant>
 
 // Die folgenden Kommentare beschreiben Datenstrukturen und Funktionen
 // Die Datenstrukturen und Funktionen die weiter hinten im Text beschrieben sind,
 // hängen höchstens von den vorhergehenden Datenstrukturen ab, aber nicht umgekehrt.
 
 // Ein "Bildschirm", der das Setzen eines Pixels kapselt
-// Der Bildschirm hat eine Auflösung (Breite x Höhe)
-// Kann zur Ausgabe einer PPM-Datei verwendet werden oder
+// Der Bildschirm hat eine Auflösung (Breite x Höhe) und speichert 3 Byte pro Pixel (RGB8).
+// Kann zur Ausgabe einer binären PPM-Datei (P6) verwendet werden oder
 // mit SDL2 implementiert werden.
+// Für sehr große Bilder kann der Bildschirm auch nur einen Streifen des Bildes enthalten,
+// der mit writeRows() an seine Position in der Datei geschrieben wird.
 class Screen {
   public:
     int width, height;
@@ -21,27 +33,24 @@ class Screen {
     }
     void setPixel(int x, int y, int r,  int g, int b) {
       if (x < 0 || x >= width || y < 0 || y >= height) return; 
-      pixels[y * width + x] = {r, g, b};
+      pixels[y * width + x] = {static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b)};
   }
-    void saveAsPPM(const std::string& filename) {
-      std::ofstream file(filename);
-      if (!file) {
-        std::cerr << "Error opening file for writing: " << filename << std::endl;
+    void saveAsPPM(const std::string& filename) const {
+      ImageWriter writer(filename, ImageWriter::Format::P6, width, height);
+      writeRows(writer, 0, height);
+      if (!writer.good()) {
+        std::cerr << "Error writing file: " << filename << std::endl;
         return;
       }
-      file << "P3\n" << width << " " << height << "\n255\n";
-      for (const auto& pixel : pixels) {
-        file << pixel.r << " " << pixel.g << " " << pixel.b << "\n";
-      }
-      file.close();
       std::cout << "Image saved as " << filename << "\n";
     }
+    // schreibt die ersten rows Zeilen als Zeilen [top, top + rows) des Bildes
+    void writeRows(ImageWriter& writer, int top, int rows) const {
+      writer.write_rows(top, pixels.data(), rows);
+    }
 
   private:
-    struct Pixel {
-      int r, g, b;
-    };
-    std::vector<Pixel> pixels;
+    std::vector<RGB8> pixels;
   };
 
 // Eine "Kamera", die von einem Augenpunkt aus in eine Richtung senkrecht auf ein Rechteck (das Bild) zeigt.
@@ -101,37 +110,89 @@ struct Color {
 };
 
 // Das "Material" der Objektoberfläche mit ambienten, diffusem und reflektiven Farbanteil.
+// isReflective und isDiffuse werden einmal im Konstruktor berechnet, damit shade() nicht für jeden Treffer
+// die Farbanteile prüft: ohne diffusen Anteil wird kein Schattenstrahl benötigt, ohne Reflexion kein Spiegelstrahl.
 struct Material {
   Vector3df ambient;
   Vector3df diffuse;
   Vector3df reflective;
+  bool isReflective;  // ein Farbanteil der Reflexion ist größer als 0.01 (minThroughput)
+  bool isDiffuse;     // ein diffuser Farbanteil ist nicht 0
   Material(Vector3df ambient, Vector3df diffuse, Vector3df reflective)
-    : ambient(ambient), diffuse(diffuse), reflective(reflective) {}
+    : ambient(ambient), diffuse(diffuse), reflective(reflective),
+      isReflective(reflective[0] > 0.01f || reflective[1] > 0.01f || reflective[2] > 0.01f),
+      isDiffuse(diffuse[0] != 0.0f || diffuse[1] != 0.0f || diffuse[2] != 0.0f) {}
+
+  bool operator==(const Material& other) const {
+    for (int i = 0; i < 3; ++i) {
+      if (ambient[i] != other.ambient[i] || diffuse[i] != other.diffuse[i] || reflective[i] != other.reflective[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
 };
 
+// Objekte und Netze speichern nur den Index ihres Materials in der MaterialTable der Szene,
+// so bleiben die beim Schnitttest durchsuchten Arrays klein.
+typedef uint16_t MaterialId;
+
+// Sichtbarkeit eines Objekts für die verschiedenen Strahlarten, als Bitmaske der BVH (LinearBVH3df::Mask).
+// Ein Objekt wird von einem Strahl nur getroffen, wenn es das Bit der Strahlart gesetzt hat.
+namespace Visibility {
+  constexpr LinearBVH3df::Mask Camera = 1;      // Primärstrahlen
+  constexpr LinearBVH3df::Mask Shadow = 2;      // wirft Schatten
+  constexpr LinearBVH3df::Mask Reflection = 4;  // in Spiegelungen sichtbar
+  constexpr LinearBVH3df::Mask All = Camera | Shadow | Reflection;
+}
+
 // Ein "Objekt", z.B. eine Kugel oder ein Dreieck, und dem zugehörigen Material der Oberfläche.
-// Im Prinzip ein Wrapper-Objekt, das mindestens Material und geometrisches Objekt zusammenfasst.
-// Kugel und Dreieck finden Sie in geometry.h/tcc
+// Im Prinzip ein Wrapper-Objekt, das den Index des Materials und das geometrische Objekt zusammenfasst.
+// Kugel, Ebene, Quader und Dreieck finden Sie in geometry.h/tcc
+// Ein Objekt ist eine Kugel, eine unendliche Ebene (z.B. eine Wand) oder ein achsenparalleler Quader,
+// der mit Kantenlänge 0 in einer Achse ein Rechteck ist. Alle Formen haben dieselben Schnitttests.
 class Object {
   public:
-      Object(const Material& material, const Sphere<float, 3>& sphere)
-          : material(material), sphere(sphere) {}
+      typedef std::variant<Sphere3df, Plane3df, Box3df> Shape;
+
+      Object(MaterialId material, const Shape& shape, LinearBVH3df::Mask visibility = Visibility::All)
+          : shape(shape), material(material), visibility(visibility) {}
+
+      // Schnitttest ohne Normale für die Suche nach dem nächsten Schnittpunkt mit tMin < t < tMax,
+      // tMax wird auf t gesetzt, die Normale berechnet danach finalize() nur für den nächsten Schnittpunkt
+      bool intersect(const Ray3df& ray, float tMin, float& tMax) const {
+          return std::visit([&](const auto& s) { return s.intersects(ray, tMin, tMax); }, shape);
+      }
+
+      // Schattentest: wird das Objekt irgendwo mit tMin < t < tMax getroffen?
+      bool occludes(const Ray3df& ray, float tMin, float tMax) const {
+          return std::visit([&](const auto& s) { return s.occludes(ray, tMin, tMax); }, shape);
+      }
 
-      bool intersect(const Ray3df& ray, float& t, Vector3df& normal) const {
+      Vector3df finalize(const Ray3df& ray, float t) const {
           Intersection_Context<float, 3> ctx;
-          if (sphere.intersects(ray, ctx)) {
-              t = ctx.t;
-              normal = ctx.normal;
-              return true;
+          std::visit([&](const auto& s) { s.finalize(ray, t, ctx); }, shape);
+          return ctx.normal;
+      }
+
+      MaterialId getMaterial() const { return material; }
+
+      // Ebenen haben keinen Hüllquader und kommen nicht in die BVH
+      bool isBounded() const { return !std::holds_alternative<Plane3df>(shape); }
+
+      AABB3df getBoundingBox() const {
+          if (const Sphere3df* sphere = std::get_if<Sphere3df>(&shape)) {
+              return sphere->bounding_box();
           }
-          return false;
+          return std::get<Box3df>(shape).bounding_box();
       }
-  
-      const Material& getMaterial() const { return material; }
+
+      LinearBVH3df::Mask getVisibility() const { return visibility; }
   
   private:
-      Material material;
-      Sphere<float, 3> sphere;
+      Shape shape;
+      MaterialId material;
+      LinearBVH3df::Mask visibility;
   };
 // verschiedene Materialdefinition, z.B. Mattes Schwarz, Mattes Rot, Reflektierendes Weiss, ...
 // im wesentlichen Variablen, die mit Konstruktoraufrufen initialisiert werden.
@@ -176,13 +237,321 @@ struct Materials {
   }
 };
 
+// Tabelle aller Materialien einer Szene, add() liefert den Index eines Materials, gleiche Materialien
+// werden nur einmal gespeichert.
+class MaterialTable {
+  public:
+    MaterialId add(const Material& material) {
+      auto found = std::find(materials.begin(), materials.end(), material);
+      if (found != materials.end()) {
+        return static_cast<MaterialId>(found - materials.begin());
+      }
+      materials.push_back(material);
+      return static_cast<MaterialId>(materials.size() - 1);
+    }
+
+    const Material& operator[](MaterialId id) const { return materials[id]; }
+
+    size_t size() const { return materials.size(); }
+
+  private:
+    std::vector<Material> materials;
+};
+
 // Die folgenden Werte zur konkreten Objekten, Lichtquellen und Funktionen, wie Lambertian-Shading
 // oder die Suche nach einem Sehstrahl für das dem Augenpunkt am nächsten liegenden Objekte,
 // können auch zusammen in eine Datenstruktur für die gesammte zu
 // rendernde "Szene" zusammengefasst werden.
 
+// Ein Dreiecksnetz mit gemeinsamen Eckpunkten und einem Material für alle Dreiecke.
+// Die Eckpunkte liegen im Objektraum des Netzes, in die Szene kommt es über Instanzen.
+struct Mesh {
+  MaterialId material;
+  TriangleMesh3df triangles;
+  LinearBVH3df::Mask visibility = Visibility::All;
+};
+
+// Eine Kopie eines Netzes in der Szene: die affine Abbildung transform bringt die Eckpunkte des Netzes
+// aus dem Objektraum in die Welt. Die Dreiecke und ihre BVH gibt es nur einmal pro Netz, so dass tausende
+// Kopien nur je eine Abbildung kosten und beim Bewegen nur die obere BVH neu aufgebaut werden muss.
+struct Instance {
+  uint32_t mesh;  // Index des Netzes in Scene::meshes
+  Transform3df transform;
+};
+
 // Die Cornelbox aufgebaut aus den Objekten
 // Am besten verwendet man hier einen std::vector< ... > von Objekten.
+// Die Szene hält zusätzlich eine Bounding Volume Hierarchy über die Hüllquader der Objekte,
+// damit die Suche nach dem nächsten Schnittpunkt nicht alle Objekte testen muss.
+// Die BVH wird nach dem Aufbau in ein Array mit 32-Byte-Knoten umgewandelt.
+// Die Indizes der BVH sind zuerst die Kugeln und Quader (objects), danach folgen die Instanzen der Netze.
+// Ebenen haben keinen Hüllquader, sie werden vor der BVH einzeln getestet und haben die Indizes danach.
+// Die BVH speichert die Sichtbarkeit jedes Primitivs, unsichtbare Teilbäume werden beim Traversieren übersprungen.
+// Zweistufig: jedes Netz hat eine eigene BVH über seine Dreiecke im Objektraum. Trifft ein Strahl den Hüllquader
+// einer Instanz in der oberen BVH, wird er mit der inversen Abbildung in den Objektraum gebracht und dort
+// mit der BVH des Netzes geschnitten. Da die Richtung nicht normiert wird, bleibt t in beiden Räumen gleich.
+// Mit einem Cache-Verzeichnis wird jede BVH unter dem Hash ihrer Hüllquader als Datei abgelegt. Beim nächsten Start
+// mit derselben Geometrie wird die Datei nur eingeblendet (mmap), statt die BVH neu zu bauen.
+// Mit wide wird zusätzlich eine BVH mit vier Kindern pro Knoten gebaut, die closestHit() und occluded() statt der
+// binären BVH traversieren. Sie kennt keine Sichtbarkeit, die Strahlart wird deshalb erst pro Primitiv geprüft.
+// Die Pakete (closestHits()) verwenden immer die binäre BVH.
+struct Scene {
+  // Treffer in Instanzen haben den Index instanceHit | Instanz << 32 | Dreieck, damit normal() und material()
+  // das getroffene Dreieck kennen
+  static constexpr size_t instanceHit = size_t(1) << 63;
+
+  struct Placement {
+    uint32_t mesh;
+    Transform3df toWorld, toObject;
+  };
+
+  MaterialTable materials;
+  std::vector<Object> objects; // Objekte mit Hüllquader (Kugeln, Quader) in der BVH
+  std::vector<Mesh> meshes;
+  std::vector<LinearBVH3df> meshBvhs; // BVH über die Dreiecke jedes Netzes im Objektraum
+  std::vector<Placement> instances;   // Instanzen der Netze, Indizes ab objects.size()
+  std::vector<Object> planes;  // unbeschränkte Objekte (Ebenen), werden linear getestet, Indizes ab firstPlane()
+  LinearBVH3df bvh;
+  std::optional<WideBVH4_3df> wideBvh; // nur mit wide, über dieselben Primitive wie bvh
+
+  // ohne Instanzen wird jedes Netz einmal unverändert in die Szene gesetzt, ohne cache wird nichts gespeichert
+  Scene(const MaterialTable& materials, const std::vector<Object>& objects, const std::vector<Mesh>& meshes = {},
+        const std::vector<Instance>& instances = {}, const std::string& cache = "", bool wide = false)
+    : materials(materials), objects(select(objects, true)), meshes(meshes), meshBvhs(buildMeshBvhs(meshes, cache)),
+      instances(place(meshes, instances)), planes(select(objects, false)),
+      bvh(buildBvh(boundingBoxes(), visibilities(), cache)),
+      wideBvh(wide ? std::optional<WideBVH4_3df>(BVH3df(boundingBoxes(), bvhLeafSize, 1u, bvhBuilder)) : std::nullopt) {}
+
+  static std::vector<Object> select(const std::vector<Object>& objects, bool bounded) {
+    std::vector<Object> selected;
+    std::copy_if(objects.begin(), objects.end(), std::back_inserter(selected),
+                 [&](const Object& object) { return object.isBounded() == bounded; });
+    return selected;
+  }
+
+  // Einstellungen, mit denen alle BVHs gebaut werden. Sie gehen mit bvhVersion in den Schlüssel des Caches ein,
+  // bvhVersion wird bei jeder anderen Änderung am Aufbau erhöht, damit alte Dateien nicht mehr geladen werden.
+  static constexpr size_t bvhLeafSize = 4;
+  static constexpr BVH3df::Builder bvhBuilder = BVH3df::Builder::sah;
+  static constexpr uint64_t bvhVersion = 1;
+
+  static uint64_t cacheSeed() {
+    return bvhVersion << 48 | uint64_t(LinearBVH3df::cache_version) << 32 | uint64_t(sizeof(LinearBVH3df::Node)) << 16 |
+           uint64_t(bvhBuilder) << 8 | uint64_t(bvhLeafSize);
+  }
+
+  // die Datei heißt nach dem Schlüssel, so dass verschiedene Szenen dasselbe Verzeichnis verwenden können
+  static LinearBVH3df buildBvh(const std::vector<AABB3df>& boxes, const std::vector<LinearBVH3df::Mask>& masks,
+                               const std::string& cache) {
+    if (cache.empty()) {
+      return LinearBVH3df(BVH3df(boxes, bvhLeafSize, 1u, bvhBuilder), masks);
+    }
+    uint64_t key = LinearBVH3df::hash(boxes, masks, cacheSeed());
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bvh", static_cast<unsigned long long>(key));
+    std::string path = (std::filesystem::path(cache) / name).string();
+    if (std::optional<LinearBVH3df> cached = LinearBVH3df::load(path, key, boxes.size())) {
+      return std::move(*cached);
+    }
+    LinearBVH3df bvh(BVH3df(boxes, bvhLeafSize, 1u, bvhBuilder), masks);
+    if (!bvh.save(path, key)) {
+      std::cerr << "Error writing BVH cache: " << path << std::endl;
+    }
+    return bvh;
+  }
+
+  static std::vector<LinearBVH3df> buildMeshBvhs(const std::vector<Mesh>& meshes, const std::string& cache) {
+    std::vector<LinearBVH3df> bvhs;
+    for (const auto& mesh : meshes) {
+      std::vector<AABB3df> boxes;
+      for (size_t k = 0; k < mesh.triangles.size(); k++) {
+        boxes.push_back(mesh.triangles.bounding_box(k));
+      }
+      bvhs.push_back(buildBvh(boxes, {}, cache));
+    }
+    return bvhs;
+  }
+
+  // leere Netze haben keinen Hüllquader und werden weggelassen
+  static std::vector<Placement> place(const std::vector<Mesh>& meshes, const std::vector<Instance>& instances) {
+    std::vector<Placement> placements;
+    if (instances.empty()) {
+      for (uint32_t m = 0; m < meshes.size(); m++) {
+        if (meshes[m].triangles.size() > 0) {
+          placements.push_back({m, Transform3df(), Transform3df()});
+        }
+      }
+    }
+    for (const auto& instance : instances) {
+      if (meshes[instance.mesh].triangles.size() > 0) {
+        placements.push_back({instance.mesh, instance.transform, instance.transform.inverse()});
+      }
+    }
+    return placements;
+  }
+
+  size_t firstPlane() const { return objects.size() + instances.size(); }
+
+  std::vector<AABB3df> boundingBoxes() const {
+    std::vector<AABB3df> boxes;
+    boxes.reserve(objects.size() + instances.size());
+    for (const auto& object : objects) {
+      boxes.push_back(object.getBoundingBox());
+    }
+    for (const auto& instance : instances) {
+      const LinearBVH3df::Node& root = meshBvhs[instance.mesh].get_nodes()[0];
+      Vector3df lower = {root.lower[0], root.lower[1], root.lower[2]},
+                upper = {root.upper[0], root.upper[1], root.upper[2]};
+      boxes.push_back(instance.toWorld.bounding_box(AABB3df(0.5f * (lower + upper), 0.5f * (upper - lower))));
+    }
+    return boxes;
+  }
+
+  std::vector<LinearBVH3df::Mask> visibilities() const {
+    std::vector<LinearBVH3df::Mask> masks;
+    masks.reserve(objects.size() + instances.size());
+    for (size_t i = 0; i < objects.size() + instances.size(); i++) {
+      masks.push_back(visibility(i));
+    }
+    return masks;
+  }
+
+  // Sichtbarkeit des Primitivs i der BVH
+  LinearBVH3df::Mask visibility(size_t i) const {
+    return i < objects.size() ? objects[i].getVisibility() : meshes[instances[i - objects.size()].mesh].visibility;
+  }
+
+  // Index des Treffers für Primitiv i, bei Instanzen mit dem getroffenen Dreieck
+  size_t hitIndex(size_t i, uint32_t triangle) const {
+    if (i >= objects.size() && i < firstPlane()) {
+      return instanceHit | (i - objects.size()) << 32 | triangle;
+    }
+    return i;
+  }
+
+  // Schnitttest mit Primitiv i für tMin < t < tMax, tMax wird auf t gesetzt
+  // bei Instanzen werden triangle auf das getroffene Dreieck und u und v auf die baryzentrischen Koordinaten gesetzt
+  bool intersect(size_t i, const Ray3df& ray, float tMin, float& tMax, float& u, float& v, uint32_t& triangle) const {
+    if (i < objects.size()) {
+      return objects[i].intersect(ray, tMin, tMax);
+    }
+    if (i >= firstPlane()) {
+      return planes[i - firstPlane()].intersect(ray, tMin, tMax);
+    }
+    const Placement& instance = instances[i - objects.size()];
+    const TriangleMesh3df& mesh = meshes[instance.mesh].triangles;
+    Ray3df local = instance.toObject.ray(ray);
+    size_t k = meshBvhs[instance.mesh].closest_hit(local, tMin, tMax, [&](size_t k, float& t) {
+      return mesh.intersects(k, local, tMin, t, u, v);
+    });
+    if (k == LinearBVH3df::no_hit) {
+      return false;
+    }
+    triangle = static_cast<uint32_t>(k);
+    return true;
+  }
+
+  // Schattentest mit Primitiv i für tMin < t < tMax, ohne t, u, v oder Normale zu berechnen
+  bool occludes(size_t i, const Ray3df& ray, float tMin, float tMax) const {
+    if (i < objects.size()) {
+      return objects[i].occludes(ray, tMin, tMax);
+    }
+    if (i >= firstPlane()) {
+      return planes[i - firstPlane()].occludes(ray, tMin, tMax);
+    }
+    const Placement& instance = instances[i - objects.size()];
+    const TriangleMesh3df& mesh = meshes[instance.mesh].triangles;
+    Ray3df local = instance.toObject.ray(ray);
+    return meshBvhs[instance.mesh].any_hit(local, tMin, tMax, [&](size_t k) {
+      return mesh.occludes(k, local, tMin, tMax);
+    }) != LinearBVH3df::no_hit;
+  }
+
+  // liegt irgendein Primitiv zwischen ray.origin + tMin * ray.direction und ray.origin + maxDist * ray.direction?
+  // die Suche bricht beim ersten Treffer ab, nur Primitive mit Visibility::Shadow werfen Schatten
+  bool occluded(const Ray3df& ray, float maxDist, float tMin = 0.001f) const {
+    for (const auto& plane : planes) {
+      if ((plane.getVisibility() & Visibility::Shadow) && plane.occludes(ray, tMin, maxDist)) {
+        return true;
+      }
+    }
+    if (wideBvh) {
+      return wideBvh->any_hit(ray, tMin, maxDist, [&](size_t i) {
+        return (visibility(i) & Visibility::Shadow) && occludes(i, ray, tMin, maxDist);
+      }) != WideBVH4_3df::no_hit;
+    }
+    return bvh.any_hit(ray, tMin, maxDist, [&](size_t i) {
+      return occludes(i, ray, tMin, maxDist);
+    }, Visibility::Shadow) != LinearBVH3df::no_hit;
+  }
+
+  // Index des nächsten Treffers mit tMin < t < tMax für die Strahlart rayType oder LinearBVH3df::no_hit,
+  // tMax wird auf t gesetzt. Die Ebenen werden zuerst getestet, damit die BVH alles hinter ihnen überspringt.
+  size_t closestHit(const Ray3df& ray, float tMin, float& tMax, float& u, float& v, LinearBVH3df::Mask rayType) const {
+    size_t hit = LinearBVH3df::no_hit;
+    for (size_t p = 0; p < planes.size(); p++) {
+      if ((planes[p].getVisibility() & rayType) && planes[p].intersect(ray, tMin, tMax)) {
+        hit = firstPlane() + p;
+      }
+    }
+    uint32_t triangle = 0;
+    size_t closer = wideBvh ? wideBvh->closest_hit(ray, tMin, tMax, [&](size_t i, float& t) {
+      return (visibility(i) & rayType) && intersect(i, ray, tMin, t, u, v, triangle);
+    }) : bvh.closest_hit(ray, tMin, tMax, [&](size_t i, float& t) {
+      return intersect(i, ray, tMin, t, u, v, triangle);
+    }, rayType);
+    return closer != LinearBVH3df::no_hit ? hitIndex(closer, triangle) : hit;
+  }
+
+  // Paket aus den Primärstrahlen benachbarter Pixel, die Hüllquader der BVH werden mit allen Strahlen zugleich getestet
+  typedef RayPacket<float, 3u, LinearBVH3df::packet_size> Packet;
+
+  // closestHit() für die Strahlen rays[0], ..., rays[count - 1] (count <= Packet::size) als ein Paket,
+  // tMax, hit, u und v haben je einen Wert pro Strahl. Zeigen die Strahlen nicht in dieselben Oktanten,
+  // verfolgt die BVH sie einzeln. Instanzen werden für jeden Strahl einzeln im Objektraum geschnitten.
+  void closestHits(const Ray3df* rays, size_t count, float tMin, float* tMax, size_t* hit, float* u, float* v, LinearBVH3df::Mask rayType) const {
+    size_t planeHit[Packet::size];
+    uint32_t triangle[Packet::size] = {};
+    for (size_t l = 0; l < count; l++) {
+      planeHit[l] = LinearBVH3df::no_hit;
+      for (size_t p = 0; p < planes.size(); p++) {
+        if ((planes[p].getVisibility() & rayType) && planes[p].intersect(rays[l], tMin, tMax[l])) {
+          planeHit[l] = firstPlane() + p;
+        }
+      }
+      hit[l] = LinearBVH3df::no_hit;
+    }
+    bvh.closest_hit(Packet(rays, count), tMin, tMax, hit, [&](size_t i, unsigned l, float& t) {
+      return intersect(i, rays[l], tMin, t, u[l], v[l], triangle[l]);
+    }, rayType);
+    for (size_t l = 0; l < count; l++) {
+      hit[l] = hit[l] != LinearBVH3df::no_hit ? hitIndex(hit[l], triangle[l]) : planeHit[l];
+    }
+  }
+
+  // normierte Normale im Treffer hit, wird nur für den nächsten Schnittpunkt berechnet
+  // Dreiecke sind von beiden Seiten sichtbar, die Normale zeigt zum Strahl. Normalen aus dem Objektraum
+  // werden mit der Transponierten der inversen Abbildung in die Welt gebracht.
+  Vector3df normal(size_t hit, const Ray3df& ray, float t, float u, float v) const {
+    if (hit & instanceHit) {
+      const Placement& instance = instances[(hit & ~instanceHit) >> 32];
+      Vector3df normal = instance.toObject.transposed_direction(meshes[instance.mesh].triangles.normal(hit & 0xFFFFFFFFu, u, v));
+      normal.normalize();
+      return normal * ray.direction > 0.0f ? -1.0f * normal : normal;
+    }
+    if (hit < objects.size()) {
+      return objects[hit].finalize(ray, t);
+    }
+    return planes[hit - firstPlane()].finalize(ray, t);
+  }
+
+  const Material& material(size_t hit) const {
+    if (hit & instanceHit) {
+      return materials[meshes[instances[(hit & ~instanceHit) >> 32].mesh].material];
+    }
+    return materials[hit < objects.size() ? objects[hit].getMaterial() : planes[hit - firstPlane()].getMaterial()];
+  }
+};
 
 // Punktförmige "Lichtquellen" können einfach als Vector3df implementiert werden mit weisser Farbe,
 // bei farbigen Lichtquellen müssen die entsprechenden Daten in Objekt zusammengefaßt werden
@@ -196,113 +565,512 @@ struct Materials {
 // Für einen Sehstrahl aus allen Objekte, dasjenige finden, das dem Augenpunkt am nächsten liegt.
 // Am besten einen Zeiger auf das Objekt zurückgeben. Wenn dieser nullptr ist, dann gibt es kein sichtbares Objekt.
 
-// Die rekursive raytracing-Methode. Am besten ab einer bestimmten Rekursionstiefe (z.B. als Parameter übergeben) abbrechen.
+// Ein Spiegelstrahl wird nur verfolgt, wenn der Durchsatz danach (das Produkt der Reflexionsfaktoren entlang
+// des Pfads) in mindestens einem Farbkanal größer ist, sonst trägt er kaum noch zur Farbe bei.
+// Für den Primärstrahl ist das die Schwelle für spiegelnde Materialien.
+constexpr float minThroughput = 0.01f;
+
+// Gewicht der lokalen Farbe eines Treffers mit Material mat bei Durchsatz throughput: wird der Pfad gespiegelt,
+// ist es 1 - reflective und der Durchsatz wird mit reflective multipliziert, sonst ist es 1 und der Pfad endet.
+bool reflects(const Material& mat, int bounce, int depth, Vector3df& throughput, Vector3df& weight) {
+  bool reflect = bounce < depth && mat.isReflective && (throughput[0] * mat.reflective[0] > minThroughput ||
+                                    throughput[1] * mat.reflective[1] > minThroughput ||
+                                    throughput[2] * mat.reflective[2] > minThroughput);
+  weight = reflect ? Vector3df({1.0f, 1.0f, 1.0f}) - mat.reflective : Vector3df({1.0f, 1.0f, 1.0f});
+  if (reflect) {
+    for (int i = 0; i < 3; ++i) {
+      throughput[i] *= mat.reflective[i];
+    }
+  }
+  return reflect;
+}
+
+// Begrenzung pro Treffer wie in der früheren Rekursion, die die Farbe jedes Treffers (lokale Farbe plus gespiegelte
+// Farbe) auf [0,1] begrenzt hat. Ist color die bisher gesammelte Farbe und throughput der Durchsatz vor dem Treffer,
+// liegt das Ergebnis des Pfads wegen dieser Begrenzung zwischen color und color + throughput. Da die Reflexionsfaktoren
+// nicht negativ sind, ergeben alle Begrenzungen zusammen eine einzige auf [lower, upper], die hier verengt wird.
+// Am Ende des Pfads wird die Farbe auf [lower, upper] begrenzt, anfangs ist das [0,1].
+void narrowBounds(const Vector3df& color, const Vector3df& throughput, Vector3df& lower, Vector3df& upper) {
+  for (int i = 0; i < 3; ++i) {
+    float l = std::clamp(color[i], lower[i], upper[i]);
+    float u = std::clamp(color[i] + throughput[i], lower[i], upper[i]);
+    lower[i] = l;
+    upper[i] = u;
+  }
+}
+
+// Farbe eines Pfads, dessen erster Strahl ray das Primitiv hit bei t = minDist trifft, mit Schatten,
+// Lambertian-Shading und bis zu depth - 1 Spiegelungen.
+// Die Spiegelungen werden iterativ verfolgt: jeder Treffer addiert seine lokale Farbe gewichtet mit dem Durchsatz
+// des Pfads, so dass auch viele Spiegelungen keinen Stack benötigen. Die Begrenzung auf [0,1] jedes Treffers
+// übernimmt narrowBounds().
+Color shade(const Ray3df& primary, const Scene& scene, const Vector3df& lightPos, size_t hit, float minDist, float hitU, float hitV, int depth)
+{
+  constexpr float shadow_epsilon = 0.001f;
+  Ray3df ray = primary;
+  Vector3df color({0.0f, 0.0f, 0.0f});
+  Vector3df throughput({1.0f, 1.0f, 1.0f});
+  Vector3df weight({1.0f, 1.0f, 1.0f});
+  Vector3df lower({0.0f, 0.0f, 0.0f}), upper({1.0f, 1.0f, 1.0f});
+
+  for (int bounce = 1; ; ++bounce) {
+    Vector3df hitPoint = ray.origin + minDist * ray.direction;
+    Vector3df hitNormal = scene.normal(hit, ray, minDist, hitU, hitV);
+
+    // Farbe & Licht, der Schattenstrahl wird nur für diffuse Materialien benötigt
+    const Material& mat = scene.material(hit);
+    Vector3df local = mat.ambient;
+    if (mat.isDiffuse) {
+      Vector3df toLight = lightPos - hitPoint;
+      float lightDist = toLight.length();
+      toLight.normalize();
+      Ray3df shadowRay(hitPoint + shadow_epsilon * hitNormal, toLight);
+      if (!scene.occluded(shadowRay, lightDist, shadow_epsilon)) {
+        float diff = std::max(0.0f, hitNormal * toLight);
+        local = local + diff * mat.diffuse;
+      }
+    }
+
+    Vector3df pathThroughput = throughput;
+    narrowBounds(color, pathThroughput, lower, upper);
+    bool reflect = reflects(mat, bounce, depth, throughput, weight);
+    for (int i = 0; i < 3; ++i) {
+      color[i] = color[i] + pathThroughput[i] * (weight[i] * local[i]);
+    }
+    if (!reflect) {
+      break;
+    }
+
+    //Reflexion
+    Vector3df reflDir = ray.direction - 2.0f * (ray.direction * hitNormal) * hitNormal;
+    reflDir.normalize();
+    ray = Ray3df(hitPoint + 0.001f * hitNormal, reflDir);
+    minDist = std::numeric_limits<float>::max();
+    hit = scene.closestHit(ray, 0.001f, minDist, hitU, hitV, Visibility::Reflection);
+    if (hit == LinearBVH3df::no_hit) {
+      break; // die Spiegelung trifft nichts und ist schwarz
+    }
+  }
+
+  // Clamp auf [lower, upper], höchstens [0,1]
+  for (int i = 0; i < 3; ++i) {
+    color[i] = std::clamp(color[i], lower[i], upper[i]);
+  }
+  return Color(color[0], color[1], color[2]);
+}
+
+// Die raytracing-Methode: sucht den nächsten Schnittpunkt und berechnet mit shade() die Farbe,
+// depth ist die Anzahl der Treffer des Pfads einschließlich des ersten, d.h. depth - 1 Spiegelungen.
 Color trace(const Ray3df& ray,
-const std::vector<Object>& scene,
+const Scene& scene,
 const Vector3df& lightPos,
-int depth = 2) 
+int depth = 2,
+LinearBVH3df::Mask rayType = Visibility::Camera)
 {
   if (depth == 0){
-    return Color(0, 0, 0); //Schwarz 
+    return Color(0, 0, 0); //Schwarz
   }
   float minDist = std::numeric_limits<float>::max();
-  const Object* hitObject = nullptr;
-  Vector3df hitPoint({0.0f, 0.0f, 0.0f});
-  Vector3df hitNormal({0.0f, 0.0f, 0.0f});
-
-  // Schnittpunkt mit Szene suchen
-  for (const auto& object : scene) {
-  float t;
-  Vector3df normal({0.0f, 0.0f, 0.0f});
-  if (object.intersect(ray, t, normal)) {
-    if (t < minDist && t > 0.001f) {
-      minDist = t;
-      hitObject = &object;
-      hitNormal = normal;
-      hitPoint = ray.origin + t * ray.direction;
-    }
+  float hitU = 0.0f, hitV = 0.0f;
+
+  // Schnittpunkt mit Szene suchen, die BVH testet nur Objekte deren Hüllquader getroffen wird
+  // der Schnitttest berechnet nur t (und u, v bei Dreiecken), Schnittpunkt und Normale folgen nur für den nächsten
+  // rayType gibt an, welche Objekte der Strahl sieht (Kamera oder Spiegelung)
+  size_t hit = scene.closestHit(ray, 0.001f, minDist, hitU, hitV, rayType);
+  if (hit == LinearBVH3df::no_hit){
+    return Color(0, 0, 0); //kein Schnittpunkt gefunden
   }
+  return shade(ray, scene, lightPos, hit, minDist, hitU, hitV, depth);
 }
-  if (!hitObject){
-    return Color(0, 0, 0); //kein Schnittpunkt gefunden
+
+// Rendert die Pixel [x0, x1) x [y0, y1) eines Blocks mit höchstens Scene::Packet::size Pixeln.
+// Die Primärstrahlen des Blocks werden als Paket verfolgt, Schatten und Spiegelungen danach einzeln mit shade().
+// rays wird für alle Blöcke einer Kachel wiederverwendet.
+void renderPacket(const Camera& camera, const Scene& scene, const Vector3df& lightPos, Screen& screen, int top,
+                  int x0, int y0, int x1, int y1, std::vector<Ray3df>& rays, int depth) {
+  rays.clear();
+  for (int y = y0; y < y1; ++y) {
+    for (int x = x0; x < x1; ++x) {
+      rays.push_back(camera.generateRay(x, top + y));
+    }
   }
+  float minDist[Scene::Packet::size], hitU[Scene::Packet::size], hitV[Scene::Packet::size];
+  size_t hit[Scene::Packet::size];
+  std::fill(minDist, minDist + Scene::Packet::size, std::numeric_limits<float>::max());
+  scene.closestHits(rays.data(), rays.size(), 0.001f, minDist, hit, hitU, hitV, Visibility::Camera);
 
-//Schatten
-Vector3df toLight = lightPos - hitPoint;
-float lightDist = toLight.length();
-toLight.normalize();
-
-constexpr float shadow_epsilon = 0.001f;
-Ray3df shadowRay(hitPoint + shadow_epsilon * hitNormal, toLight);
-bool inShadow = false;
-for (const auto& object : scene) {
-    if (&object == hitObject) continue; // Self-shadowing 
-    float tShadow;
-    Vector3df nShadow({0.0f, 0.0f, 0.0f});
-    if (object.intersect(shadowRay, tShadow, nShadow)) {
-        if (tShadow > shadow_epsilon && tShadow < lightDist) {
-            // Ausnahme: Strahl trifft Kugel (Wand, Boden, Decke) dann ignorieren --> Schattenwurf auf Wände möglich
-            if (&object == &scene[0]) continue;
-            inShadow = true;
-            break;
+  for (size_t l = 0; l < rays.size(); ++l) {
+    Color pixelColor = hit[l] == LinearBVH3df::no_hit ? Color(0, 0, 0)
+                                                       : shade(rays[l], scene, lightPos, hit[l], minDist[l], hitU[l], hitV[l], depth);
+    int r, g, b;
+    pixelColor.to8BitColor(r, g, b);
+    screen.setPixel(x0 + l % (x1 - x0), y0 + l / (x1 - x0), r, g, b);
+  }
+}
+
+// Rendert die Zeilen [top, top + screen.height) des Bildes in screen.
+// Der Streifen wird in Kacheln zerlegt, die der Thread-Pool verteilt. Kacheln mit spiegelnden Kugeln
+// dauern länger, freie Threads übernehmen dann Kacheln von den anderen (work stealing).
+// Mit packets werden die Kacheln in Blöcke von 4x4 (AVX-512) oder 4x2 Pixeln zerlegt, deren Primärstrahlen
+// als Paket verfolgt werden, sonst wird jedes Pixel einzeln mit trace() berechnet.
+void renderTiles(ThreadPool& pool, const Camera& camera, const Scene& scene, const Vector3df& lightPos, Screen& screen, int top,
+                 bool packets = false, int depth = 2) {
+  constexpr int tileSize = 16;
+  constexpr int packetWidth = 4, packetHeight = Scene::Packet::size / packetWidth;
+  int tilesX = (screen.width + tileSize - 1) / tileSize;
+  int tilesY = (screen.height + tileSize - 1) / tileSize;
+
+  pool.parallel_for(tilesX * tilesY, [&](size_t tile) {
+    int x0 = (tile % tilesX) * tileSize, y0 = (tile / tilesX) * tileSize;
+    int x1 = std::min(x0 + tileSize, screen.width), y1 = std::min(y0 + tileSize, screen.height);
+    if (packets) {
+      std::vector<Ray3df> rays;
+      rays.reserve(Scene::Packet::size);
+      for (int y = y0; y < y1; y += packetHeight) {
+        for (int x = x0; x < x1; x += packetWidth) {
+          renderPacket(camera, scene, lightPos, screen, top, x, y, std::min(x + packetWidth, x1), std::min(y + packetHeight, y1), rays, depth);
         }
+      }
+      return;
+    }
+    for (int y = y0; y < y1; ++y) {
+      for (int x = x0; x < x1; ++x) {
+        Ray3df ray = camera.generateRay(x, top + y);
+        Color pixelColor = trace(ray, scene, lightPos, depth);
+
+        int r, g, b;
+        pixelColor.to8BitColor(r, g, b);
+        screen.setPixel(x, y, r, g, b);
+      }
     }
+  });
 }
 
+// Warteschlange von Strahlen für den Wavefront-Renderer im SoA-Layout (je ein Array pro Koordinate),
+// path ist das Pixel der Kachel, zu dem der Strahl gehört.
+struct RayQueue {
+  std::vector<float> origin[3], direction[3];
+  std::vector<uint32_t> path;
 
-// Farbe & Licht 
-const Material& mat = hitObject->getMaterial();
-Vector3df color = mat.ambient;
+  size_t size() const { return path.size(); }
 
-if (!inShadow) {
-  float diff = std::max(0.0f, hitNormal * toLight); 
-  color = color + diff * mat.diffuse;
-}
+  void clear() {
+    for (int i = 0; i < 3; ++i) {
+      origin[i].clear();
+      direction[i].clear();
+    }
+    path.clear();
+  }
 
-//Reflexion
-if (depth > 1 &&
-(mat.reflective[0] > 0.01f || mat.reflective[1] > 0.01f || mat.reflective[2] > 0.01f)) {
-  Vector3df reflDir = ray.direction - 2.0f * (ray.direction * hitNormal) * hitNormal;
-  reflDir.normalize();
-  Ray3df reflectRay(hitPoint + 0.001f * hitNormal, reflDir);
-  Color reflected = trace(reflectRay, scene, lightPos, depth - 1);
+  void push(const Ray3df& ray, uint32_t p) {
+    for (int i = 0; i < 3; ++i) {
+      origin[i].push_back(ray.origin[i]);
+      direction[i].push_back(ray.direction[i]);
+    }
+    path.push_back(p);
+  }
 
-  Vector3df reflColor{reflected.r, reflected.g, reflected.b};
-  Vector3df temp = Vector3df({1.0f, 1.0f, 1.0f}) - mat.reflective;
+  Ray3df ray(size_t k) const {
+    return Ray3df{Vector3df({origin[0][k], origin[1][k], origin[2][k]}), Vector3df({direction[0][k], direction[1][k], direction[2][k]})};
+  }
+};
 
-  for (int i = 0; i < 3; ++i) {
-    color[i] = temp[i] * color[i] + mat.reflective[i] * reflColor[i];
+// Treffer der extend-Stufe im SoA-Layout: Index des Strahls in der RayQueue, Primitiv, t und baryzentrische u, v
+struct HitQueue {
+  std::vector<uint32_t> ray;
+  std::vector<size_t> primitive;
+  std::vector<float> t, u, v;
+
+  size_t size() const { return ray.size(); }
+
+  void clear() {
+    ray.clear();
+    primitive.clear();
+    t.clear();
+    u.clear();
+    v.clear();
   }
-}
+};
+
+// Schattenstrahlen der shade-Stufe mit Abstand zur Lichtquelle und diffusem Faktor (Normale * Lichtrichtung),
+// dazu Material, Durchsatz und Gewicht des Treffers wie in shade().
+// shadow setzt occluded, connect addiert die lokale Farbe des Treffers zur Farbe des Pfads.
+struct ShadowQueue {
+  RayQueue rays;
+  std::vector<float> lightDist, diff;
+  std::vector<const Material*> material;
+  std::vector<Vector3df> throughput, weight;
+  std::vector<uint8_t> occluded;
 
-// Clamp auf [0,1]
-for (int i = 0; i < 3; ++i){
-  color[i] = std::clamp(color[i], 0.0f, 1.0f);
+  void clear() {
+    rays.clear();
+    lightDist.clear();
+    diff.clear();
+    material.clear();
+    throughput.clear();
+    weight.clear();
+    occluded.clear();
+  }
+};
+
+// Wavefront-Renderer: statt jedes Pixel rekursiv mit trace() zu berechnen, werden die Strahlen aller Pixel einer Kachel
+// in Warteschlangen gesammelt und in getrennten Stufen verarbeitet, Stufe für Stufe über alle Strahlen:
+//   generate: Primärstrahlen aller Pixel in Blöcken von Scene::Packet::size Pixeln, damit extend Pakete bilden kann
+//   extend:   nächster Schnittpunkt aller Strahlen einer Runde, je Scene::Packet::size Strahlen als Paket
+//   shade:    Normale und Material jedes Treffers, ein Schattenstrahl (nur bei diffusen Materialien)
+//             und ggf. ein Spiegelstrahl für die nächste Runde
+//   shadow:   Schattentest aller Schattenstrahlen
+//   connect:  lokale Farbe aus ambientem und diffusem Anteil, gewichtet zur Farbe des Pfads addiert
+// Eine Runde pro Spiegelung, der Zustand jedes Pfads (Farbe und Durchsatz) liegt in Arrays pro Pixel.
+// Die Rechenschritte sind dieselben wie in shade(), so dass das Bild identisch zu trace() ist.
+class Wavefront {
+  public:
+    Wavefront(const Camera& camera, const Scene& scene, const Vector3df& lightPos, int depth = 2)
+      : camera(camera), scene(scene), lightPos(lightPos), depth(depth) {}
+
+    // rendert die Pixel [x0, x1) x [y0, y1) des Streifens ab Bildzeile top in screen
+    void render(Screen& screen, int top, int x0, int y0, int x1, int y1) {
+      generate(top, x0, y0, x1, y1);
+      for (int level = 0; level < depth && rays.size() > 0; ++level) {
+        extend(level);
+        shade(level);
+        shadow();
+        connect();
+        std::swap(rays, next);
+      }
+      for (size_t p = 0; p < pixelX.size(); ++p) {
+        Vector3df color = pathColor[p];
+        for (int i = 0; i < 3; ++i) {
+          color[i] = std::clamp(color[i], pathLower[p][i], pathUpper[p][i]);
+        }
+        int r, g, b;
+        Color(color[0], color[1], color[2]).to8BitColor(r, g, b);
+        screen.setPixel(pixelX[p], pixelY[p], r, g, b);
+      }
+    }
+
+  private:
+    static constexpr float shadow_epsilon = 0.001f;
+
+    void generate(int top, int x0, int y0, int x1, int y1) {
+      constexpr int packetWidth = 4, packetHeight = Scene::Packet::size / packetWidth;
+      pixelX.clear();
+      pixelY.clear();
+      rays.clear();
+      for (int by = y0; by < y1; by += packetHeight) {
+        for (int bx = x0; bx < x1; bx += packetWidth) {
+          for (int y = by; y < std::min(by + packetHeight, y1); ++y) {
+            for (int x = bx; x < std::min(bx + packetWidth, x1); ++x) {
+              rays.push(camera.generateRay(x, top + y), static_cast<uint32_t>(pixelX.size()));
+              pixelX.push_back(x);
+              pixelY.push_back(y);
+            }
+          }
+        }
+      }
+      pathColor.assign(pixelX.size(), Vector3df({0.0f, 0.0f, 0.0f}));
+      pathThroughput.assign(pixelX.size(), Vector3df({1.0f, 1.0f, 1.0f}));
+      pathLower.assign(pixelX.size(), Vector3df({0.0f, 0.0f, 0.0f}));
+      pathUpper.assign(pixelX.size(), Vector3df({1.0f, 1.0f, 1.0f}));
+    }
+
+    void extend(int level) {
+      LinearBVH3df::Mask rayType = level == 0 ? Visibility::Camera : Visibility::Reflection;
+      hits.clear();
+      std::vector<Ray3df> packet;
+      packet.reserve(Scene::Packet::size);
+      for (size_t first = 0; first < rays.size(); first += Scene::Packet::size) {
+        packet.clear();
+        for (size_t k = first; k < std::min(first + Scene::Packet::size, rays.size()); ++k) {
+          packet.push_back(rays.ray(k));
+        }
+        float minDist[Scene::Packet::size], hitU[Scene::Packet::size], hitV[Scene::Packet::size];
+        size_t hit[Scene::Packet::size];
+        std::fill(minDist, minDist + Scene::Packet::size, std::numeric_limits<float>::max());
+        scene.closestHits(packet.data(), packet.size(), 0.001f, minDist, hit, hitU, hitV, rayType);
+        for (size_t l = 0; l < packet.size(); ++l) {
+          if (hit[l] != LinearBVH3df::no_hit) {
+            hits.ray.push_back(static_cast<uint32_t>(first + l));
+            hits.primitive.push_back(hit[l]);
+            hits.t.push_back(minDist[l]);
+            hits.u.push_back(hitU[l]);
+            hits.v.push_back(hitV[l]);
+          }
+        }
+      }
+    }
+
+    // dieselben Rechenschritte wie eine Iteration von shade()
+    void shade(int level) {
+      shadows.clear();
+      next.clear();
+      for (size_t k = 0; k < hits.size(); ++k) {
+        Ray3df ray = rays.ray(hits.ray[k]);
+        uint32_t p = rays.path[hits.ray[k]];
+        Vector3df hitPoint = ray.origin + hits.t[k] * ray.direction;
+        Vector3df hitNormal = scene.normal(hits.primitive[k], ray, hits.t[k], hits.u[k], hits.v[k]);
+
+        const Material& mat = scene.material(hits.primitive[k]);
+        Vector3df throughput = pathThroughput[p];
+        Vector3df weight({1.0f, 1.0f, 1.0f});
+        // die Farbe der vorigen Treffer ist vollständig, connect() der letzten Runde ist schon gelaufen
+        narrowBounds(pathColor[p], throughput, pathLower[p], pathUpper[p]);
+        if (reflects(mat, level + 1, depth, pathThroughput[p], weight)) {
+          Vector3df reflDir = ray.direction - 2.0f * (ray.direction * hitNormal) * hitNormal;
+          reflDir.normalize();
+          next.push(Ray3df(hitPoint + 0.001f * hitNormal, reflDir), p);
+        }
+
+        // ohne diffusen Anteil ist die lokale Farbe der ambiente Anteil, der Schattenstrahl entfällt
+        if (!mat.isDiffuse) {
+          for (int i = 0; i < 3; ++i) {
+            pathColor[p][i] = pathColor[p][i] + throughput[i] * (weight[i] * mat.ambient[i]);
+          }
+          continue;
+        }
+        Vector3df toLight = lightPos - hitPoint;
+        float lightDist = toLight.length();
+        toLight.normalize();
+        shadows.rays.push(Ray3df(hitPoint + shadow_epsilon * hitNormal, toLight), p);
+        shadows.lightDist.push_back(lightDist);
+        shadows.diff.push_back(std::max(0.0f, hitNormal * toLight));
+        shadows.material.push_back(&mat);
+        shadows.throughput.push_back(throughput);
+        shadows.weight.push_back(weight);
+      }
+    }
+
+    void shadow() {
+      shadows.occluded.resize(shadows.rays.size());
+      for (size_t k = 0; k < shadows.rays.size(); ++k) {
+        shadows.occluded[k] = scene.occluded(shadows.rays.ray(k), shadows.lightDist[k], shadow_epsilon);
+      }
+    }
+
+    void connect() {
+      for (size_t k = 0; k < shadows.rays.size(); ++k) {
+        uint32_t p = shadows.rays.path[k];
+        Vector3df local = shadows.material[k]->ambient;
+        if (!shadows.occluded[k]) {
+          local = local + shadows.diff[k] * shadows.material[k]->diffuse;
+        }
+        for (int i = 0; i < 3; ++i) {
+          pathColor[p][i] = pathColor[p][i] + shadows.throughput[k][i] * (shadows.weight[k][i] * local[i]);
+        }
+      }
+    }
+
+    const Camera& camera;
+    const Scene& scene;
+    const Vector3df& lightPos;
+    int depth;
+    std::vector<int> pixelX, pixelY;
+    RayQueue rays, next;
+    HitQueue hits;
+    ShadowQueue shadows;
+    // Zustand der Pfade: bisher gesammelte Farbe, Durchsatz für die nächste Spiegelung und Grenzen wie in shade()
+    std::vector<Vector3df> pathColor, pathThroughput, pathLower, pathUpper;
+};
+
+// Rendert die Zeilen [top, top + screen.height) wie renderTiles(), aber mit dem Wavefront-Renderer
+// in größeren Kacheln, damit jede Stufe viele Strahlen auf einmal verarbeitet.
+void renderWavefront(ThreadPool& pool, const Camera& camera, const Scene& scene, const Vector3df& lightPos, Screen& screen, int top,
+                     int depth = 2) {
+  constexpr int tileSize = 32;
+  int tilesX = (screen.width + tileSize - 1) / tileSize;
+  int tilesY = (screen.height + tileSize - 1) / tileSize;
+
+  pool.parallel_for(tilesX * tilesY, [&](size_t tile) {
+    int x0 = (tile % tilesX) * tileSize, y0 = (tile / tilesX) * tileSize;
+    Wavefront wavefront(camera, scene, lightPos, depth);
+    wavefront.render(screen, top, x0, y0, std::min(x0 + tileSize, screen.width), std::min(y0 + tileSize, screen.height));
+  });
 }
-  return Color(color[0], color[1], color[2]);
-} 
 
-int main(void) {
-Screen screen(800, 600);
+// Aufruf: raytracer [Anzahl Threads] [Breite Höhe] [stream] [packets | wavefront] [wide] [depth=Tiefe] [instances=Anzahl]
+//                  [cache=Verzeichnis]
+// ohne Angabe werden alle Hardware-Threads verwendet und ein 800x600 Bild berechnet.
+// Mit stream wird das Bild in Streifen von 16 Zeilen berechnet und jeder Streifen sofort geschrieben,
+// so dass auch sehr große Bilder nicht vollständig im Speicher liegen.
+// Mit packets werden die Primärstrahlen in Paketen statt einzeln verfolgt (in Messungen nicht schneller,
+// daher nicht der Standard), mit wavefront berechnet der Wavefront-Renderer das (identische) Bild.
+// Mit wide verwenden die einzelnen Strahlen die BVH mit vier Kindern pro Knoten (siehe Scene).
+// depth ist die Anzahl der Treffer pro Pfad (Standard 2, d.h. eine Spiegelung), mindestens 1.
+// instances stellt die angegebene Anzahl Instanzen eines Netzes in die Szene (zweistufige BVH).
+// cache legt die BVHs im angegebenen Verzeichnis ab bzw. lädt sie von dort, die Aufbauzeit der Szene wird ausgegeben.
+int main(int argc, char* argv[]) {
+size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : ThreadPool::default_threads();
+int width = argc > 3 ? std::atoi(argv[2]) : 800;
+int height = argc > 3 ? std::atoi(argv[3]) : 600;
+bool stream = false, packets = false, wavefront = false, wide = false;
+int depth = 2, instanceCount = 0;
+std::string cache;
+for (int i = 4; i < argc; ++i) {
+  if (std::string(argv[i]).rfind("depth=", 0) == 0) {
+    depth = std::atoi(argv[i] + 6);
+  }
+  if (std::string(argv[i]).rfind("instances=", 0) == 0) {
+    instanceCount = std::atoi(argv[i] + 10);
+  }
+  if (std::string(argv[i]).rfind("cache=", 0) == 0) {
+    cache = argv[i] + 6;
+  }
+  stream = stream || std::string(argv[i]) == "stream";
+  packets = packets || std::string(argv[i]) == "packets";
+  wavefront = wavefront || std::string(argv[i]) == "wavefront";
+  wide = wide || std::string(argv[i]) == "wide";
+}
+// Pakete und Wavefront schattieren den ersten Treffer immer, nur trace() kennt depth = 0
+if (depth < 1) {
+  std::cerr << "depth must be at least 1" << std::endl;
+  return 1;
+}
+MaterialTable materials;
 std::vector<Object> cornellBox;
-// Wände (Kugeln)
-Sphere<float, 3> ceilingSphere(Vector<float,3>({0.0f, -1000.0f, 0.0f}), 1000.0f);
-Sphere<float, 3> floorSphere(Vector<float,3>({0.0f, 1002.0f, 0.0f}), 1000.0f);
-Sphere<float, 3> leftWallSphere(Vector<float,3>({-1002.0f, 0.0f, 0.0f}), 1000.0f);
-Sphere<float, 3> rightWallSphere(Vector<float,3>({1002.0f, 0.0f, 0.0f}), 1000.0f);
-Sphere<float, 3> backWallSphere(Vector<float,3>({0.0f, 0.0f, -1002.0f}), 1000.0f);
+// Wände (Ebenen durch einen Punkt mit der Normale in den Raum hinein)
+Plane3df ceilingPlane(Vector3df({0.0f, 0.0f, 0.0f}), Vector3df({0.0f, 1.0f, 0.0f}));
+Plane3df floorPlane(Vector3df({0.0f, 2.0f, 0.0f}), Vector3df({0.0f, -1.0f, 0.0f}));
+Plane3df leftWallPlane(Vector3df({-2.0f, 0.0f, 0.0f}), Vector3df({1.0f, 0.0f, 0.0f}));
+Plane3df rightWallPlane(Vector3df({2.0f, 0.0f, 0.0f}), Vector3df({-1.0f, 0.0f, 0.0f}));
+Plane3df backWallPlane(Vector3df({0.0f, 0.0f, -2.0f}), Vector3df({0.0f, 0.0f, 1.0f}));
 
 //Wände setzen
-cornellBox.emplace_back(Materials::white(), floorSphere);
-cornellBox.emplace_back(Materials::white(), ceilingSphere);
-cornellBox.emplace_back(Materials::red(), leftWallSphere);
-cornellBox.emplace_back(Materials::green(), rightWallSphere);
-cornellBox.emplace_back(Materials::white(), backWallSphere);
+cornellBox.emplace_back(materials.add(Materials::white()), floorPlane);
+cornellBox.emplace_back(materials.add(Materials::white()), ceilingPlane);
+cornellBox.emplace_back(materials.add(Materials::red()), leftWallPlane);
+cornellBox.emplace_back(materials.add(Materials::green()), rightWallPlane);
+cornellBox.emplace_back(materials.add(Materials::white()), backWallPlane);
 
 //Kugeln
-cornellBox.emplace_back(Materials::mirror(), Sphere<float, 3>(Vector<float, 3>({-1.0f, 1.0f, 0.0f}), 0.3f));  // Spiegelkugel links
-cornellBox.emplace_back(Materials::reflektierendesBlau(), Sphere<float, 3>(Vector<float, 3>({ 0.5f, 0.4f, -1.0f}), 0.3f));  // Blaukugel Mitte
-cornellBox.emplace_back(Materials::mattGruen(),  Sphere<float, 3>(Vector<float, 3>({ 1.0f, 1.5f, 1.5f}), 0.3f));  // Grünkugel rechts
+cornellBox.emplace_back(materials.add(Materials::mirror()), Sphere<float, 3>(Vector<float, 3>({-1.0f, 1.0f, 0.0f}), 0.3f));  // Spiegelkugel links
+cornellBox.emplace_back(materials.add(Materials::reflektierendesBlau()), Sphere<float, 3>(Vector<float, 3>({ 0.5f, 0.4f, -1.0f}), 0.3f));  // Blaukugel Mitte
+cornellBox.emplace_back(materials.add(Materials::mattGruen()),  Sphere<float, 3>(Vector<float, 3>({ 1.0f, 1.5f, 1.5f}), 0.3f));  // Grünkugel rechts
+
+// instances=N stellt N Kopien einer kleinen Pyramide auf den Boden, alle Kopien teilen sich ein Netz
+std::vector<Mesh> meshes;
+std::vector<Instance> instances;
+if (instanceCount > 0) {
+  TriangleMesh3df pyramid({ Vector3df({-1.0f, 0.0f, -1.0f}), Vector3df({1.0f, 0.0f, -1.0f}), Vector3df({1.0f, 0.0f, 1.0f}),
+                            Vector3df({-1.0f, 0.0f, 1.0f}), Vector3df({0.0f, -1.5f, 0.0f}) },
+                          { {0, 1, 4}, {1, 2, 4}, {2, 3, 4}, {3, 0, 4} });
+  meshes.push_back({materials.add(Materials::reflektierendesRot()), pyramid});
+  int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(instanceCount))));
+  float size = 1.5f / side;
+  for (int k = 0; k < instanceCount; k++) {
+    float x = -1.8f + 3.6f * (k % side + 0.5f) / side, z = -1.8f + 3.6f * (k / side + 0.5f) / side;
+    instances.push_back({0u, Transform3df::translation({x, 2.0f, z}) * Transform3df::rotation(0, 2, 0.7f * k)
+                             * Transform3df::scaling({0.5f * size, size, 0.5f * size})});
+  }
+}
+
+if (!cache.empty()) {
+  std::error_code error;
+  std::filesystem::create_directories(cache, error);
+}
+auto setupStart = std::chrono::steady_clock::now();
+Scene scene(materials, cornellBox, meshes, instances, cache, wide);
+std::chrono::duration<double> setupSeconds = std::chrono::steady_clock::now() - setupStart;
+std::cout << "Scene built in " << setupSeconds.count() << " s\n";
 
 // Kamera
 Camera camera(
@@ -310,24 +1078,43 @@ Vector3df({0.0f, 1.0f, 5.0f}), // Position
 Vector3df({0.0f, 1.0f, 0.0f}), // Blickrichtung
 Vector3df({0.0f, 1.0f, 0.0f}), // Up
 45.0f,
-screen.width, screen.height
+width, height
 );
 
 // Lichtquelle
 Vector3df lightPos({0.0f, 0.05f, 2.0f});
 
-//Eigentliches Raytracing
-for (int y = 0; y < screen.height; ++y) {
-  for (int x = 0; x < screen.width; ++x) {
-    Ray3df ray = camera.generateRay(x, y);
-    Color pixelColor = trace(ray, cornellBox, lightPos, 2);
-
-    int r, g, b;
-    pixelColor.to8BitColor(r, g, b);
-    screen.setPixel(x, y, r, g, b);
+//Eigentliches Raytracing, die Laufzeit wird als Primärstrahlen pro Sekunde ausgegeben
+ThreadPool pool(threads);
+auto render = [&](Screen& screen, int top) {
+  if (wavefront) {
+    renderWavefront(pool, camera, scene, lightPos, screen, top, depth);
+  } else {
+    renderTiles(pool, camera, scene, lightPos, screen, top, packets, depth);
+  }
+};
+auto start = std::chrono::steady_clock::now();
+if (stream) {
+  constexpr int bandHeight = 16;
+  ImageWriter writer("output.ppm", ImageWriter::Format::P6, width, height);
+  Screen band(width, bandHeight);
+  for (int top = 0; top < height; top += bandHeight) {
+    band.height = std::min(bandHeight, height - top);
+    render(band, top);
+    band.writeRows(writer, top, band.height);
+  }
+  if (!writer.good()) {
+    std::cerr << "Error writing file: output.ppm" << std::endl;
+    return 1;
   }
+  std::cout << "Image saved as output.ppm\n";
+} else {
+  Screen screen(width, height);
+  render(screen, 0);
+  screen.saveAsPPM("output.ppm");
 }
-
-screen.saveAsPPM("output.ppm");
+std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+std::cout << "Rendered " << width << "x" << height << " pixels with " << pool.size() << " threads in "
+          << seconds.count() << " s (" << width * static_cast<double>(height) / seconds.count() << " rays/s)\n";
 return 0;
 }
\ No newline at end of file
@@ -0,0 +1,5 @@
+#include "sphere_set.h"
+#include "sphere_set.tcc"
+
+template class SphereSet<float, 2u>;
+template class SphereSet<float, 3u>;
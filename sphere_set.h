@@ -0,0 +1,210 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+
+#include "geometry.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// contains a set of spheres that are intersected with one ray at once, e.g. all spheres of a bvh leaf
+// for float and N = 3 several spheres are tested with each instruction (width: 16 with AVX-512, 8 with AVX2),
+// all other cases use the scalar implementation.
+
+
+/*
+ the centers and radii are stored in structure of arrays layout:
+
+   center[0] | x0 x1 x2 x3 ... |
+   center[1] | y0 y1 y2 y3 ... |
+   center[2] | z0 z1 z2 z3 ... |
+   radius2   | r0² r1² r2² ... |
+
+ the arrays are padded with block spheres that are never hit (radius2 = -INFINITY), so that
+ a load of width values starting at any sphere stays inside the arrays
+*/
+template <class FLOAT, size_t N>
+class SphereSet {
+public:
+  static constexpr size_t no_hit = static_cast<size_t>(-1);
+  static constexpr size_t block = 16u;
+
+#if defined(__AVX512F__)
+  static constexpr size_t width = std::is_same_v<FLOAT, float> && N == 3u ? 16u : 1u;
+#elif defined(__AVX2__)
+  static constexpr size_t width = std::is_same_v<FLOAT, float> && N == 3u ? 8u : 1u;
+#else
+  static constexpr size_t width = 1u;
+#endif
+
+  // the k-th sphere of the set is spheres[order[k]], e.g. in the leaf order of a bvh, or spheres[k] if order is empty
+  explicit SphereSet(const std::vector<Sphere<FLOAT, N>> & spheres, std::span<const uint32_t> order = {});
+  SphereSet(const std::vector<Sphere<FLOAT, N>> & spheres, const std::vector<uint32_t> & order);
+
+  // returns the number of spheres
+  size_t size() const;
+
+  // searches the closest of the spheres first, ..., first + count - 1 that is hit by the ray at
+  // a value t with t_min < t < t_max, like Sphere::intersects(ray, t_min, t_max) does for one sphere
+  // returns the position of this sphere in the set and sets t_max to t, or returns no_hit
+  size_t closest_hit(const Ray<FLOAT, N> &ray, size_t first, size_t count, FLOAT t_min, FLOAT & t_max) const;
+
+  // scalar implementation of closest_hit(), used if no SIMD instructions are available
+  size_t closest_hit_scalar(const Ray<FLOAT, N> &ray, size_t first, size_t count, FLOAT t_min, FLOAT & t_max) const;
+
+  // returns the sphere at the given position
+  Sphere<FLOAT, N> sphere(size_t k) const;
+
+  // returns the number of bytes used by the arrays
+  size_t memory_size() const;
+
+private:
+  std::vector<FLOAT> center[N];
+  std::vector<FLOAT> radius2;
+  size_t count;
+};
+
+
+// the ray equation |origin + t * direction - center|² = radius² is solved with the half coefficient
+// b = (origin - center) * direction, the near solution is taken if it is larger than t_min
+template <class FLOAT, size_t N>
+inline size_t SphereSet<FLOAT, N>::closest_hit_scalar(const Ray<FLOAT, N> &ray, size_t first, size_t count, FLOAT t_min, FLOAT & t_max) const {
+  FLOAT a = ray.direction * ray.direction,
+        inverse_a = static_cast<FLOAT>(1.0) / a;
+  size_t hit = no_hit;
+  for (size_t k = first; k < first + count; k++) {
+    FLOAT b = 0.0, c = -radius2[k];
+    for (size_t i = 0; i < N; i++) {
+      FLOAT om = ray.origin[i] - center[i][k];
+      b += om * ray.direction[i];
+      c += om * om;
+    }
+    FLOAT d = b * b - a * c;
+    if (d < 0.0) {
+      continue;
+    }
+    d = std::sqrt(d);
+    FLOAT t = (-b - d) * inverse_a;
+    if (t <= t_min) {
+      t = (-b + d) * inverse_a;
+    }
+    if (t > t_min && t < t_max) {
+      t_max = t;
+      hit = k;
+    }
+  }
+  return hit;
+}
+
+// each lane keeps the closest hit of its spheres, the lanes are reduced once at the end,
+// among equal values the smallest position wins like in the scalar implementation
+template <class FLOAT, size_t N>
+inline size_t SphereSet<FLOAT, N>::closest_hit(const Ray<FLOAT, N> &ray, size_t first, size_t count, FLOAT t_min, FLOAT & t_max) const {
+#if defined(__AVX512F__)
+  if constexpr (std::is_same_v<FLOAT, float> && N == 3u) {
+    float a = ray.direction * ray.direction;
+    __m512 ox = _mm512_set1_ps(ray.origin[0]), oy = _mm512_set1_ps(ray.origin[1]), oz = _mm512_set1_ps(ray.origin[2]),
+           dx = _mm512_set1_ps(ray.direction[0]), dy = _mm512_set1_ps(ray.direction[1]), dz = _mm512_set1_ps(ray.direction[2]),
+           va = _mm512_set1_ps(a), inverse_a = _mm512_set1_ps(1.0f / a), tmin = _mm512_set1_ps(t_min);
+    __m512 best = _mm512_set1_ps(t_max);
+    __m512i best_k = _mm512_set1_epi32(-1),
+            lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    for (size_t k = first; k < first + count; k += 16u) {
+      __mmask16 valid = count - (k - first) >= 16u ? 0xFFFF : static_cast<__mmask16>((1u << (count - (k - first))) - 1u);
+      __m512 omx = _mm512_sub_ps(ox, _mm512_loadu_ps(center[0].data() + k)),
+             omy = _mm512_sub_ps(oy, _mm512_loadu_ps(center[1].data() + k)),
+             omz = _mm512_sub_ps(oz, _mm512_loadu_ps(center[2].data() + k));
+      __m512 b = _mm512_fmadd_ps(omx, dx, _mm512_fmadd_ps(omy, dy, _mm512_mul_ps(omz, dz)));
+      __m512 c = _mm512_fmadd_ps(omx, omx, _mm512_fmadd_ps(omy, omy, _mm512_fmsub_ps(omz, omz, _mm512_loadu_ps(radius2.data() + k))));
+      __m512 d = _mm512_fmsub_ps(b, b, _mm512_mul_ps(va, c));
+      valid = _mm512_mask_cmp_ps_mask(valid, d, _mm512_setzero_ps(), _CMP_GE_OQ);
+      if (valid == 0) {
+        continue;
+      }
+      d = _mm512_maskz_sqrt_ps(valid, d); // the unmasked form starts from an undefined register, see below
+      __m512 t_near = _mm512_mul_ps(_mm512_sub_ps(_mm512_setzero_ps(), _mm512_add_ps(b, d)), inverse_a),
+             t_far = _mm512_mul_ps(_mm512_sub_ps(d, b), inverse_a);
+      __m512 t = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(t_near, tmin, _CMP_GT_OQ), t_far, t_near);
+      valid = _mm512_mask_cmp_ps_mask(valid, t, tmin, _CMP_GT_OQ);
+      valid = _mm512_mask_cmp_ps_mask(valid, t, best, _CMP_LT_OQ);
+      best = _mm512_mask_blend_ps(valid, best, t);
+      best_k = _mm512_mask_blend_epi32(valid, best_k, _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(k)), lane));
+    }
+    if (_mm512_cmp_epi32_mask(best_k, _mm512_set1_epi32(-1), _MM_CMPINT_NE) == 0) {
+      return no_hit;
+    }
+    // the lanes are reduced through memory like in the AVX2 branch, the reduce intrinsics of GCC 12 start
+    // from an undefined register and cause -Wmaybe-uninitialized warnings
+    alignas(64) float lane_t[16];
+    alignas(64) int32_t lane_k[16];
+    _mm512_store_ps(lane_t, best);
+    _mm512_store_si512(lane_k, best_k);
+    size_t hit = no_hit;
+    for (size_t l = 0; l < 16u; l++) {
+      if ( lane_k[l] >= 0 && (lane_t[l] < t_max || (lane_t[l] == t_max && static_cast<size_t>(lane_k[l]) < hit)) ) {
+        t_max = lane_t[l];
+        hit = static_cast<size_t>(lane_k[l]);
+      }
+    }
+    return hit;
+  }
+#elif defined(__AVX2__)
+  if constexpr (std::is_same_v<FLOAT, float> && N == 3u) {
+    float a = ray.direction * ray.direction;
+    __m256 ox = _mm256_set1_ps(ray.origin[0]), oy = _mm256_set1_ps(ray.origin[1]), oz = _mm256_set1_ps(ray.origin[2]),
+           dx = _mm256_set1_ps(ray.direction[0]), dy = _mm256_set1_ps(ray.direction[1]), dz = _mm256_set1_ps(ray.direction[2]),
+           va = _mm256_set1_ps(a), inverse_a = _mm256_set1_ps(1.0f / a), tmin = _mm256_set1_ps(t_min);
+    __m256 best = _mm256_set1_ps(t_max);
+    __m256i best_k = _mm256_set1_epi32(-1),
+            lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (size_t k = first; k < first + count; k += 8u) {
+      __m256 valid = _mm256_castsi256_ps( _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count - (k - first))), lane) );
+      __m256 omx = _mm256_sub_ps(ox, _mm256_loadu_ps(center[0].data() + k)),
+             omy = _mm256_sub_ps(oy, _mm256_loadu_ps(center[1].data() + k)),
+             omz = _mm256_sub_ps(oz, _mm256_loadu_ps(center[2].data() + k));
+      __m256 b = _mm256_add_ps(_mm256_mul_ps(omx, dx), _mm256_add_ps(_mm256_mul_ps(omy, dy), _mm256_mul_ps(omz, dz)));
+      __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(omx, omx), _mm256_add_ps(_mm256_mul_ps(omy, omy), _mm256_mul_ps(omz, omz))),
+                               _mm256_loadu_ps(radius2.data() + k));
+      __m256 d = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(va, c));
+      valid = _mm256_and_ps(valid, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+      if (_mm256_movemask_ps(valid) == 0) {
+        continue;
+      }
+      d = _mm256_sqrt_ps(d);
+      __m256 t_near = _mm256_mul_ps(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_add_ps(b, d)), inverse_a),
+             t_far = _mm256_mul_ps(_mm256_sub_ps(d, b), inverse_a);
+      __m256 t = _mm256_blendv_ps(t_far, t_near, _mm256_cmp_ps(t_near, tmin, _CMP_GT_OQ));
+      valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, tmin, _CMP_GT_OQ), _mm256_cmp_ps(t, best, _CMP_LT_OQ)));
+      best = _mm256_blendv_ps(best, t, valid);
+      best_k = _mm256_castps_si256( _mm256_blendv_ps(_mm256_castsi256_ps(best_k),
+                                    _mm256_castsi256_ps(_mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(k)), lane)), valid) );
+    }
+    alignas(32) float lane_t[8];
+    alignas(32) int32_t lane_k[8];
+    _mm256_store_ps(lane_t, best);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lane_k), best_k);
+    size_t hit = no_hit;
+    for (size_t l = 0; l < 8u; l++) {
+      if ( lane_k[l] >= 0 && (lane_t[l] < t_max || (lane_t[l] == t_max && static_cast<size_t>(lane_k[l]) < hit)) ) {
+        t_max = lane_t[l];
+        hit = static_cast<size_t>(lane_k[l]);
+      }
+    }
+    return hit;
+  }
+#endif
+  return closest_hit_scalar(ray, first, count, t_min, t_max);
+}
+
+
+typedef SphereSet<float, 3u> SphereSet3df;
+
+#endif
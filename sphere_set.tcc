@@ -0,0 +1,47 @@
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+template <class FLOAT, size_t N>
+SphereSet<FLOAT, N>::SphereSet(const std::vector<Sphere<FLOAT, N>> & spheres, std::span<const uint32_t> order)
+  : radius2(spheres.size() + block, -std::numeric_limits<FLOAT>::infinity()), count(spheres.size())
+{
+  assert(order.empty() || order.size() == spheres.size());
+  assert(spheres.size() <= static_cast<size_t>(INT32_MAX)); // positions are 32 bit integers in the SIMD lanes
+  for (size_t i = 0; i < N; i++) {
+    center[i].resize(spheres.size() + block, 0.0);
+  }
+  for (size_t k = 0; k < spheres.size(); k++) {
+    const Sphere<FLOAT, N> & sphere = spheres[order.empty() ? k : order[k]];
+    Vector<FLOAT, N> c = sphere.get_center();
+    for (size_t i = 0; i < N; i++) {
+      center[i][k] = c[i];
+    }
+    radius2[k] = sphere.get_radius() * sphere.get_radius();
+  }
+}
+
+template <class FLOAT, size_t N>
+SphereSet<FLOAT, N>::SphereSet(const std::vector<Sphere<FLOAT, N>> & spheres, const std::vector<uint32_t> & order)
+  : SphereSet(spheres, std::span<const uint32_t>(order))
+{
+}
+
+template <class FLOAT, size_t N>
+size_t SphereSet<FLOAT, N>::size() const {
+  return count;
+}
+
+template <class FLOAT, size_t N>
+Sphere<FLOAT, N> SphereSet<FLOAT, N>::sphere(size_t k) const {
+  Vector<FLOAT, N> c = {};
+  for (size_t i = 0; i < N; i++) {
+    c[i] = center[i][k];
+  }
+  return Sphere<FLOAT, N>(c, std::sqrt(radius2[k]));
+}
+
+template <class FLOAT, size_t N>
+size_t SphereSet<FLOAT, N>::memory_size() const {
+  return (N + 1) * radius2.size() * sizeof(FLOAT);
+}
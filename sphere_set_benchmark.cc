@@ -0,0 +1,68 @@
+#include "sphere_set.h"
+#include "bvh.h"
+#include "wide_bvh.h"
+#include "test_scenes.h"
+#include "benchmark/benchmark.h"
+#include <cmath>
+
+// SphereSet_ClosestHit<SIMD> intersects one ray with all spheres of a set, with the SIMD kernel or the scalar loop,
+// items_per_second is the number of ray sphere tests per second
+// *BVH_SphereLeaves<LEAF_WIDTH> search the closest hit in a particle scene: with LEAF_WIDTH 1 the leaves
+// are built as before and tested one sphere after the other, with LEAF_WIDTH SphereSet3df::width the
+// SAH builds leaves of up to 16 spheres that are tested with the SIMD kernel, items_per_second is the
+// number of rays per second
+
+namespace {
+
+template <bool SIMD>
+void SphereSet_ClosestHit(benchmark::State & state) {
+  SphereSet3df set( constant_density_spheres(state.range(0)) );
+  std::vector<Ray3df> rays = rays_from_origin(1024);
+  size_t r = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    float t_max = INFINITY;
+    size_t hit = SIMD ? set.closest_hit(ray, 0u, set.size(), 0.0f, t_max)
+                      : set.closest_hit_scalar(ray, 0u, set.size(), 0.0f, t_max);
+    benchmark::DoNotOptimize(hit);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <class HIERARCHY, size_t LEAF_WIDTH>
+void BVH_SphereLeaves(benchmark::State & state) {
+  std::vector<Sphere3df> spheres = constant_density_spheres(state.range(0));
+  HIERARCHY bvh( BVH3df( bounding_boxes(spheres), LEAF_WIDTH == 1u ? 4u : 16u, LEAF_WIDTH ) );
+  SphereSet3df set(spheres, bvh.primitive_indices());
+  std::vector<Ray3df> rays = rays_from_origin(1024);
+  size_t r = 0;
+
+  for (auto _ : state) {
+    const Ray3df & ray = rays[r++ % rays.size()];
+    float t_max = INFINITY;
+    size_t hit;
+    if constexpr (LEAF_WIDTH == 1u) {
+      hit = bvh.closest_hit(ray, 0.0f, t_max, [&](size_t i, float & t) {
+        return spheres[i].intersects(ray, 0.0f, t);
+      });
+    } else {
+      hit = bvh.closest_hit_leaves(ray, 0.0f, t_max, [&](uint32_t first, uint32_t count, float & t) {
+        size_t k = set.closest_hit(ray, first, count, 0.0f, t);
+        return k == SphereSet3df::no_hit ? HIERARCHY::no_hit : bvh.primitive_indices()[k];
+      });
+    }
+    benchmark::DoNotOptimize(hit);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["nodes"] = bvh.get_nodes().size();
+}
+
+}
+
+BENCHMARK_TEMPLATE(SphereSet_ClosestHit, false)->RangeMultiplier(4)->Range(16, 1 << 12);
+BENCHMARK_TEMPLATE(SphereSet_ClosestHit, true)->RangeMultiplier(4)->Range(16, 1 << 12);
+BENCHMARK_TEMPLATE(BVH_SphereLeaves, LinearBVH3df, 1u)->RangeMultiplier(8)->Range(64, 1 << 18);
+BENCHMARK_TEMPLATE(BVH_SphereLeaves, LinearBVH3df, SphereSet3df::width)->RangeMultiplier(8)->Range(64, 1 << 18);
+BENCHMARK_TEMPLATE(BVH_SphereLeaves, WideBVH8_3df, 1u)->RangeMultiplier(8)->Range(64, 1 << 18);
+BENCHMARK_TEMPLATE(BVH_SphereLeaves, WideBVH8_3df, SphereSet3df::width)->RangeMultiplier(8)->Range(64, 1 << 18);
@@ -0,0 +1,129 @@
+#include "sphere_set.h"
+#include "bvh.h"
+#include "wide_bvh.h"
+#include "test_scenes.h"
+#include "gtest/gtest.h"
+#include <random>
+
+namespace {
+
+std::vector<Ray3df> random_rays(size_t count, unsigned seed) {
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+  std::vector<Ray3df> rays;
+  for (size_t i = 0; i < count; i++) {
+    Vector3df d = { value(generator), value(generator), value(generator) };
+    d.normalize();
+    rays.push_back( Ray3df{ {5.0f * value(generator), 5.0f * value(generator), 5.0f * value(generator)}, d } );
+  }
+  return rays;
+}
+
+TEST(SPHERE_SET, Order) {
+  std::vector<Sphere3df> spheres = random_spheres(5, 1u, 0.05f, 2.0f);
+  SphereSet3df set(spheres, {4u, 2u, 0u, 1u, 3u});
+
+  ASSERT_EQ(5u, set.size());
+  EXPECT_EQ(4u * 21u * sizeof(float), set.memory_size());
+  for (size_t i = 0; i < 3; i++) {
+    EXPECT_NEAR(spheres[4].get_center()[i], set.sphere(0).get_center()[i], 0.00001);
+    EXPECT_NEAR(spheres[3].get_center()[i], set.sphere(4).get_center()[i], 0.00001);
+  }
+  EXPECT_NEAR(spheres[2].get_radius(), set.sphere(1).get_radius(), 0.00001);
+}
+
+TEST(SPHERE_SET, EmptyRange) {
+  SphereSet3df set( random_spheres(20, 2u, 0.05f, 2.0f) );
+  Ray3df ray = { {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0} };
+  float t = INFINITY;
+
+  EXPECT_EQ(SphereSet3df::no_hit, set.closest_hit(ray, 3u, 0u, 0.0f, t));
+  EXPECT_EQ(INFINITY, t);
+  EXPECT_EQ(SphereSet3df::no_hit, SphereSet3df({}).closest_hit(ray, 0u, 0u, 0.0f, t));
+}
+
+// only the spheres of the range are hit, not their neighbours in the padded SIMD loads
+TEST(SPHERE_SET, RangeExcludesNeighbours) {
+  std::vector<Sphere3df> spheres;
+  for (size_t k = 0; k < 40; k++) {
+    spheres.push_back( Sphere3df( {0.0, 0.0, -2.0f - k}, 0.25 ) );
+  }
+  SphereSet3df set(spheres);
+  Ray3df ray = { {0.0, 0.0, 0.0}, {0.0, 0.0, -1.0} };
+
+  float t = INFINITY;
+  EXPECT_EQ(5u, set.closest_hit(ray, 5u, 3u, 0.0f, t));
+  EXPECT_NEAR(6.75, t, 0.00001);
+  t = INFINITY;
+  EXPECT_EQ(17u, set.closest_hit(ray, 17u, 23u, 0.0f, t));
+  t = 10.0f;   // a closer hit was found before
+  EXPECT_EQ(SphereSet3df::no_hit, set.closest_hit(ray, 17u, 23u, 0.0f, t));
+  EXPECT_EQ(10.0f, t);
+  t = INFINITY; // the ray starts inside sphere 0, its far intersection is the closest
+  EXPECT_EQ(0u, set.closest_hit(Ray3df{ {0.0, 0.0, -2.0}, {0.0, 0.0, -1.0} }, 0u, 40u, 0.0f, t));
+  EXPECT_NEAR(0.25, t, 0.00001);
+}
+
+TEST(SPHERE_SET, ClosestHitEqualsSphereIntersects) {
+  std::vector<Sphere3df> spheres = random_spheres(100, 3u, 0.05f, 2.0f);
+  SphereSet3df set(spheres);
+  const size_t ranges[][2] = { {0u, 100u}, {3u, 13u}, {17u, 16u}, {31u, 33u}, {99u, 1u} };
+
+  for (const Ray3df & ray : random_rays(200, 4u)) {
+    for (const auto & range : ranges) {
+      float t_expected = INFINITY;
+      size_t expected = SphereSet3df::no_hit;
+      for (size_t k = range[0]; k < range[0] + range[1]; k++) {
+        if ( spheres[k].intersects(ray, 0.0f, t_expected) ) {
+          expected = k;
+        }
+      }
+
+      float t = INFINITY, t_scalar = INFINITY;
+      EXPECT_EQ(expected, set.closest_hit(ray, range[0], range[1], 0.0f, t));
+      EXPECT_EQ(expected, set.closest_hit_scalar(ray, range[0], range[1], 0.0f, t_scalar));
+      if (expected != SphereSet3df::no_hit) {
+        EXPECT_NEAR(t_expected, t, 0.001);
+        EXPECT_NEAR(t_expected, t_scalar, 0.001);
+      }
+    }
+  }
+}
+
+// the set is built in the leaf order of the bvh, so that each leaf is a range of the set
+template <class HIERARCHY>
+void expect_leaves_equal_closest_hit(const HIERARCHY & bvh, const std::vector<Sphere3df> & spheres) {
+  SphereSet3df set(spheres, bvh.primitive_indices());
+
+  for (const Ray3df & ray : random_rays(200, 6u)) {
+    float t = INFINITY, t_leaves = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t, [&](size_t i, float & t_max) {
+      return spheres[i].intersects(ray, 0.0f, t_max);
+    });
+    size_t leaf_hit = bvh.closest_hit_leaves(ray, 0.0f, t_leaves, [&](uint32_t first, uint32_t count, float & t_max) {
+      size_t k = set.closest_hit(ray, first, count, 0.0f, t_max);
+      return k == SphereSet3df::no_hit ? HIERARCHY::no_hit : bvh.primitive_indices()[k];
+    });
+
+    EXPECT_EQ(hit, leaf_hit);
+    if (hit != HIERARCHY::no_hit) {
+      EXPECT_NEAR(t, t_leaves, 0.001);
+    }
+  }
+}
+
+TEST(SPHERE_SET, LinearBVHLeaves) {
+  std::vector<Sphere3df> spheres = random_spheres(1000, 5u, 0.05f, 2.0f);
+  LinearBVH3df bvh( BVH3df( bounding_boxes(spheres), 16u, SphereSet3df::width ) );
+
+  expect_leaves_equal_closest_hit(bvh, spheres);
+}
+
+TEST(SPHERE_SET, WideBVHLeaves) {
+  std::vector<Sphere3df> spheres = random_spheres(1000, 7u, 0.05f, 2.0f);
+  WideBVH8_3df bvh( BVH3df( bounding_boxes(spheres), 16u, SphereSet3df::width ) );
+
+  expect_leaves_equal_closest_hit(bvh, spheres);
+}
+
+}
@@ -0,0 +1,84 @@
+#ifndef TEST_SCENES_H
+#define TEST_SCENES_H
+
+
+#include "geometry.h"
+#include <array>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// random scenes shared by the tests and benchmarks of the hierarchies and the sphere sets
+
+// count spheres with centers in [-10, 10]^3 and radii in [min_radius, max_radius]
+inline std::vector<Sphere3df> random_spheres(size_t count, unsigned seed, float min_radius = 0.05f, float max_radius = 0.5f) {
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+  std::uniform_real_distribution<float> radius(min_radius, max_radius);
+  std::vector<Sphere3df> spheres;
+  for (size_t i = 0; i < count; i++) {
+    spheres.push_back( Sphere3df( {position(generator), position(generator), position(generator)}, radius(generator) ) );
+  }
+  return spheres;
+}
+
+// spheres with a constant density: the edge length of the scene grows with the cubic root of count
+inline std::vector<Sphere3df> constant_density_spheres(size_t count) {
+  std::mt19937 generator(42u);
+  float extent = 2.0f * std::cbrt(static_cast<float>(count));
+  std::uniform_real_distribution<float> position(-extent, extent);
+  std::uniform_real_distribution<float> radius(0.1f, 0.5f);
+  std::vector<Sphere3df> spheres;
+  for (size_t i = 0; i < count; i++) {
+    spheres.push_back( Sphere3df( {position(generator), position(generator), position(generator)}, radius(generator) ) );
+  }
+  return spheres;
+}
+
+// count rays from the origin in random directions
+inline std::vector<Ray3df> rays_from_origin(size_t count) {
+  std::mt19937 generator(7u);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+  std::vector<Ray3df> rays;
+  for (size_t i = 0; i < count; i++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    d.normalize();
+    rays.push_back( Ray3df{ {0.0, 0.0, 0.0}, d } );
+  }
+  return rays;
+}
+
+// small triangles with a few long thin triangles across the scene, like the beams and window frames
+// of architectural meshes, whose aabbs make the children of object splits overlap
+inline std::vector<std::array<Vector3df, 3u>> random_slivers(size_t count, size_t slivers, unsigned seed) {
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+  std::vector<std::array<Vector3df, 3u>> triangles;
+  for (size_t i = 0; i < count + slivers; i++) {
+    Vector3df a = { position(generator), position(generator), position(generator) };
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    Vector3df w = { direction(generator), direction(generator), direction(generator) };
+    Vector3df b = i < count ? a + 0.2f * d : Vector3df{ position(generator), position(generator), position(generator) };
+    triangles.push_back({ a, b, a + (i < count ? 0.2f : 0.1f) * w });
+  }
+  return triangles;
+}
+
+inline std::vector<AABB3df> bounding_boxes(const std::vector<Sphere3df> & spheres) {
+  std::vector<AABB3df> boxes;
+  for (const auto & sphere : spheres) {
+    boxes.push_back( sphere.bounding_box() );
+  }
+  return boxes;
+}
+
+inline std::vector<AABB3df> bounding_boxes(const std::vector<std::array<Vector3df, 3u>> & triangles) {
+  std::vector<AABB3df> boxes;
+  for (const auto & triangle : triangles) {
+    boxes.push_back( Triangle3df(triangle[0], triangle[1], triangle[2]).bounding_box() );
+  }
+  return boxes;
+}
+
+#endif
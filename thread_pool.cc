@@ -0,0 +1,108 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t workers) {
+  workers = workers > 0 ? workers : 1u;
+  for (size_t i = 0; i < workers; i++) {
+    queues.push_back( std::make_unique<Queue>() );
+  }
+  for (size_t i = 0; i < workers; i++) {
+    threads.emplace_back( [this, i]() { work(i); } );
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  started.notify_all();
+  for (auto & thread : threads) {
+    thread.join();
+  }
+}
+
+size_t ThreadPool::default_threads() {
+  size_t threads = std::thread::hardware_concurrency();
+  return threads > 0 ? threads : 1u;
+}
+
+size_t ThreadPool::size() const {
+  return threads.size();
+}
+
+size_t ThreadPool::steals() const {
+  return stolen.load();
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)> & task) {
+  stolen = 0;
+  if (count == 0) {
+    return;
+  }
+  // the workers wait for the next generation and do not access the queues meanwhile
+  size_t workers = queues.size();
+  for (size_t w = 0; w < workers; w++) {
+    std::lock_guard<std::mutex> lock(queues[w]->mutex);
+    for (size_t i = count * w / workers; i < count * (w + 1) / workers; i++) {
+      queues[w]->indices.push_back(i);
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  this->task = &task;
+  running = workers;
+  generation++;
+  started.notify_all();
+  finished.wait(lock, [this]() { return running == 0; });
+  this->task = nullptr;
+}
+
+void ThreadPool::work(size_t worker) {
+  size_t done = 0; // the last generation this worker has finished
+  for (;;) {
+    const std::function<void(size_t)> * current;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      started.wait(lock, [&]() { return stopped || generation != done; });
+      if (stopped) {
+        return;
+      }
+      done = generation;
+      current = task;
+    }
+
+    // no indices are added during a generation, so an unsuccessful next() means that all indices are taken
+    size_t index;
+    while ( next(worker, index) ) {
+      (*current)(index);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--running == 0) {
+      finished.notify_one();
+    }
+  }
+}
+
+bool ThreadPool::next(size_t worker, size_t & index) {
+  {
+    Queue & own = *queues[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.indices.empty()) {
+      index = own.indices.front();
+      own.indices.pop_front();
+      return true;
+    }
+  }
+  for (size_t k = 1; k < queues.size(); k++) {
+    Queue & victim = *queues[(worker + k) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.indices.empty()) {
+      index = victim.indices.back();
+      victim.indices.pop_back();
+      stolen++;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,75 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// contains a thread pool with work stealing, e.g. to render the tiles of an image in parallel.
+
+
+/*
+ parallel_for(count, task) calls task(i) for all i in [0, count) on the worker threads
+
+ the indices are split into one contiguous block per worker:
+
+   worker 0 | 0 1 2 |   worker 1 | 3 4 5 |   worker 2 | 6 7 8 |
+
+ each worker takes the indices of its own block from the front. a worker with an empty block
+ steals from the back of the block of another worker, so that expensive indices (e.g. tiles
+ with reflective objects) do not leave the other workers idle.
+*/
+class ThreadPool {
+public:
+  // starts the given number of worker threads, at least one
+  explicit ThreadPool(size_t threads = default_threads());
+
+  // waits for the worker threads to finish
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool & operator=(const ThreadPool &) = delete;
+
+  // returns the number of hardware threads, or one if it is unknown
+  static size_t default_threads();
+
+  // returns the number of worker threads
+  size_t size() const;
+
+  // calls task(i) for each i in [0, count) and returns after all calls have returned
+  // task is called concurrently from different threads and must not throw
+  void parallel_for(size_t count, const std::function<void(size_t)> & task);
+
+  // returns the number of indices of the last parallel_for() that were stolen by another worker
+  size_t steals() const;
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> indices;
+  };
+
+  void work(size_t worker);
+  bool next(size_t worker, size_t & index);
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable started, finished;
+  const std::function<void(size_t)> * task = nullptr;
+  size_t generation = 0;   // number of parallel_for() calls, a change wakes up the workers
+  size_t running = 0;      // number of workers that have not finished the current generation
+  bool stopped = false;
+  std::atomic<size_t> stolen{0};
+};
+
+
+#endif
@@ -0,0 +1,58 @@
+#include "thread_pool.h"
+#include "benchmark/benchmark.h"
+#include <cmath>
+
+// measures the scaling of parallel_for() with the number of threads for the tiles of an 800x600 image
+// with 16x16 pixel tiles. the tiles in the center are 16 times more expensive than the others,
+// like tiles with reflective spheres. StaticPartition_Tiles assigns each thread a fixed block of tiles
+// for comparison, items_per_second is the number of tiles per second (wall clock)
+
+namespace {
+
+const size_t tiles_x = 50u, tiles_y = 38u;
+
+// some floating point work, 16 times more for the tiles in the center
+void render_tile(size_t tile) {
+  size_t x = tile % tiles_x, y = tile / tiles_x;
+  bool expensive = x > tiles_x / 3 && x < 2 * tiles_x / 3 && y > tiles_y / 3 && y < 2 * tiles_y / 3;
+  size_t iterations = expensive ? 16u * 4096u : 4096u;
+  float value = static_cast<float>(tile);
+  for (size_t i = 0; i < iterations; i++) {
+    value = std::sqrt(value + 1.0f);
+    benchmark::DoNotOptimize(value);
+  }
+}
+
+void ThreadPool_Tiles(benchmark::State & state) {
+  ThreadPool pool(state.range(0));
+
+  for (auto _ : state) {
+    pool.parallel_for(tiles_x * tiles_y, render_tile);
+  }
+  state.SetItemsProcessed(state.iterations() * tiles_x * tiles_y);
+  state.counters["steals"] = pool.steals();
+}
+
+void StaticPartition_Tiles(benchmark::State & state) {
+  size_t workers = state.range(0), tiles = tiles_x * tiles_y;
+
+  for (auto _ : state) {
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < workers; w++) {
+      threads.emplace_back( [=]() {
+        for (size_t i = tiles * w / workers; i < tiles * (w + 1) / workers; i++) {
+          render_tile(i);
+        }
+      } );
+    }
+    for (auto & thread : threads) {
+      thread.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * tiles);
+}
+
+}
+
+BENCHMARK(ThreadPool_Tiles)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+BENCHMARK(StaticPartition_Tiles)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
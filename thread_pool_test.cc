@@ -0,0 +1,69 @@
+#include "thread_pool.h"
+#include "gtest/gtest.h"
+#include <chrono>
+
+namespace {
+
+TEST(THREAD_POOL, AtLeastOneThread) {
+  ThreadPool pool(0u);
+
+  EXPECT_EQ(1u, pool.size());
+  EXPECT_GE(ThreadPool::default_threads(), 1u);
+}
+
+TEST(THREAD_POOL, NoIndices) {
+  ThreadPool pool(2u);
+  bool called = false;
+
+  pool.parallel_for(0u, [&](size_t) { called = true; });
+  EXPECT_FALSE(called);
+}
+
+TEST(THREAD_POOL, EachIndexOnce) {
+  ThreadPool pool(4u);
+  std::vector<std::atomic<int>> calls(1000);
+
+  pool.parallel_for(calls.size(), [&](size_t i) { calls[i]++; });
+  for (size_t i = 0; i < calls.size(); i++) {
+    EXPECT_EQ(1, calls[i].load());
+  }
+}
+
+TEST(THREAD_POOL, FewerIndicesThanThreads) {
+  ThreadPool pool(8u);
+  std::vector<std::atomic<int>> calls(3);
+
+  pool.parallel_for(calls.size(), [&](size_t i) { calls[i]++; });
+  for (size_t i = 0; i < calls.size(); i++) {
+    EXPECT_EQ(1, calls[i].load());
+  }
+}
+
+TEST(THREAD_POOL, RepeatedCalls) {
+  ThreadPool pool(3u);
+  std::atomic<size_t> sum{0};
+
+  for (size_t k = 0; k < 100; k++) {
+    pool.parallel_for(10u, [&](size_t i) { sum += i; });
+  }
+  EXPECT_EQ(100u * 45u, sum.load());
+}
+
+TEST(THREAD_POOL, StealsFromSlowWorker) {
+  ThreadPool pool(2u);
+  std::vector<std::atomic<int>> calls(20);
+
+  // the first block belongs to worker 0 and is slow, worker 1 finishes its block and steals
+  pool.parallel_for(calls.size(), [&](size_t i) {
+    if (i < 10) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    calls[i]++;
+  });
+  EXPECT_GT(pool.steals(), 0u);
+  for (size_t i = 0; i < calls.size(); i++) {
+    EXPECT_EQ(1, calls[i].load());
+  }
+}
+
+}
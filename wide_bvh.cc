@@ -0,0 +1,5 @@
+#include "wide_bvh.h"
+#include "wide_bvh.tcc"
+
+template class WideBoundingVolumeHierarchy<float, 3u, 4u>;
+template class WideBoundingVolumeHierarchy<float, 3u, 8u>;
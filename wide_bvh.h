@@ -0,0 +1,244 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+
+#include "bvh.h"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// contains a bounding volume hierarchy with WIDTH children per node (e.g. 4 = qbvh or 8)
+// the aabbs of all children of a node are tested together with SSE (WIDTH = 4) or AVX (WIDTH = 8)
+// instructions for float and N = 3, all other cases use the scalar implementation.
+
+
+/*
+ the child aabbs are stored in structure of arrays layout, i.e. for each axis
+ the lower (upper) coordinates of all children are consecutive in memory:
+
+   lower[0] | x0 x1 x2 x3 |     upper[0] | x0 x1 x2 x3 |
+   lower[1] | y0 y1 y2 y3 |     upper[1] | y0 y1 y2 y3 |
+   lower[2] | z0 z1 z2 z3 |     upper[2] | z0 z1 z2 z3 |
+
+ unused children have an empty aabb (lower = INFINITY, upper = -INFINITY) that is never hit
+*/
+template <class FLOAT, size_t N, size_t WIDTH>
+class WideBoundingVolumeHierarchy {
+public:
+  static constexpr size_t no_hit = static_cast<size_t>(-1);
+
+  struct alignas(64) Node {
+    FLOAT lower[N][WIDTH], upper[N][WIDTH];
+    uint32_t child[WIDTH];  // index of the child node, or the first primitive index for leaves
+    uint32_t count[WIDTH];  // number of primitives of a leaf child, zero for inner nodes
+    uint32_t children;      // number of used children
+  };
+
+  // collapses the binary hierarchy: the inner child with the largest surface area
+  // is replaced by its children until a node holds WIDTH children
+  explicit WideBoundingVolumeHierarchy(const BoundingVolumeHierarchy<FLOAT, N> & bvh);
+
+  // same as BoundingVolumeHierarchy::closest_hit()
+  // the hit children are visited in the order of their distance to the ray origin
+  template <class INTERSECT>
+  size_t closest_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t, INTERSECT intersect) const;
+
+  // same as LinearBoundingVolumeHierarchy::closest_hit_leaves(), without masks
+  template <class INTERSECT_LEAF>
+  size_t closest_hit_leaves(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t, INTERSECT_LEAF intersect_leaf) const;
+
+  // same as BoundingVolumeHierarchy::any_hit()
+  // the hit children are pushed unsorted, their entry values are not needed
+  template <class OCCLUDES>
+  size_t any_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max, OCCLUDES occludes) const;
+
+  // tests the ray against all child aabbs of node within [query.t_min, query.t_max]
+  // bit i of the result is set iff child i is hit, t_near[i] is set to its entry value
+  static unsigned intersects(const Node & node, const RayQuery<FLOAT, N> & query, FLOAT * t_near);
+
+  // scalar implementation of intersects(), used if no SIMD instructions are available
+  static unsigned intersects_scalar(const Node & node, const RayQuery<FLOAT, N> & query, FLOAT * t_near);
+
+  const std::vector<Node> & get_nodes() const;
+
+  // the primitive indices in leaf order
+  const std::vector<uint32_t> & primitive_indices() const;
+
+  // returns the number of bytes used by the nodes and primitive indices
+  size_t memory_size() const;
+
+private:
+  uint32_t collapse(const typename BoundingVolumeHierarchy<FLOAT, N>::Node * node);
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> indices;
+};
+
+
+template <class FLOAT, size_t N, size_t WIDTH>
+inline unsigned WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::intersects_scalar(const Node & node, const RayQuery<FLOAT, N> & query, FLOAT * t_near) {
+  unsigned mask = 0;
+  for (size_t c = 0; c < WIDTH; c++) {
+    FLOAT t0 = query.t_min, t1 = query.t_max;
+    for (size_t i = 0; i < N; i++) {
+      FLOAT near = ( (query.negative[i] ? node.upper[i][c] : node.lower[i][c]) - query.origin[i] ) * query.inverse_direction[i];
+      FLOAT far = ( (query.negative[i] ? node.lower[i][c] : node.upper[i][c]) - query.origin[i] ) * query.inverse_direction[i];
+      t0 = near > t0 ? near : t0;
+      t1 = far < t1 ? far : t1;
+    }
+    t_near[c] = t0;
+    mask |= static_cast<unsigned>(t0 <= t1) << c;
+  }
+  return mask;
+}
+
+template <class FLOAT, size_t N, size_t WIDTH>
+inline unsigned WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::intersects(const Node & node, const RayQuery<FLOAT, N> & query, FLOAT * t_near) {
+#if defined(__SSE__)
+  if constexpr (std::is_same_v<FLOAT, float> && N == 3u && WIDTH == 4u) {
+    __m128 t0 = _mm_set1_ps(query.t_min),
+           t1 = _mm_set1_ps(query.t_max);
+    for (size_t i = 0; i < N; i++) {
+      __m128 o = _mm_set1_ps(query.origin[i]),
+             inv = _mm_set1_ps(query.inverse_direction[i]);
+      __m128 near = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(query.negative[i] ? node.upper[i] : node.lower[i]), o), inv);
+      __m128 far = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(query.negative[i] ? node.lower[i] : node.upper[i]), o), inv);
+      t0 = _mm_max_ps(near, t0); // returns the second operand if near is NaN, like the scalar slab test
+      t1 = _mm_min_ps(far, t1);
+    }
+    _mm_storeu_ps(t_near, t0);
+    return static_cast<unsigned>( _mm_movemask_ps(_mm_cmple_ps(t0, t1)) );
+  }
+#endif
+#if defined(__AVX__)
+  if constexpr (std::is_same_v<FLOAT, float> && N == 3u && WIDTH == 8u) {
+    __m256 t0 = _mm256_set1_ps(query.t_min),
+           t1 = _mm256_set1_ps(query.t_max);
+    for (size_t i = 0; i < N; i++) {
+      __m256 o = _mm256_set1_ps(query.origin[i]),
+             inv = _mm256_set1_ps(query.inverse_direction[i]);
+      __m256 near = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(query.negative[i] ? node.upper[i] : node.lower[i]), o), inv);
+      __m256 far = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(query.negative[i] ? node.lower[i] : node.upper[i]), o), inv);
+      t0 = _mm256_max_ps(near, t0);
+      t1 = _mm256_min_ps(far, t1);
+    }
+    _mm256_storeu_ps(t_near, t0);
+    return static_cast<unsigned>( _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)) );
+  }
+#endif
+  return intersects_scalar(node, query, t_near);
+}
+
+// the traversal is a template wrt the intersection function and therefore defined in this header
+// each stack entry is either a node (count == 0) or a leaf range, both with the entry value of their aabb
+template <class FLOAT, size_t N, size_t WIDTH>
+template <class INTERSECT>
+size_t WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::closest_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t, INTERSECT intersect) const {
+  return closest_hit_leaves(ray, t_min, t, [&](uint32_t first, uint32_t count, FLOAT & t_max) {
+    size_t hit = no_hit;
+    for (uint32_t i = first; i < first + count; i++) {
+      if ( intersect(indices[i], t_max) ) {
+        hit = indices[i];
+      }
+    }
+    return hit;
+  });
+}
+
+template <class FLOAT, size_t N, size_t WIDTH>
+template <class INTERSECT_LEAF>
+size_t WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::closest_hit_leaves(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT & t, INTERSECT_LEAF intersect_leaf) const {
+  if (nodes.empty()) {
+    return no_hit;
+  }
+  RayQuery<FLOAT, N> query(ray, t_min, t);
+
+  struct Entry {
+    uint32_t child, count;
+    FLOAT t_near;
+  };
+  Entry stack[BoundingVolumeHierarchy<FLOAT, N>::max_depth * WIDTH];
+  size_t top = 0;
+  stack[top++] = {0u, 0u, t_min};
+  size_t hit = no_hit;
+  alignas(32) FLOAT t_near[WIDTH];
+
+  while (top > 0) {
+    Entry entry = stack[--top];
+    if (entry.t_near > query.t_max) {
+      continue; // a closer hit was found after pushing this entry
+    }
+    if (entry.count > 0) {
+      size_t leaf_hit = intersect_leaf(entry.child, entry.count, t);
+      if (leaf_hit != no_hit) {
+        hit = leaf_hit;
+      }
+      query.t_max = t; // the address of query must not escape, to keep it in registers
+      continue;
+    }
+    const Node & node = nodes[entry.child];
+    unsigned mask = intersects(node, query, t_near);
+
+    // push the hit children sorted by descending entry value, so that the closest is popped first
+    size_t first = top;
+    for (size_t c = 0; c < WIDTH; c++) {
+      if (mask & (1u << c)) {
+        Entry child = {node.child[c], node.count[c], t_near[c]};
+        size_t k = top++;
+        while (k > first && stack[k - 1].t_near < child.t_near) {
+          stack[k] = stack[k - 1];
+          k--;
+        }
+        stack[k] = child;
+      }
+    }
+  }
+  return hit;
+}
+
+template <class FLOAT, size_t N, size_t WIDTH>
+template <class OCCLUDES>
+size_t WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::any_hit(const Ray<FLOAT, N> &ray, FLOAT t_min, FLOAT t_max, OCCLUDES occludes) const {
+  if (nodes.empty()) {
+    return no_hit;
+  }
+  RayQuery<FLOAT, N> query(ray, t_min, t_max);
+
+  struct Entry {
+    uint32_t child, count;
+  };
+  Entry stack[BoundingVolumeHierarchy<FLOAT, N>::max_depth * WIDTH];
+  size_t top = 0;
+  stack[top++] = {0u, 0u};
+  alignas(32) FLOAT t_near[WIDTH];
+
+  while (top > 0) {
+    Entry entry = stack[--top];
+    if (entry.count > 0) {
+      for (uint32_t i = entry.child; i < entry.child + entry.count; i++) {
+        if ( occludes(indices[i]) ) {
+          return indices[i];
+        }
+      }
+      continue;
+    }
+    const Node & node = nodes[entry.child];
+    for (unsigned mask = intersects(node, query, t_near); mask != 0; mask &= mask - 1) {
+      size_t c = std::countr_zero(mask);
+      stack[top++] = {node.child[c], node.count[c]};
+    }
+  }
+  return no_hit;
+}
+
+
+typedef WideBoundingVolumeHierarchy<float, 3u, 4u> WideBVH4_3df;
+typedef WideBoundingVolumeHierarchy<float, 3u, 8u> WideBVH8_3df;
+
+#endif
@@ -0,0 +1,90 @@
+#include <cmath>
+
+template <class FLOAT, size_t N, size_t WIDTH>
+WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::WideBoundingVolumeHierarchy(const BoundingVolumeHierarchy<FLOAT, N> & bvh)
+  : indices(bvh.primitive_indices().begin(), bvh.primitive_indices().end())
+{
+  if (bvh.root()) {
+    collapse(bvh.root());
+  }
+}
+
+// depth first order, returns the index of the created node
+// a binary leaf (only possible for the root) becomes the single child of a wide node
+template <class FLOAT, size_t N, size_t WIDTH>
+uint32_t WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::collapse(const typename BoundingVolumeHierarchy<FLOAT, N>::Node * node) {
+  typedef typename BoundingVolumeHierarchy<FLOAT, N>::Node BinaryNode;
+
+  std::vector<const BinaryNode *> children;
+  if (node->count > 0) {
+    children.push_back(node);
+  } else {
+    children.push_back(node->left.get());
+    children.push_back(node->right.get());
+  }
+  while (children.size() < WIDTH) {
+    size_t largest = children.size();
+    FLOAT largest_area = -1.0;
+    for (size_t c = 0; c < children.size(); c++) {
+      if (children[c]->count == 0 && children[c]->bounds.surface_area() > largest_area) {
+        largest = c;
+        largest_area = children[c]->bounds.surface_area();
+      }
+    }
+    if (largest == children.size()) {
+      break; // all children are leaves
+    }
+    const BinaryNode * inner = children[largest];
+    children[largest] = inner->left.get();
+    children.push_back(inner->right.get());
+  }
+
+  uint32_t index = static_cast<uint32_t>(nodes.size());
+  nodes.emplace_back();
+  Node & wide = nodes.back();
+  for (size_t c = 0; c < WIDTH; c++) {
+    for (size_t i = 0; i < N; i++) {
+      wide.lower[i][c] = INFINITY;
+      wide.upper[i][c] = -INFINITY;
+    }
+    wide.child[c] = 0;
+    wide.count[c] = 0;
+  }
+  wide.children = static_cast<uint32_t>(children.size());
+  for (size_t c = 0; c < children.size(); c++) {
+    Vector<FLOAT, N> lower = children[c]->bounds.get_min(),
+                     upper = children[c]->bounds.get_max();
+    for (size_t i = 0; i < N; i++) {
+      wide.lower[i][c] = lower[i];
+      wide.upper[i][c] = upper[i];
+    }
+    if (children[c]->count > 0) {
+      wide.child[c] = static_cast<uint32_t>(children[c]->first);
+      wide.count[c] = static_cast<uint32_t>(children[c]->count);
+    }
+  }
+
+  // wide is invalidated by the recursion, since nodes may be reallocated
+  for (size_t c = 0; c < children.size(); c++) {
+    if (children[c]->count == 0) {
+      uint32_t child = collapse(children[c]);
+      nodes[index].child[c] = child;
+    }
+  }
+  return index;
+}
+
+template <class FLOAT, size_t N, size_t WIDTH>
+const std::vector<typename WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::Node> & WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::get_nodes() const {
+  return nodes;
+}
+
+template <class FLOAT, size_t N, size_t WIDTH>
+const std::vector<uint32_t> & WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::primitive_indices() const {
+  return indices;
+}
+
+template <class FLOAT, size_t N, size_t WIDTH>
+size_t WideBoundingVolumeHierarchy<FLOAT, N, WIDTH>::memory_size() const {
+  return nodes.size() * sizeof(Node) + indices.size() * sizeof(uint32_t);
+}
@@ -0,0 +1,168 @@
+#include "wide_bvh.h"
+#include "test_scenes.h"
+#include "gtest/gtest.h"
+#include <random>
+
+namespace {
+
+template <class WIDE_BVH>
+void expect_closest_hit_equals_linear_search(unsigned seed) {
+  std::vector<Sphere3df> spheres = random_spheres(500, seed);
+  WIDE_BVH bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::mt19937 generator(seed + 1);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+  for (size_t r = 0; r < 200; r++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    d.normalize();
+    Ray3df ray = { {0.0, 0.0, 0.0}, d };
+
+    float t_linear = INFINITY;
+    size_t linear = WIDE_BVH::no_hit;
+    for (size_t i = 0; i < spheres.size(); i++) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_linear) {
+        t_linear = t;
+        linear = i;
+      }
+    }
+
+    float t_bvh = INFINITY;
+    size_t hit = bvh.closest_hit(ray, 0.0f, t_bvh, [&](size_t i, float & t_max) {
+      float t = spheres[i].intersects(ray);
+      if (t > 0.0f && t < t_max) {
+        t_max = t;
+        return true;
+      }
+      return false;
+    });
+
+    EXPECT_EQ(linear, hit);
+    if (linear != WIDE_BVH::no_hit) {
+      EXPECT_NEAR(t_linear, t_bvh, 0.00001);
+    }
+  }
+}
+
+template <class WIDE_BVH>
+void expect_any_hit_equals_linear_search(unsigned seed) {
+  std::vector<Sphere3df> spheres = random_spheres(500, seed);
+  WIDE_BVH bvh( BVH3df( bounding_boxes(spheres) ) );
+  std::mt19937 generator(seed + 1);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+  const float t_max = 4.0f;
+
+  for (size_t r = 0; r < 200; r++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    d.normalize();
+    Ray3df ray = { {0.0, 0.0, 0.0}, d };
+
+    bool linear = false;
+    for (size_t i = 0; i < spheres.size(); i++) {
+      linear = linear || spheres[i].occludes(ray, 0.0f, t_max);
+    }
+
+    size_t hit = bvh.any_hit(ray, 0.0f, t_max, [&](size_t i) {
+      return spheres[i].occludes(ray, 0.0f, t_max);
+    });
+
+    EXPECT_EQ(linear, hit != WIDE_BVH::no_hit);
+    if (hit != WIDE_BVH::no_hit) {
+      EXPECT_TRUE( spheres[hit].occludes(ray, 0.0f, t_max) );
+    }
+  }
+}
+
+TEST(WIDE_BVH, EmptyHierarchy) {
+  WideBVH4_3df bvh( BVH3df( {} ) );
+  Ray3df ray = { {0.0, 0.0, 0.0}, {1.0, 0.0, 0.0} };
+  float t = INFINITY;
+
+  EXPECT_TRUE(bvh.get_nodes().empty());
+  EXPECT_EQ(WideBVH4_3df::no_hit, bvh.closest_hit(ray, 0.0f, t, [](size_t, float &) { return true; }));
+  EXPECT_EQ(WideBVH4_3df::no_hit, bvh.any_hit(ray, 0.0f, t, [](size_t) { return true; }));
+}
+
+TEST(WIDE_BVH, SingleLeafRoot) {
+  WideBVH4_3df bvh( BVH3df( { Sphere3df( {0.0, 0.0, 0.0}, 1.0 ).bounding_box() } ) );
+  Ray3df ray = { {0.0, 0.0, -5.0}, {0.0, 0.0, 1.0} };
+  float t = INFINITY;
+
+  ASSERT_EQ(1u, bvh.get_nodes().size());
+  EXPECT_EQ(1u, bvh.get_nodes()[0].children);
+  EXPECT_EQ(1u, bvh.get_nodes()[0].count[0]);
+  EXPECT_EQ(0u, bvh.closest_hit(ray, 0.0f, t, [](size_t, float & t_max) { t_max = 4.0f; return true; }));
+  EXPECT_NEAR(4.0, t, 0.00001);
+}
+
+TEST(WIDE_BVH, CollapsesToWidth) {
+  std::vector<AABB3df> boxes;
+  for (size_t i = 0; i < 8; i++) {
+    boxes.push_back( Sphere3df( {4.0f * i, 0.0, 0.0}, 0.5 ).bounding_box() );
+  }
+  BVH3df binary(boxes, 1u);
+
+  WideBVH4_3df bvh4(binary);
+  WideBVH8_3df bvh8(binary);
+
+  EXPECT_EQ(4u, bvh4.get_nodes()[0].children);
+  ASSERT_EQ(1u, bvh8.get_nodes().size());
+  EXPECT_EQ(8u, bvh8.get_nodes()[0].children);
+  for (size_t c = 0; c < 8; c++) {
+    EXPECT_EQ(1u, bvh8.get_nodes()[0].count[c]);
+  }
+}
+
+TEST(WIDE_BVH, SimdEqualsScalar) {
+  WideBVH8_3df bvh( BVH3df( bounding_boxes( random_spheres(300, 8u) ) ) );
+  std::mt19937 generator(9u);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+  for (size_t r = 0; r < 50; r++) {
+    Vector3df d = { direction(generator), direction(generator), direction(generator) };
+    Vector3df origin = { direction(generator), direction(generator), direction(generator) };
+    RayQuery<float, 3u> query( Ray3df{origin, d} );
+
+    for (const auto & node : bvh.get_nodes()) {
+      alignas(32) float t_simd[8], t_scalar[8];
+      unsigned simd = WideBVH8_3df::intersects(node, query, t_simd);
+      unsigned scalar = WideBVH8_3df::intersects_scalar(node, query, t_scalar);
+
+      EXPECT_EQ(scalar, simd);
+      for (size_t c = 0; c < 8; c++) {
+        if (scalar & (1u << c)) {
+          EXPECT_NEAR(t_scalar[c], t_simd[c], 0.0001);
+        }
+      }
+    }
+  }
+}
+
+TEST(WIDE_BVH, EmptyChildIsNeverHit) {
+  WideBVH4_3df bvh( BVH3df( { Sphere3df( {0.0, 0.0, 0.0}, 1.0 ).bounding_box(), Sphere3df( {3.0, 0.0, 0.0}, 1.0 ).bounding_box() }, 1u ) );
+  RayQuery<float, 3u> query( Ray3df{ {-5.0, 0.0, 0.0}, {1.0, 0.0, 0.0} } );
+  alignas(16) float t_near[4];
+
+  ASSERT_EQ(2u, bvh.get_nodes()[0].children);
+  EXPECT_EQ(3u, WideBVH4_3df::intersects(bvh.get_nodes()[0], query, t_near));
+  EXPECT_NEAR(4.0, t_near[0], 0.00001);
+  EXPECT_NEAR(7.0, t_near[1], 0.00001);
+}
+
+TEST(WIDE_BVH, ClosestHitEqualsLinearSearch4) {
+  expect_closest_hit_equals_linear_search<WideBVH4_3df>(10u);
+}
+
+TEST(WIDE_BVH, ClosestHitEqualsLinearSearch8) {
+  expect_closest_hit_equals_linear_search<WideBVH8_3df>(12u);
+}
+
+TEST(WIDE_BVH, AnyHitEqualsLinearSearch4) {
+  expect_any_hit_equals_linear_search<WideBVH4_3df>(14u);
+}
+
+TEST(WIDE_BVH, AnyHitEqualsLinearSearch8) {
+  expect_any_hit_equals_linear_search<WideBVH8_3df>(16u);
+}
+
+}